@@ -0,0 +1,778 @@
+// Measures each phase of Branchlets generation on a synthetic tree.  Build this headless (BRANCHLETS_HEADLESS) and run e.g.
+//
+//     Benchmark --branches 20000 --segments 12 --sides 8 --bend 15 --taper 0.92 --threads 0 --repeat 5
+//
+// --decimate, --decimate-radius and --decimate-deviation merge segments with decimateSegments() before anything is timed, taking
+// the largest bend in degrees, the largest radius change as a fraction, and the largest deviation in world units.  The synthetic
+// tree bends at every joint, so to have something to merge, --subdivide splits each of its segments into that many straight pieces
+//
+// When built with BRANCHLETS_STATS, --stats writes the generation statistics gathered over the whole run to a JSON file, and
+// --trace records every timed scope and writes them to a Chrome trace file
+//
+// --chunk-size and --chunk-verts also time createChunks(), splitting the tree by grid cells of that edge length and by that many
+// vertices per chunk
+//
+// --bvh times building Branchlets::capsuleBvh() over the tree, finding every pair of segments that overlap, and that many nearest
+// point and ray queries
+//
+// --submit-cost also times submitting the chunks to a LocalChunkSink that spends that many nanoseconds per vertex, standing in
+// for MFnMesh::create(), first after every chunk has been built and then through a ChunkPipeline that builds while it submits
+//
+// --shapes makes every branch a copy of one of that many shapes, moved and turned at random, and also times finding the shapes
+// with BranchletInstances and copying them into a mesh with addInstances()
+//
+// --cache times addMany() with a MeshCache in that directory, once storing the tree and then again loading it back
+//
+// --normals 1 also times addMany() into reused memory with normals and tangents kept, to compare with "reset + addMany"
+//
+// --vertex-cache times reordering a copy of the whole mesh for a GPU vertex cache of that many entries, and reports the average
+// cache miss ratio before and after
+//
+// --write-stream writes the synthetic tree (after any decimation) to a segment stream file for the Cli project, instead of timing anything
+//
+// Every phase is run 'repeat' times and the fastest run is reported, along with the heap allocations it made and the most
+// heap memory that was in use at once while it ran
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "Branchlets.h"
+#include "Chunks.h"
+#include "Decimate.h"
+#include "Instancing.h"
+#include "MeshCache.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "SegmentStream.h"
+#include "Stats.h"
+#include "SyntheticTree.h"
+#include "VertexCache.h"
+
+// Every allocation in the program goes through these counters.  Each block is prefixed with its size so that frees can be
+// subtracted from the number of bytes in use
+static std::atomic<long long> allocationCount(0);
+static std::atomic<long long> bytesInUse(0);
+static std::atomic<long long> peakBytesInUse(0);
+
+static const size_t allocationHeader = 16;
+
+void* operator new(size_t size) {
+
+	void* block = std::malloc(size + allocationHeader);
+	if (block == nullptr)
+		throw std::bad_alloc();
+
+	*static_cast<size_t*>(block) = size;
+
+	allocationCount++;
+	long long inUse = (bytesInUse += static_cast<long long>(size));
+	long long peak = peakBytesInUse.load();
+	while (inUse > peak && !peakBytesInUse.compare_exchange_weak(peak, inUse)) {}
+
+	return static_cast<char*>(block) + allocationHeader;
+}
+
+void operator delete(void* pointer) noexcept {
+
+	if (pointer == nullptr)
+		return;
+
+	void* block = static_cast<char*>(pointer) - allocationHeader;
+	bytesInUse -= static_cast<long long>(*static_cast<size_t*>(block));
+	std::free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete[](void* pointer) noexcept { operator delete(pointer); }
+
+void operator delete(void* pointer, size_t) noexcept { operator delete(pointer); }
+
+void operator delete[](void* pointer, size_t) noexcept { operator delete(pointer); }
+
+struct PhaseResult {
+
+	double seconds = 0.;
+	long long allocations = 0;
+	long long peakBytes = 0;
+};
+
+// Run 'phase' 'repeat' times, with 'setup' before each run outside of the timing, and keep the fastest run
+static PhaseResult measure(int repeat, const std::function<void()>& setup, const std::function<void()>& phase) {
+
+	PhaseResult best;
+	best.seconds = 1e30;
+
+	for (int r = 0; r < repeat; r++) {
+
+		setup();
+
+		long long allocationsBefore = allocationCount.load();
+		peakBytesInUse = bytesInUse.load();
+		long long bytesBefore = bytesInUse.load();
+
+		auto start = std::chrono::steady_clock::now();
+		phase();
+		auto end = std::chrono::steady_clock::now();
+
+		double seconds = std::chrono::duration<double>(end - start).count();
+		if (seconds < best.seconds) {
+
+			best.seconds = seconds;
+			best.allocations = allocationCount.load() - allocationsBefore;
+			best.peakBytes = peakBytesInUse.load() - bytesBefore;
+		}
+	}
+
+	return best;
+}
+
+static void report(const char* name, const PhaseResult& result, long long segments, long long verts) {
+
+	std::printf("%-34s %10.3f %14.0f %14.0f %12lld %10.2f\n", name, result.seconds * 1000., segments / result.seconds, verts / result.seconds,
+		result.allocations, result.peakBytes / (1024. * 1024.));
+}
+
+// Has access to the internals of Branchlets and BranchletStrips so that each phase can be run on its own
+class BranchletsBenchmark {
+
+	const std::vector<BBranch>& branches;
+	const int sides;
+	const int repeat;
+	const unsigned threadCount;
+
+	long long segmentCount = 0;
+	long long ringCount = 0;
+
+	// Results are accumulated here so the compiler can't discard the work being timed
+	volatile double sink = 0.;
+
+public:
+
+	BranchletsBenchmark(const std::vector<BBranch>& Branches, int Sides, int Repeat, unsigned ThreadCount)
+		: branches(Branches), sides(Sides), repeat(Repeat), threadCount(ThreadCount) {
+
+		for (const BBranch& branch : branches) {
+
+			segmentCount += branch.segments.size();
+			ringCount += branch.segments.size() + 1;
+		}
+	}
+
+	void run() {
+
+		if (sides > 2)
+			runTubes();
+		else
+			runStrips();
+	}
+
+private:
+
+	MeshCounts countAll() const {
+
+		MeshCounts total;
+		for (const BBranch& branch : branches)
+			total += sides > 2 ? Branchlets::countOne(static_cast<int>(branch.segments.size()), sides) : BranchletStrips::countOne(static_cast<int>(branch.segments.size()));
+
+		return total;
+	}
+
+	void runTubes() {
+
+		const MeshCounts total = countAll();
+		const long long verts = total.verts;
+
+		std::printf("Branchlets: %zu branches, %lld segments, %d sides, %lld vertices, %d faces\n\n", branches.size(), segmentCount, sides, verts, total.faces);
+		std::printf("%-34s %10s %14s %14s %12s %10s\n", "phase", "ms", "segments/s", "vertices/s", "allocations", "peak MB");
+
+		Branchlets branchlets(sides);
+
+		report("findEllipseVectors", measure(repeat, [] {}, [&] {
+
+			BVector major, minor;
+			double total = 0.;
+
+			for (const BBranch& branch : branches) {
+
+				const std::vector<BSegment>& segs = branch.segments;
+				BVector center = branch.startPoint;
+
+				branchlets.findEllipseVectors(major, minor, segs[0]);
+				total += major.x;
+				center += segs[0].v;
+
+				for (size_t i = 0; i + 1 < segs.size(); i++) {
+
+					branchlets.findEllipseVectors(major, minor, center, segs[i], segs[i + 1]);
+					total += major.x;
+					center += segs[i + 1].v;
+				}
+
+				branchlets.findEllipseVectors(major, minor, segs.back());
+				total += major.x;
+			}
+
+			sink = sink + total;
+		}), segmentCount, verts);
+
+		// Find every ring's ellipse up front so that makeVertexRing can be timed on its own
+		struct Ring { BVector major, minor, center, next; };
+		std::vector<Ring> rings;
+		rings.reserve(ringCount);
+
+		for (const BBranch& branch : branches) {
+
+			const std::vector<BSegment>& segs = branch.segments;
+			Ring ring;
+			ring.center = branch.startPoint;
+
+			branchlets.findEllipseVectors(ring.major, ring.minor, segs[0]);
+			ring.next = segs[0].v;
+			rings.push_back(ring);
+			ring.center += segs[0].v;
+
+			for (size_t i = 0; i + 1 < segs.size(); i++) {
+
+				branchlets.findEllipseVectors(ring.major, ring.minor, ring.center, segs[i], segs[i + 1]);
+				ring.next = segs[i + 1].v;
+				rings.push_back(ring);
+				ring.center += segs[i + 1].v;
+			}
+
+			branchlets.findEllipseVectors(ring.major, ring.minor, segs.back());
+			ring.next = segs.back().v;
+			rings.push_back(ring);
+		}
+
+		report("makeVertexRing", measure(repeat, [&] { branchlets.mesh.resize(total); }, [&] {
+
+			const RingTable& ringTable = getRingTable(sides);
+			int vertIndex = 0;
+
+			for (const Ring& ring : rings)
+				branchlets.makeVertexRing(ring.major, ring.minor, ring.center, ringTable, ring.next, vertIndex);
+		}), segmentCount, verts);
+
+		report("makeVertexCoords", measure(repeat, [&] { branchlets.mesh.resize(total); }, [&] {
+
+			int vertIndex = 0;
+			for (const BBranch& branch : branches) {
+
+				branchlets.makeVertexCoords(branch.startPoint, branch.segments, sides, vertIndex);
+				vertIndex += Branchlets::countOne(static_cast<int>(branch.segments.size()), sides).verts;
+			}
+		}), segmentCount, verts);
+
+		report("makeUVs", measure(repeat, [] {}, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				const int segs = static_cast<int>(branch.segments.size());
+				branchlets.makeUVs(branch.segments, segs, sides, 1., branch.vOffset, at.verts, at.uvs, 0);
+				at += Branchlets::countOne(segs, sides);
+			}
+		}), segmentCount, verts);
+
+		report("makeVertexCoordsAndUVs", measure(repeat, [&] { branchlets.mesh.resize(total); }, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				branchlets.makeVertexCoordsAndUVs(branch.startPoint, branch.segments, sides, branch.vOffset, at.verts, at.uvs);
+				at += Branchlets::countOne(static_cast<int>(branch.segments.size()), sides);
+			}
+		}), segmentCount, verts);
+
+		// The same with the number of sides only known at run time, as it is for side counts that have no specialization
+		report("makeVertexCoordsAndUVs (generic)", measure(repeat, [&] { branchlets.mesh.resize(total); }, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				branchlets.makeVertexCoordsAndUVsFor<0, false>(branch.startPoint, branch.segments, sides, branch.vOffset, at.verts, at.uvs);
+				at += Branchlets::countOne(static_cast<int>(branch.segments.size()), sides);
+			}
+		}), segmentCount, verts);
+
+		// The same with each ring's frame carried up from the one below rather than found with trig
+		branchlets.setFrameMode(FrameMode::RotationMinimizing);
+		report("makeVertexCoordsAndUVs (RMF)", measure(repeat, [&] { branchlets.mesh.resize(total); }, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				branchlets.makeVertexCoordsAndUVs(branch.startPoint, branch.segments, sides, branch.vOffset, at.verts, at.uvs);
+				at += Branchlets::countOne(static_cast<int>(branch.segments.size()), sides);
+			}
+		}), segmentCount, verts);
+		branchlets.setFrameMode(FrameMode::Ellipse);
+
+		report("makeConnects", measure(repeat, [] {}, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				const int segs = static_cast<int>(branch.segments.size());
+				branchlets.makeConnects(getTopologyTemplate(segs, sides), at);
+				at += Branchlets::countOne(segs, sides);
+			}
+		}), segmentCount, verts);
+
+		report("addOne (each branch)", measure(repeat, [&] { branchlets = Branchlets(sides); }, [&] {
+
+			for (const BBranch& branch : branches)
+				branchlets.addOne(branch.startPoint, branch.segments, branch.vOffset);
+		}), segmentCount, verts);
+
+		report("addMany (1 thread)", measure(repeat, [&] { branchlets = Branchlets(sides); }, [&] {
+
+			branchlets.addMany(branches, 1);
+		}), segmentCount, verts);
+
+		// With one thread this would only repeat the row above
+		if (resolveThreadCount(threadCount) > 1) {
+
+			std::string threaded = "addMany (" + std::to_string(resolveThreadCount(threadCount)) + " threads)";
+			report(threaded.c_str(), measure(repeat, [&] { branchlets = Branchlets(sides); }, [&] {
+
+				branchlets.addMany(branches, threadCount);
+			}), segmentCount, verts);
+		}
+
+		// A rebuild into an object that has already held this many branches reuses all of its memory
+		report("reset + addMany (1 thread)", measure(repeat, [&] { branchlets.reset(); branchlets.addMany(branches, 1); branchlets.reset(); }, [&] {
+
+			branchlets.addMany(branches, 1);
+		}), segmentCount, verts);
+	}
+
+	void runStrips() {
+
+		const MeshCounts total = countAll();
+		const long long verts = total.verts;
+
+		std::printf("BranchletStrips: %zu strips, %lld segments, %lld vertices, %d faces\n\n", branches.size(), segmentCount, verts, total.faces);
+		std::printf("%-34s %10s %14s %14s %12s %10s\n", "phase", "ms", "segments/s", "vertices/s", "allocations", "peak MB");
+
+		BranchletStrips strips;
+
+		report("makeVertexCoords", measure(repeat, [&] { strips.mesh.resize(total); }, [&] {
+
+			int vertIndex = 0;
+			for (const BBranch& branch : branches) {
+
+				strips.makeVertexCoords(branch.startPoint, branch.segments, 2, vertIndex);
+				vertIndex += BranchletStrips::countOne(static_cast<int>(branch.segments.size())).verts;
+			}
+		}), segmentCount, verts);
+
+		report("makeUVs", measure(repeat, [] {}, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				const int segs = static_cast<int>(branch.segments.size());
+				strips.makeUVs(branch.segments, segs, 1., branch.vOffset, at.verts, at.uvs, 0);
+				at += BranchletStrips::countOne(segs);
+			}
+		}), segmentCount, verts);
+
+		report("makeVertexCoordsAndUVs", measure(repeat, [&] { strips.mesh.resize(total); }, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				strips.makeVertexCoordsAndUVs(branch.startPoint, branch.segments, branch.vOffset, at.verts, at.uvs);
+				at += BranchletStrips::countOne(static_cast<int>(branch.segments.size()));
+			}
+		}), segmentCount, verts);
+
+		report("makeConnects", measure(repeat, [] {}, [&] {
+
+			MeshCounts at;
+			for (const BBranch& branch : branches) {
+
+				const int segs = static_cast<int>(branch.segments.size());
+				strips.makeConnects(getTopologyTemplate(segs, 2), at);
+				at += BranchletStrips::countOne(segs);
+			}
+		}), segmentCount, verts);
+
+		report("addOne (each strip)", measure(repeat, [&] { strips = BranchletStrips(); }, [&] {
+
+			for (const BBranch& branch : branches)
+				strips.addOne(branch.startPoint, branch.segments, branch.vOffset);
+		}), segmentCount, verts);
+
+		report("addMany (1 thread)", measure(repeat, [&] { strips = BranchletStrips(); }, [&] {
+
+			strips.addMany(branches, 1);
+		}), segmentCount, verts);
+
+		// With one thread this would only repeat the row above
+		if (resolveThreadCount(threadCount) > 1) {
+
+			std::string threaded = "addMany (" + std::to_string(resolveThreadCount(threadCount)) + " threads)";
+			report(threaded.c_str(), measure(repeat, [&] { strips = BranchletStrips(); }, [&] {
+
+				strips.addMany(branches, threadCount);
+			}), segmentCount, verts);
+		}
+
+		// A rebuild into an object that has already held this many branches reuses all of its memory
+		report("reset + addMany (1 thread)", measure(repeat, [&] { strips.reset(); strips.addMany(branches, 1); strips.reset(); }, [&] {
+
+			strips.addMany(branches, 1);
+		}), segmentCount, verts);
+	}
+};
+
+int main(int argc, char* argv[]) {
+
+	SyntheticTreeSettings settings;
+	int sides = 8;
+	int repeat = 3;
+	unsigned threadCount = 0;
+	DecimateSettings decimateSettings;
+	bool decimate = false;
+	std::string statsPath;
+	std::string tracePath;
+	std::string streamPath;
+	ChunkSettings chunkSettings;
+	int bvhQueryCount = 0;
+	std::string cachePath;
+	double submitCost = -1.;
+	bool normals = false;
+	int cacheSize = 0;
+
+	for (int i = 1; i < argc; i += 2) {
+
+		const std::string option = argv[i];
+
+		if (i + 1 == argc) {
+
+			std::fprintf(stderr, "Option %s needs a value\n", option.c_str());
+			return 1;
+		}
+
+		const char* value = argv[i + 1];
+
+		if (option == "--branches") settings.branchCount = std::atoi(value);
+		else if (option == "--segments") settings.segmentCount = std::atoi(value);
+		else if (option == "--sides") sides = std::atoi(value);
+		else if (option == "--bend") settings.bendAngle = static_cast<float>(std::atof(value));
+		else if (option == "--subdivide") settings.subdivisions = std::max(1, std::atoi(value));
+		else if (option == "--taper") settings.radiusTaper = static_cast<float>(std::atof(value));
+		else if (option == "--radius") settings.startRadius = static_cast<float>(std::atof(value));
+		else if (option == "--length") settings.segmentLength = static_cast<float>(std::atof(value));
+		else if (option == "--seed") settings.seed = std::strtoull(value, nullptr, 10);
+		else if (option == "--threads") threadCount = static_cast<unsigned>(std::atoi(value));
+		else if (option == "--repeat") repeat = std::max(1, std::atoi(value));
+		else if (option == "--stats") statsPath = value;
+		else if (option == "--trace") tracePath = value;
+		else if (option == "--write-stream") streamPath = value;
+		else if (option == "--chunk-size") chunkSettings.cellSize = static_cast<float>(std::atof(value));
+		else if (option == "--chunk-verts") chunkSettings.maxVerts = std::atoi(value);
+		else if (option == "--cache") cachePath = value;
+		else if (option == "--submit-cost") submitCost = std::atof(value);
+		else if (option == "--shapes") settings.shapeCount = std::max(1, std::atoi(value));
+		else if (option == "--normals") normals = std::atoi(value) != 0;
+		else if (option == "--vertex-cache") cacheSize = std::max(0, std::atoi(value));
+		else if (option == "--bvh") bvhQueryCount = std::max(1, std::atoi(value));
+		else if (option == "--decimate") { decimate = true; decimateSettings.maxAngle = static_cast<float>(std::atof(value) * 3.14159265358979 / 180.); }
+		else if (option == "--decimate-radius") { decimate = true; decimateSettings.maxRadiusChange = static_cast<float>(std::atof(value)); }
+		else if (option == "--decimate-deviation") { decimate = true; decimateSettings.maxDeviation = static_cast<float>(std::atof(value)); }
+		else {
+
+			std::fprintf(stderr, "Unknown option %s\n", option.c_str());
+			return 1;
+		}
+	}
+
+	if (sides < 2 || settings.branchCount < 1 || settings.segmentCount < 1) {
+
+		std::fprintf(stderr, "Need at least 2 sides, 1 branch and 1 segment\n");
+		return 1;
+	}
+
+	std::vector<BBranch> branches = makeSyntheticTree(settings);
+
+	if (decimate) {
+
+		size_t before = 0;
+		size_t after = 0;
+		for (const BBranch& branch : branches)
+			before += branch.segments.size();
+
+		decimateSettings.sides = sides;
+		branches = decimateBranches(branches, decimateSettings);
+		for (const BBranch& branch : branches)
+			after += branch.segments.size();
+
+		std::printf("Decimated %zu segments to %zu\n\n", before, after);
+	}
+
+	if (!streamPath.empty()) {
+
+		SegmentStreamWriter writer(streamPath);
+		for (const BBranch& branch : branches)
+			writer.write(branch.startPoint, branch.segments, branch.vOffset);
+
+		return writer.finish() ? 0 : 1;
+	}
+
+#ifndef BRANCHLETS_STATS
+	if (!statsPath.empty() || !tracePath.empty())
+		std::fprintf(stderr, "Statistics are only gathered when built with BRANCHLETS_STATS\n");
+#endif
+
+	resetGenerationStats();
+	setStatTracing(!tracePath.empty());
+
+	BranchletsBenchmark benchmark(branches, sides, repeat, threadCount);
+	benchmark.run();
+
+	if (chunkSettings.cellSize > 0.f || chunkSettings.maxVerts > 0) {
+
+		long long segmentCount = 0;
+		long long vertCount = 0;
+		for (const BBranch& branch : branches) {
+
+			const int segs = static_cast<int>(branch.segments.size());
+			segmentCount += segs;
+			vertCount += sides > 2 ? Branchlets::countOne(segs, sides).verts : BranchletStrips::countOne(segs).verts;
+		}
+
+		size_t chunkCount = 0;
+		std::string name = "createChunks (" + std::to_string(resolveThreadCount(threadCount)) + " threads)";
+
+		report(name.c_str(), measure(repeat, [] {}, [&] {
+
+			chunkCount = createChunks(branches, sides, chunkSettings, threadCount).size();
+		}), segmentCount, vertCount);
+
+		if (submitCost >= 0.) {
+
+			const double secondsPerVert = submitCost * 1e-9;
+
+			report("build, then submit", measure(repeat, [] {}, [&] {
+
+				LocalChunkSink sink(nullptr, secondsPerVert);
+				std::vector<BranchletChunk> chunks = createChunks(branches, sides, chunkSettings, threadCount);
+
+				for (int i = 0; i < static_cast<int>(chunks.size()); i++)
+					sink.submit(i, chunks[i]);
+			}), segmentCount, vertCount);
+
+			PipelineResult pipelined;
+			PipelineSettings pipelineSettings;
+			pipelineSettings.threadCount = threadCount;
+
+			report("pipeline", measure(repeat, [] {}, [&] {
+
+				LocalChunkSink sink(nullptr, secondsPerVert);
+				ChunkPipeline pipeline;
+				pipelined = pipeline.run(branches, sides, chunkSettings, sink, pipelineSettings);
+			}), segmentCount, vertCount);
+
+			std::printf("\nPipeline: %.1f ms submitting, %.1f ms waiting for chunks\n", pipelined.submitSeconds * 1000., pipelined.waitSeconds * 1000.);
+		}
+
+		std::printf("\n%zu chunks\n", chunkCount);
+	}
+
+	if (!cachePath.empty() && sides > 2) {
+
+		long long segmentCount = 0;
+		long long vertCount = 0;
+		for (const BBranch& branch : branches) {
+
+			const int segs = static_cast<int>(branch.segments.size());
+			segmentCount += segs;
+			vertCount += Branchlets::countOne(segs, sides).verts;
+		}
+
+		// Each miss clears the cache first so that it has to generate and store the tree
+		MeshCache cache(cachePath);
+		Branchlets mesh(sides);
+		mesh.setCache(&cache);
+		mesh.addMany(branches, threadCount);
+
+		report("addMany (cache miss)", measure(repeat, [&] { mesh.reset(); cache.clear(); }, [&] {
+
+			mesh.addMany(branches, threadCount);
+		}), segmentCount, vertCount);
+
+		report("addMany (cache hit)", measure(repeat, [&] { mesh.reset(); }, [&] {
+
+			mesh.addMany(branches, threadCount);
+		}), segmentCount, vertCount);
+
+		const MeshCacheStats cacheStats = cache.stats();
+		std::printf("\n%lld hits, %lld misses, %.1f MB in the cache\n", cacheStats.hits, cacheStats.misses, cache.sizeBytes() / (1024. * 1024.));
+	}
+
+	if (normals) {
+
+		long long segmentCount = 0;
+		long long vertCount = 0;
+		for (const BBranch& branch : branches) {
+
+			const int segs = static_cast<int>(branch.segments.size());
+			segmentCount += segs;
+			vertCount += sides > 2 ? Branchlets::countOne(segs, sides).verts : BranchletStrips::countOne(segs).verts;
+		}
+
+		std::unique_ptr<Branchlets> mesh = BranchletCreator().createDefault(sides);
+		mesh->setNormals(true);
+		mesh->addMany(branches, 1);
+
+		report("reset + addMany with normals (1 thread)", measure(repeat, [&] { mesh->reset(); }, [&] {
+
+			mesh->addMany(branches, 1);
+		}), segmentCount, vertCount);
+
+		std::printf("\n%.1f MB with normals and tangents\n", mesh->buffer().capacityBytes() / (1024. * 1024.));
+	}
+
+	if (cacheSize > 0) {
+
+		long long segmentCount = 0;
+		long long vertCount = 0;
+		for (const BBranch& branch : branches) {
+
+			const int segs = static_cast<int>(branch.segments.size());
+			segmentCount += segs;
+			vertCount += sides > 2 ? Branchlets::countOne(segs, sides).verts : BranchletStrips::countOne(segs).verts;
+		}
+
+		std::unique_ptr<Branchlets> mesh = BranchletCreator().createDefault(sides);
+		mesh->addMany(branches, threadCount);
+
+		// Each run reorders a fresh copy, with the optimizer's scratch memory kept from the run before
+		VertexCacheSettings cacheSettings;
+		cacheSettings.cacheSize = cacheSize;
+		VertexCacheOptimizer optimizer(cacheSettings);
+		VertexCacheStats cacheStats;
+		MeshBuffer copy;
+
+		report("optimizeVertexCache", measure(repeat, [&] { copy = mesh->buffer(); }, [&] {
+
+			cacheStats = optimizer.optimize(copy);
+		}), segmentCount, vertCount);
+
+		std::printf("\nAverage cache miss ratio %.3f before, %.3f after, over %lld triangles\n", cacheStats.acmrBefore(), cacheStats.acmrAfter(), cacheStats.triangles);
+	}
+
+	if (settings.shapeCount > 0) {
+
+		long long segmentCount = 0;
+		long long vertCount = 0;
+		for (const BBranch& branch : branches) {
+
+			const int segs = static_cast<int>(branch.segments.size());
+			segmentCount += segs;
+			vertCount += sides > 2 ? Branchlets::countOne(segs, sides).verts : BranchletStrips::countOne(segs).verts;
+		}
+
+		BranchletInstances instances;
+		std::string name = "BranchletInstances (" + std::to_string(resolveThreadCount(threadCount)) + " threads)";
+
+		report(name.c_str(), measure(repeat, [] {}, [&] {
+
+			instances = BranchletInstances(sides, branches, .001f, threadCount);
+		}), segmentCount, vertCount);
+
+		// Each run copies into an object that has already held the tree, as "reset + addMany" does
+		std::unique_ptr<Branchlets> mesh = BranchletCreator().createDefault(sides);
+		mesh->addInstances(instances, threadCount);
+
+		name = "reset + addInstances (" + std::to_string(resolveThreadCount(threadCount)) + " threads)";
+		report(name.c_str(), measure(repeat, [&] { mesh->reset(); }, [&] {
+
+			mesh->addInstances(instances, threadCount);
+		}), segmentCount, vertCount);
+
+		std::printf("\n%d shapes, %.1f MB as instances, %.1f MB as a mesh\n", instances.prototypeCount(), instances.memoryBytes() / (1024. * 1024.), mesh->buffer().capacityBytes() / (1024. * 1024.));
+	}
+
+	if (bvhQueryCount > 0 && sides > 2) {
+
+		Branchlets mesh(sides);
+		mesh.addMany(branches, threadCount);
+
+		long long segmentCount = 0;
+		for (const BBranch& branch : branches)
+			segmentCount += static_cast<long long>(branch.segments.size());
+
+		// Each run adds the branchlets again so that the hierarchy has to be rebuilt
+		report("capsuleBvh", measure(repeat, [&] { mesh.reset(); mesh.addMany(branches, threadCount); }, [&] {
+
+			mesh.capsuleBvh();
+		}), segmentCount, 0);
+
+		const CapsuleBvh& bvh = mesh.capsuleBvh();
+		std::vector<CapsulePair> pairs;
+
+		report("selfOverlaps", measure(repeat, [] {}, [&] {
+
+			bvh.selfOverlaps(pairs);
+		}), segmentCount, 0);
+
+		// Query around the middle of randomly picked segments, in random directions
+		std::vector<BVector> points(bvhQueryCount);
+		std::vector<BVector> directions(bvhQueryCount);
+		unsigned long long state = settings.seed;
+		auto random = [&state] {
+
+			state = (state * 6364136223846793005ULL) + 1442695040888963407ULL;
+			return static_cast<double>(state >> 11) / 9007199254740992.;
+		};
+
+		for (int i = 0; i < bvhQueryCount; i++) {
+
+			const Capsule& capsule = bvh.capsules()[static_cast<size_t>(random() * bvh.capsules().size()) % bvh.capsules().size()];
+			const BVector offset(random() - 0.5, random() - 0.5, random() - 0.5);
+			points[i] = ((capsule.start + capsule.end) * 0.5) + (offset * (4. * capsule.radius));
+			directions[i] = BVector(random() - 0.5, random() - 0.5, random() - 0.5).normal();
+		}
+
+		std::vector<CapsuleHit> hits;
+		std::string name = "nearest (" + std::to_string(bvhQueryCount) + " points)";
+		report(name.c_str(), measure(repeat, [] {}, [&] {
+
+			bvh.nearest(points, hits, threadCount);
+		}), segmentCount, 0);
+
+		name = "raycast (" + std::to_string(bvhQueryCount) + " rays)";
+		report(name.c_str(), measure(repeat, [] {}, [&] {
+
+			bvh.raycast(points, directions, hits, threadCount);
+		}), segmentCount, 0);
+
+		std::printf("\n%zu capsules, %zu overlapping pairs\n", bvh.capsules().size(), pairs.size());
+	}
+
+	if (!statsPath.empty()) {
+
+		std::ofstream statsFile(statsPath);
+		statsFile << getGenerationStats().toJson();
+	}
+
+	if (!tracePath.empty() && !writeChromeTrace(tracePath))
+		std::fprintf(stderr, "Couldn't write %s\n", tracePath.c_str());
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include "SyntheticTree.h"
+
+#include <algorithm>
+
+// A small self contained random generator (splitmix64), used instead of <random> so that trees are identical on every platform
+class SyntheticRandom {
+
+	unsigned long long state;
+
+public:
+
+	SyntheticRandom(unsigned long long seed) : state(seed) {}
+
+	unsigned long long next() {
+
+		unsigned long long z = (state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// A value in [-1, 1)
+	double signedUnit() {
+
+		return ((next() >> 11) * (1. / 9007199254740992.)) * 2. - 1.;
+	}
+};
+
+// Build one branch of a tree with the given settings
+static BBranch makeBranch(const SyntheticTreeSettings& settings, SyntheticRandom& random, int index, std::vector<BSegment>& segments) {
+
+	const double PI = 3.14159265358979323846;
+	const double bendRadians = settings.bendAngle * (PI / 180.);
+
+	BVector startPoint(random.signedUnit(), random.signedUnit(), random.signedUnit());
+	startPoint = startPoint * (settings.spread * .5);
+
+	// Branches lean up and outward, never straight down
+	BVector direction = BVector(random.signedUnit() * .5, 1., random.signedUnit() * .5).normal();
+	float radius = settings.startRadius;
+
+	segments.clear();
+
+	for (int s = 0; s < settings.segmentCount; s++) {
+
+		const int pieces = std::max(settings.subdivisions, 1);
+		for (int piece = 0; piece < pieces; piece++)
+			segments.push_back(BSegment(direction * (settings.segmentLength / pieces), radius));
+
+		// Bend about a random axis perpendicular to the current direction
+		BVector axis = direction ^ BVector(random.signedUnit(), random.signedUnit(), random.signedUnit());
+		if (axis.length() > 1e-6)
+			direction = direction.rotateBy(BQuaternion(bendRadians, axis)).normal();
+
+		radius *= settings.radiusTaper;
+	}
+
+	return BBranch(startPoint, segments, static_cast<float>(index % 16) * .25f);
+}
+
+std::vector<BBranch> makeSyntheticTree(const SyntheticTreeSettings& settings) {
+
+	SyntheticRandom random(settings.seed);
+	std::vector<BBranch> branches;
+	branches.reserve(settings.branchCount);
+
+	std::vector<BSegment> segments;
+
+	if (settings.shapeCount <= 0) {
+
+		for (int b = 0; b < settings.branchCount; b++)
+			branches.push_back(makeBranch(settings, random, b, segments));
+
+		return branches;
+	}
+
+	std::vector<BBranch> shapes;
+	for (int s = 0; s < settings.shapeCount; s++)
+		shapes.push_back(makeBranch(settings, random, s, segments));
+
+	for (int b = 0; b < settings.branchCount; b++) {
+
+		const BBranch& shape = shapes[random.next() % shapes.size()];
+
+		BVector startPoint(random.signedUnit(), random.signedUnit(), random.signedUnit());
+		startPoint = startPoint * (settings.spread * .5);
+
+		// Turn it by up to a half turn about a random axis
+		const BVector axis(random.signedUnit(), random.signedUnit(), random.signedUnit());
+		const BQuaternion turn(random.signedUnit() * 3.14159265358979323846, axis.length() > 1e-6 ? axis : BVector::yAxis);
+
+		segments.clear();
+		for (const BSegment& seg : shape.segments)
+			segments.push_back(BSegment(seg.v.rotateBy(turn), seg.r));
+
+		branches.push_back(BBranch(startPoint, segments, shape.vOffset));
+	}
+
+	return branches;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "Branchlets.h"
+
+// Controls the shape of a synthetic tree.  The same settings always produce exactly the same branches on every platform
+struct SyntheticTreeSettings {
+
+	int branchCount = 1000;
+
+	// Segments per branch
+	int segmentCount = 12;
+
+	float segmentLength = 1.f;
+
+	// The radius of each branch's first segment
+	float startRadius = .5f;
+
+	// Each segment's radius is the previous one's multiplied by this
+	float radiusTaper = .92f;
+
+	// The angle in degrees between each segment and the one below it, about a random axis
+	float bendAngle = 15.f;
+
+	// If more than 1, each segment is made of this many straight pieces of the same radius, as scanned or simulated branches
+	// are often sampled far more finely than their shape needs
+	int subdivisions = 1;
+
+	// Branches start at random points within a cube this wide, centered on the origin
+	float spread = 50.f;
+
+	// If more than 0, every branch is a copy of one of this many shapes, moved and turned at random, as procedural twigs often are
+	int shapeCount = 0;
+
+	unsigned long long seed = 1;
+};
+
+// Build the segment lists of a tree with the given settings
+std::vector<BBranch> makeSyntheticTree(const SyntheticTreeSettings& settings);
@@ -0,0 +1,67 @@
+#include "BMath.h"
+
+const BVector BVector::xAxis(1., 0., 0.);
+const BVector BVector::yAxis(0., 1., 0.);
+const BVector BVector::zAxis(0., 0., 1.);
+
+BVector BVector::normal() const {
+
+	double len = length();
+	return len > 0. ? *this / len : *this;
+}
+
+double BVector::angle(const BVector& other) const {
+
+	double lengths = length() * other.length();
+	if (lengths == 0.)
+		return 0.;
+
+	// Rounding can push the cosine just past +-1 for (anti)parallel vectors
+	double cosine = (*this * other) / lengths;
+	if (cosine > 1.)
+		cosine = 1.;
+	else if (cosine < -1.)
+		cosine = -1.;
+
+	return std::acos(cosine);
+}
+
+BVector BVector::rotateBy(const BQuaternion& rotation) const {
+
+	// v' = 2(u.v)u + (s^2 - u.u)v + 2s(u x v), where u is the vector part of the quaternion and s is the scalar part
+	const BVector u(rotation.x, rotation.y, rotation.z);
+	const double s = rotation.w;
+
+	return (u * (2. * (u * *this))) + (*this * ((s * s) - (u * u))) + ((u ^ *this) * (2. * s));
+}
+
+BQuaternion::BQuaternion(double angle, const BVector& axis) {
+
+	BVector unitAxis = axis.normal();
+	double halfSin = std::sin(angle / 2.);
+
+	x = unitAxis.x * halfSin;
+	y = unitAxis.y * halfSin;
+	z = unitAxis.z * halfSin;
+	w = std::cos(angle / 2.);
+}
+
+BQuaternion::BQuaternion(const BVector& from, const BVector& to) {
+
+	BVector a = from.normal();
+	BVector b = to.normal();
+	BVector axis = a ^ b;
+
+	if (axis.length() < 1e-12) {
+
+		// The vectors are parallel, so either no rotation is needed or any axis perpendicular to them will do for a half turn
+		if ((a * b) > 0.)
+			return;
+
+		axis = a ^ BVector::xAxis;
+		if (axis.length() < .001)
+			axis = a ^ BVector::zAxis;
+	}
+
+	*this = BQuaternion(a.angle(b), axis);
+}
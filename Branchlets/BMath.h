@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cmath>
+
+#ifndef BRANCHLETS_HEADLESS
+#include <maya/MVector.h>
+#include <maya/MPoint.h>
+#endif
+
+struct BQuaternion;
+
+// A double precision 3D vector or point.  The geometry code uses this in place of MVector and MPoint so that it can be built and
+// run without Maya (define BRANCHLETS_HEADLESS).  The operators follow Maya's, so * between two vectors is the dot product and ^
+// is the cross product.  In Maya builds it converts implicitly to and from MVector and MPoint
+struct BVector {
+
+	double x = 0.;
+	double y = 0.;
+	double z = 0.;
+
+	BVector() {}
+
+	BVector(double X, double Y, double Z) : x(X), y(Y), z(Z) {}
+
+#ifndef BRANCHLETS_HEADLESS
+	BVector(const MVector& v) : x(v.x), y(v.y), z(v.z) {}
+
+	BVector(const MPoint& p) : x(p.x), y(p.y), z(p.z) {}
+
+	operator MVector() const { return MVector(x, y, z); }
+
+	operator MPoint() const { return MPoint(x, y, z); }
+#endif
+
+	BVector operator+(const BVector& other) const { return BVector(x + other.x, y + other.y, z + other.z); }
+
+	BVector operator-(const BVector& other) const { return BVector(x - other.x, y - other.y, z - other.z); }
+
+	BVector operator-() const { return BVector(-x, -y, -z); }
+
+	BVector operator*(double scalar) const { return BVector(x * scalar, y * scalar, z * scalar); }
+
+	BVector operator/(double scalar) const { return BVector(x / scalar, y / scalar, z / scalar); }
+
+	BVector& operator+=(const BVector& other) { x += other.x; y += other.y; z += other.z; return *this; }
+
+	BVector& operator-=(const BVector& other) { x -= other.x; y -= other.y; z -= other.z; return *this; }
+
+	bool operator==(const BVector& other) const { return x == other.x && y == other.y && z == other.z; }
+
+	bool operator!=(const BVector& other) const { return !(*this == other); }
+
+	// Dot product
+	double operator*(const BVector& other) const { return (x * other.x) + (y * other.y) + (z * other.z); }
+
+	// Cross product
+	BVector operator^(const BVector& other) const { return BVector((y * other.z) - (z * other.y), (z * other.x) - (x * other.z), (x * other.y) - (y * other.x)); }
+
+	double length() const { return std::sqrt((x * x) + (y * y) + (z * z)); }
+
+	double distanceTo(const BVector& other) const { return (*this - other).length(); }
+
+	// A unit vector in the same direction, or this vector unchanged if it has no length
+	BVector normal() const;
+
+	// The angle in radians between this and 'other', as if they both start from the same point
+	double angle(const BVector& other) const;
+
+	BVector rotateBy(const BQuaternion& rotation) const;
+
+	static const BVector xAxis;
+	static const BVector yAxis;
+	static const BVector zAxis;
+};
+
+inline BVector operator*(double scalar, const BVector& v) { return v * scalar; }
+
+// A unit quaternion describing a rotation, standing in for MQuaternion
+struct BQuaternion {
+
+	double x = 0.;
+	double y = 0.;
+	double z = 0.;
+	double w = 1.;
+
+	BQuaternion() {}
+
+	BQuaternion(double X, double Y, double Z, double W) : x(X), y(Y), z(Z), w(W) {}
+
+	// A rotation of 'angle' radians about 'axis'
+	BQuaternion(double angle, const BVector& axis);
+
+	// The shortest rotation that turns the direction of 'from' into the direction of 'to'
+	BQuaternion(const BVector& from, const BVector& to);
+
+	BQuaternion inverse() const { return BQuaternion(-x, -y, -z, w); }
+};
@@ -1,108 +1,1272 @@
 
 #include "Branchlets.h"
+#include "FixedSides.h"
+#include "Instancing.h"
+#include "MeshCache.h"
+#include "Parallel.h"
+#include "SegmentStream.h"
+#include "Stats.h"
 
-Branchlets::Branchlets(const MPoint& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset) {
+#include <algorithm>
+#include <climits>
+
+Branchlets::Branchlets(const BVector& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset) {
 
 	this->sides = sides;
 
-	this->addOne(startPoint, branchSegments, vOffset);
+	this->addOne(startPoint, branchSegments, vOffset);
+}
+
+BranchletStrips::BranchletStrips(const BVector& startPoint, const std::vector<BSegment>& stripSegments, float vOffset) : Branchlets(2) {
+
+	this->addOne(startPoint, stripSegments, vOffset);
+}
+
+void Branchlets::reset() {
+
+	MMesh::reset();
+	recordCount = 0;
+	recordSegmentCount = 0;
+	bvhCurrent = false;
+}
+
+void Branchlets::flush() {
+
+	// The records index into the arrays that were just emptied
+	if (flushToExporter()) {
+
+		recordCount = 0;
+		recordSegmentCount = 0;
+		bvhCurrent = false;
+	}
+}
+
+int Branchlets::addRecords(int count) {
+
+	const int first = recordCount;
+	recordCount += count;
+	bvhCurrent = false;
+
+	if (static_cast<int>(records.size()) < recordCount)
+		records.resize(recordCount);
+
+	return first;
+}
+
+void Branchlets::placeRecord(int index, int segmentCount) {
+
+	BranchRecord& record = records[index];
+	record.firstSegment = recordSegmentCount;
+	record.segmentCount = segmentCount;
+	recordSegmentCount += segmentCount;
+
+	if (static_cast<int>(recordSegments.size()) < recordSegmentCount)
+		recordSegments.resize(recordSegmentCount, BSegment(BVector(), 0.f));
+}
+
+void Branchlets::setRecord(int index, const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, const MeshCounts& at, int branchSides) {
+
+	BranchRecord& record = records[index];
+	record.startPoint = startPoint;
+	record.vOffset = vOffset;
+	record.at = at;
+	record.sides = branchSides;
+	record.frameMode = frameMode;
+
+	std::copy(segs.begin(), segs.end(), recordSegments.begin() + record.firstSegment);
+}
+
+void Branchlets::addOne(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset) {
+
+	BRANCHLETS_TIME(StatPhase::AddOne);
+
+	MeshCounts at = counts();
+	MeshCounts newCounts = at;
+	newCounts += countOne(static_cast<int>(branchSegments.size()), sides);
+
+	setCounts(newCounts);
+
+	if (exporter == nullptr) {
+
+		const int record = addRecords(1);
+		placeRecord(record, static_cast<int>(branchSegments.size()));
+		setRecord(record, startPoint, branchSegments, vOffset, at, sides);
+	}
+
+	const MeshCounts start = at;
+	const uint64_t key = cache != nullptr ? cacheKey(startPoint, branchSegments, vOffset, sides) : 0;
+
+	if (!loadFromCache(key, start, newCounts)) {
+
+		fillOne(startPoint, branchSegments, vOffset, sides, at);
+		storeInCache(key, start, newCounts);
+	}
+
+	flush();
+}
+
+void BranchletStrips::addOne(const BVector& startPoint, const std::vector<BSegment>& stripSegments, float vOffset) {
+
+	BRANCHLETS_TIME(StatPhase::AddOne);
+
+	MeshCounts at = counts();
+	MeshCounts newCounts = at;
+	newCounts += countOne(static_cast<int>(stripSegments.size()));
+
+	setCounts(newCounts);
+
+	if (exporter == nullptr) {
+
+		const int record = addRecords(1);
+		placeRecord(record, static_cast<int>(stripSegments.size()));
+		setRecord(record, startPoint, stripSegments, vOffset, at, 2);
+	}
+
+	const MeshCounts start = at;
+	const uint64_t key = cache != nullptr ? cacheKey(startPoint, stripSegments, vOffset, 2) : 0;
+
+	if (!loadFromCache(key, start, newCounts)) {
+
+		fillOne(startPoint, stripSegments, vOffset, at);
+		storeInCache(key, start, newCounts);
+	}
+
+	flush();
+}
+
+void Branchlets::addMany(const std::vector<BBranch>& branches, unsigned threadCount) {
+
+	branchSides.assign(branches.size(), sides);
+	addBranches(branches, branchSides, threadCount);
+}
+
+void Branchlets::addMany(const std::vector<BBranch>& branches, const LodSettings& lod, unsigned threadCount) {
+
+	branchSides.resize(branches.size());
+	for (size_t i = 0; i < branches.size(); i++)
+		branchSides[i] = lodSides(branches[i], lod);
+
+	addBranches(branches, branchSides, threadCount);
+}
+
+void Branchlets::addMany(const std::vector<BBranch>& branches, const std::vector<int>& branchIndices, unsigned threadCount) {
+
+	branchSides.assign(branchIndices.size(), sides);
+	addBranches(BranchSelection(branches, &branchIndices), branchSides, threadCount);
+}
+
+void Branchlets::addBranches(const BranchSelection& branches, const std::vector<int>& branchSides, unsigned threadCount) {
+
+	BRANCHLETS_TIME(StatPhase::AddMany);
+
+	// The number of elements each branchlet adds depends only on its segment count and the number of sides, so a prefix
+	// sum over the segment counts gives every branchlet its own range in each array before anything is computed.
+	// This lets the arrays be allocated once, and lets each branchlet be filled independently of the others
+	const int branchCount = branches.size();
+	branchStarts.resize(branchCount);
+
+	const int firstRecord = exporter == nullptr ? addRecords(branchCount) : 0;
+
+	const MeshCounts start = counts();
+	MeshCounts newCounts = start;
+	for (int i = 0; i < branchCount; i++) {
+
+		const int segmentCount = static_cast<int>(branches[i].segments.size());
+		branchStarts[i] = newCounts;
+		newCounts += countOne(segmentCount, branchSides[i]);
+
+		if (exporter == nullptr)
+			placeRecord(firstRecord + i, segmentCount);
+	}
+
+	setCounts(newCounts);
+
+	// Every branchlet still needs its record, but those found in the cache need nothing else.  Each is looked up under its own
+	// key, the same one addOne() uses, so that changing a few branchlets of a list only generates those
+	loadBranchesFromCache(branches, branchSides, newCounts);
+
+	parallelFor(branchCount, threadCount, [&](int i) {
+
+		const BBranch& branch = branches[i];
+		MeshCounts at = branchStarts[i];
+
+		if (exporter == nullptr)
+			setRecord(firstRecord + i, branch.startPoint, branch.segments, branch.vOffset, at, branchSides[i]);
+
+		if (!cacheHits[i])
+			fillOne(branch.startPoint, branch.segments, branch.vOffset, branchSides[i], at);
+	});
+
+	storeBranchesInCache(branches, branchSides);
+
+	flush();
+}
+
+void BranchletStrips::addMany(const std::vector<BBranch>& strips, unsigned threadCount) {
+
+	addStrips(strips, threadCount);
+}
+
+void BranchletStrips::addMany(const std::vector<BBranch>& strips, const std::vector<int>& stripIndices, unsigned threadCount) {
+
+	addStrips(BranchSelection(strips, &stripIndices), threadCount);
+}
+
+void BranchletStrips::addStrips(const BranchSelection& strips, unsigned threadCount) {
+
+	BRANCHLETS_TIME(StatPhase::AddMany);
+
+	const int stripCount = strips.size();
+	branchStarts.resize(stripCount);
+
+	const int firstRecord = exporter == nullptr ? addRecords(stripCount) : 0;
+
+	const MeshCounts start = counts();
+	MeshCounts newCounts = start;
+	for (int i = 0; i < stripCount; i++) {
+
+		const int segmentCount = static_cast<int>(strips[i].segments.size());
+		branchStarts[i] = newCounts;
+		newCounts += countOne(segmentCount);
+
+		if (exporter == nullptr)
+			placeRecord(firstRecord + i, segmentCount);
+	}
+
+	setCounts(newCounts);
+
+	branchSides.assign(stripCount, 2);
+	loadBranchesFromCache(strips, branchSides, newCounts);
+
+	parallelFor(stripCount, threadCount, [&](int i) {
+
+		const BBranch& strip = strips[i];
+		MeshCounts at = branchStarts[i];
+
+		if (exporter == nullptr)
+			setRecord(firstRecord + i, strip.startPoint, strip.segments, strip.vOffset, at, 2);
+
+		if (!cacheHits[i])
+			fillOne(strip.startPoint, strip.segments, strip.vOffset, at);
+	});
+
+	storeBranchesInCache(strips, branchSides);
+
+	flush();
+}
+
+void Branchlets::addInstances(const BranchletInstances& instances, unsigned threadCount) {
+
+	BRANCHLETS_TIME(StatPhase::AddInstances);
+
+	if (instances.sideCount() != sides) {
+
+		displayWarning("Cannot add instances with " + std::to_string(instances.sideCount()) + " sides to branchlets with " + std::to_string(sides));
+		return;
+	}
+
+	const std::vector<BranchInstance>& instanceList = instances.instances();
+	const Branchlets& prototypes = instances.prototypes();
+	const MeshBuffer& source = prototypes.mesh;
+
+	const int instanceCount = static_cast<int>(instanceList.size());
+	branchStarts.resize(instanceCount);
+
+	MeshCounts newCounts = counts();
+	for (int i = 0; i < instanceCount; i++) {
+
+		branchStarts[i] = newCounts;
+		newCounts += instances.prototypeCounts(instanceList[i].prototype);
+	}
+
+	setCounts(newCounts);
+
+	const int firstRecord = exporter == nullptr ? addRecords(instanceCount) : 0;
+
+	if (exporter == nullptr)
+		for (int i = 0; i < instanceCount; i++)
+			placeRecord(firstRecord + i, prototypes.records[instanceList[i].prototype].segmentCount);
+
+	parallelFor(instanceCount, threadCount, [&](int i) {
+
+		const BranchInstance& instance = instanceList[i];
+		const RigidTransform& transform = instance.transform;
+		const MeshCounts& from = instances.prototypeStart(instance.prototype);
+		const MeshCounts count = instances.prototypeCounts(instance.prototype);
+		const MeshCounts& at = branchStarts[i];
+
+		const BranchRecord& prototype = prototypes.records[instance.prototype];
+
+		if (exporter == nullptr) {
+
+			BranchRecord& record = records[firstRecord + i];
+			record.startPoint = transform.translation;
+			record.vOffset = prototype.vOffset + instance.vShift;
+			record.at = at;
+			record.sides = sides;
+			record.frameMode = prototype.frameMode;
+
+			const BSegment* prototypeSegs = prototypes.recordSegments.data() + prototype.firstSegment;
+			BSegment* segs = recordSegments.data() + record.firstSegment;
+			for (int j = 0; j < record.segmentCount; j++) {
+
+				segs[j] = prototypeSegs[j];
+				segs[j].v = transform.rotate(prototypeSegs[j].v);
+			}
+		}
+
+		// The rotation is applied in double precision, as vertices are made, and rounded to float once
+		const double m[9] = { transform.xAxis.x, transform.yAxis.x, transform.zAxis.x, transform.xAxis.y, transform.yAxis.y, transform.zAxis.y, transform.xAxis.z, transform.yAxis.z, transform.zAxis.z };
+		const double t[3] = { transform.translation.x, transform.translation.y, transform.translation.z };
+
+		const float* inX = source.xs.data() + from.verts;
+		const float* inY = source.ys.data() + from.verts;
+		const float* inZ = source.zs.data() + from.verts;
+		float* outX = mesh.xs.data() + at.verts;
+		float* outY = mesh.ys.data() + at.verts;
+		float* outZ = mesh.zs.data() + at.verts;
+
+		for (int v = 0; v < count.verts; v++) {
+
+			const double x = inX[v];
+			const double y = inY[v];
+			const double z = inZ[v];
+
+			outX[v] = static_cast<float>((m[0] * x) + (m[1] * y) + (m[2] * z) + t[0]);
+			outY[v] = static_cast<float>((m[3] * x) + (m[4] * y) + (m[5] * z) + t[1]);
+			outZ[v] = static_cast<float>((m[6] * x) + (m[7] * y) + (m[8] * z) + t[2]);
+		}
+
+		// Normals and tangents only turn
+		if (mesh.withNormals) {
+
+			for (int v = 0; v < count.verts; v++) {
+
+				const BVector normal = transform.rotate(BVector(source.nxs[from.verts + v], source.nys[from.verts + v], source.nzs[from.verts + v]));
+				const BVector tangent = transform.rotate(BVector(source.txs[from.verts + v], source.tys[from.verts + v], source.tzs[from.verts + v]));
+
+				mesh.setNormal(at.verts + v, normal.x, normal.y, normal.z);
+				mesh.setTangent(at.verts + v, tangent.x, tangent.y, tangent.z);
+			}
+		}
+
+		std::copy_n(source.us.begin() + from.uvs, count.uvs, mesh.us.begin() + at.uvs);
+
+		const float* inV = source.vs.data() + from.uvs;
+		float* outV = mesh.vs.data() + at.uvs;
+		for (int uv = 0; uv < count.uvs; uv++)
+			outV[uv] = inV[uv] + instance.vShift;
+
+		// Connectivity only depends on the segment count and sides, so it comes from the same template as the prototype's
+		makeConnects(getTopologyTemplate(prototype.segmentCount, sides), at);
+	});
+
+	flush();
+}
+
+void Branchlets::addToCacheKey(MeshCacheKey& key, const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int branchSides) {
+
+	key.add(branchSides);
+	key.add(startPoint);
+	key.add(vOffset);
+	key.add(static_cast<int>(segs.size()));
+
+	for (const BSegment& seg : segs) {
+
+		key.add(seg.v);
+		key.add(seg.r);
+	}
+}
+
+uint64_t Branchlets::cacheKey(const BranchSelection& branches, const std::vector<int>& branchSides) const {
+
+	MeshCacheKey key;
+	key.add(static_cast<int>(frameMode));
+	key.add(branches.size());
+
+	for (int i = 0; i < branches.size(); i++)
+		addToCacheKey(key, branches[i].startPoint, branches[i].segments, branches[i].vOffset, branchSides[i]);
+
+	return key.value();
+}
+
+uint64_t Branchlets::cacheKey(const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int branchSides) const {
+
+	MeshCacheKey key;
+	key.add(static_cast<int>(frameMode));
+	key.add(1);
+	addToCacheKey(key, startPoint, segs, vOffset, branchSides);
+
+	return key.value();
+}
+
+bool Branchlets::loadFromCache(uint64_t key, const MeshCounts& at, const MeshCounts& end) {
+
+	// Cache entries don't hold normals, so a mesh that keeps them always generates its own
+	return cache != nullptr && !mesh.withNormals && cache->load(key, mesh, at, end);
+}
+
+void Branchlets::storeInCache(uint64_t key, const MeshCounts& at, const MeshCounts& end) {
+
+	if (cache != nullptr && !mesh.withNormals) {
+
+		cache->store(key, mesh, at, end);
+		cache->reportWarnings();
+	}
+}
+
+void Branchlets::loadBranchesFromCache(const BranchSelection& branches, const std::vector<int>& branchSides, const MeshCounts& end) {
+
+	const int branchCount = branches.size();
+
+	if (cache == nullptr || mesh.withNormals) {
+
+		cacheHits.assign(branchCount, 0);
+		return;
+	}
+
+	cacheRanges.resize(branchCount);
+	for (int i = 0; i < branchCount; i++) {
+
+		MeshCacheRange& range = cacheRanges[i];
+		range.key = cacheKey(branches[i].startPoint, branches[i].segments, branches[i].vOffset, branchSides[i]);
+		range.at = branchStarts[i];
+		range.end = i + 1 < branchCount ? branchStarts[i + 1] : end;
+	}
+
+	cache->load(cacheRanges, mesh, cacheHits);
+}
+
+void Branchlets::storeBranchesInCache(const BranchSelection& branches, const std::vector<int>& branchSides) {
+
+	if (cache == nullptr || mesh.withNormals)
+		return;
+
+	// Only the branchlets that were generated are stored, so nothing is in the cache twice
+	size_t missCount = 0;
+	for (size_t i = 0; i < cacheRanges.size(); i++)
+		if (!cacheHits[i])
+			cacheRanges[missCount++] = cacheRanges[i];
+
+	if (missCount > 0) {
+
+		cacheRanges.resize(missCount);
+		cache->store(cacheKey(branches, branchSides), cacheRanges, mesh);
+	}
+
+	cache->reportWarnings();
+}
+
+void Branchlets::addStream(const SegmentStream& stream, int firstBranch, int count, unsigned threadCount) {
+
+	BRANCHLETS_TIME(StatPhase::AddStream);
+
+	const int lastBranch = std::min(firstBranch + count, stream.branchCount());
+
+	// Only the small header of each branchlet is read here, to lay out the arrays as addMany() does
+	streamBranches.clear();
+	branchStarts.clear();
+	branchSides.clear();
+
+	MeshCounts newCounts = counts();
+	long long connects = newCounts.faceConnects;
+	for (int i = std::max(firstBranch, 0); i < lastBranch; i++) {
+
+		const StreamBranch branch = stream.branch(i);
+		if (branch.sides == 2)
+			continue;
+
+		const int thisSides = branch.sides > 2 ? branch.sides : sides;
+
+		// Face connects are the largest of the counts, so if they fit in an int then so do the rest
+		connects += (static_cast<long long>(branch.segmentCount) * thisSides * 4) + (thisSides * 3);
+		if (connects > INT_MAX) {
+
+			displayWarning("Cannot add branchlets " + std::to_string(firstBranch) + " to " + std::to_string(lastBranch - 1) + " of the stream because there are too many segments for one mesh");
+			return;
+		}
+
+		streamBranches.push_back(i);
+		branchStarts.push_back(newCounts);
+		branchSides.push_back(thisSides);
+		newCounts += countOne(branch.segmentCount, thisSides);
+	}
+
+	setCounts(newCounts);
+
+	const int branchCount = static_cast<int>(streamBranches.size());
+	const int firstRecord = exporter == nullptr ? addRecords(branchCount) : 0;
+
+	if (exporter == nullptr)
+		for (int i = 0; i < branchCount; i++)
+			placeRecord(firstRecord + i, stream.branch(streamBranches[i]).segmentCount);
+
+	parallelFor(branchCount, threadCount, [&](int i) {
+
+		// Each thread converts one branchlet's segments at a time into its own list, which keeps its memory from one to the next
+		thread_local std::vector<BSegment> segs;
+
+		const StreamBranch branch = stream.branch(streamBranches[i]);
+		branch.getSegments(segs);
+
+		MeshCounts at = branchStarts[i];
+
+		if (exporter == nullptr)
+			setRecord(firstRecord + i, branch.startPoint, segs, branch.vOffset, at, branchSides[i]);
+
+		fillOne(branch.startPoint, segs, branch.vOffset, branchSides[i], at);
+	});
+
+	flush();
+}
+
+void BranchletStrips::addStream(const SegmentStream& stream, int firstBranch, int count, unsigned threadCount) {
+
+	BRANCHLETS_TIME(StatPhase::AddStream);
+
+	const int lastBranch = std::min(firstBranch + count, stream.branchCount());
+
+	streamBranches.clear();
+	branchStarts.clear();
+
+	MeshCounts newCounts = counts();
+	long long connects = newCounts.faceConnects;
+	for (int i = std::max(firstBranch, 0); i < lastBranch; i++) {
+
+		const StreamBranch branch = stream.branch(i);
+		if (branch.sides != 2)
+			continue;
+
+		connects += (static_cast<long long>(branch.segmentCount) * 4) + 3;
+		if (connects > INT_MAX) {
+
+			displayWarning("Cannot add branchlets " + std::to_string(firstBranch) + " to " + std::to_string(lastBranch - 1) + " of the stream because there are too many segments for one mesh");
+			return;
+		}
+
+		streamBranches.push_back(i);
+		branchStarts.push_back(newCounts);
+		newCounts += countOne(branch.segmentCount);
+	}
+
+	setCounts(newCounts);
+
+	const int stripCount = static_cast<int>(streamBranches.size());
+	const int firstRecord = exporter == nullptr ? addRecords(stripCount) : 0;
+
+	if (exporter == nullptr)
+		for (int i = 0; i < stripCount; i++)
+			placeRecord(firstRecord + i, stream.branch(streamBranches[i]).segmentCount);
+
+	parallelFor(stripCount, threadCount, [&](int i) {
+
+		thread_local std::vector<BSegment> segs;
+
+		const StreamBranch branch = stream.branch(streamBranches[i]);
+		branch.getSegments(segs);
+
+		MeshCounts at = branchStarts[i];
+
+		if (exporter == nullptr)
+			setRecord(firstRecord + i, branch.startPoint, segs, branch.vOffset, at, 2);
+
+		fillOne(branch.startPoint, segs, branch.vOffset, at);
+	});
+
+	flush();
+}
+
+std::vector<Branchlets> Branchlets::createLevels(const std::vector<BBranch>& branches, const std::vector<LodSettings>& levels, unsigned threadCount, FrameMode frameMode, bool normals) {
+
+	BRANCHLETS_TIME(StatPhase::CreateLevels);
+
+	const int branchCount = static_cast<int>(branches.size());
+	const int levelCount = static_cast<int>(levels.size());
+
+	std::vector<Branchlets> meshes;
+	meshes.reserve(levelCount);
+
+	// Lay out every level before anything is computed, as addMany() does for one
+	std::vector<std::vector<int>> branchSides(levelCount, std::vector<int>(branchCount));
+	std::vector<std::vector<MeshCounts>> starts(levelCount, std::vector<MeshCounts>(branchCount));
+
+	for (int level = 0; level < levelCount; level++) {
+
+		// The mesh's sides are the most any of its branchlets can have, which sidesForError() never lets fall below the minimum
+		meshes.emplace_back(std::max(levels[level].maxSides, std::max(levels[level].minSides, 3)));
+		meshes[level].frameMode = frameMode;
+		meshes[level].mesh.withNormals = normals;
+
+		MeshCounts newCounts;
+		for (int i = 0; i < branchCount; i++) {
+
+			branchSides[level][i] = lodSides(branches[i], levels[level]);
+			starts[level][i] = newCounts;
+			newCounts += countOne(static_cast<int>(branches[i].segments.size()), branchSides[level][i]);
+		}
+
+		meshes[level].setCounts(newCounts);
+		meshes[level].addRecords(branchCount);
+
+		for (int i = 0; i < branchCount; i++)
+			meshes[level].placeRecord(i, static_cast<int>(branches[i].segments.size()));
+	}
+
+	if (levelCount == 0)
+		return meshes;
+
+	parallelFor(branchCount, threadCount, [&](int i) {
+
+		thread_local std::vector<RingFrame> frames;
+		meshes[0].findRingFrames(branches[i].startPoint, branches[i].segments, frames);
+
+		for (int level = 0; level < levelCount; level++) {
+
+			MeshCounts at = starts[level][i];
+			meshes[level].setRecord(i, branches[i].startPoint, branches[i].segments, branches[i].vOffset, at, branchSides[level][i]);
+			meshes[level].fillFromFrames(branches[i], frames, branchSides[level][i], at);
+		}
+	});
+
+	return meshes;
+}
+
+int Branchlets::lodSides(const BBranch& branch, const LodSettings& lod) {
+
+	float radius = 0.f;
+	BVector ringCenter = branch.startPoint;
+	double distance = ringCenter.distanceTo(lod.viewPoint);
+
+	for (const BSegment& seg : branch.segments) {
+
+		radius = std::max(radius, seg.r);
+		ringCenter += seg.v;
+		distance = std::min(distance, ringCenter.distanceTo(lod.viewPoint));
+	}
+
+	float maxError = lod.maxError;
+	if (lod.pixelSize > 0.f)
+		maxError *= lod.pixelSize * static_cast<float>(distance);
+
+	return sidesForError(radius, maxError, lod.minSides, lod.maxSides);
+}
+
+int Branchlets::sidesForError(float radius, float maxError, int minSides, int maxSides) {
+
+	// Strips have a different layout, so a branchlet always gets at least 3 sides
+	minSides = std::max(minSides, 3);
+	maxSides = std::max(maxSides, minSides);
+
+	if (maxError <= 0.f)
+		return maxSides;
+	if (maxError >= radius)
+		return minSides;
+
+	// The gap between a side and the circle is greatest at its middle, where it is r - r * cos(pi / n).  Solve that for n
+	double sides = std::ceil(PI / std::acos(1. - (maxError / radius)));
+
+	return static_cast<int>(std::min(std::max(sides, static_cast<double>(minSides)), static_cast<double>(maxSides)));
+}
+
+MeshCounts Branchlets::countOne(int segmentCount, int sides) {
+
+	MeshCounts counts;
+
+	// A ring of vertices at both ends of every segment, plus the cap vertex
+	counts.verts = ((segmentCount + 1) * sides) + 1;
+
+	// A quad for each side of every segment, plus a triangle for each side connecting the last ring to the cap vertex
+	counts.faces = (segmentCount + 1) * sides;
+	counts.faceConnects = (segmentCount * sides * 4) + (sides * 3);
+
+	// Each ring has one more uv than it has vertices due to the vertical seam, and the cap vertex has a uv for each triangle
+	counts.uvs = ((segmentCount + 1) * (sides + 1)) + sides;
+	counts.uvConnects = counts.faceConnects;
+
+	return counts;
+}
+
+MeshCounts BranchletStrips::countOne(int segmentCount) {
+
+	MeshCounts counts;
+
+	// Two vertices at both ends of every segment, plus the tip vertex
+	counts.verts = ((segmentCount + 1) * 2) + 1;
+
+	// A quad for each segment, plus the triangle at the tip
+	counts.faces = segmentCount + 1;
+	counts.faceConnects = (segmentCount * 4) + 3;
+
+	// A strip has no seam, so there is one uv per vertex
+	counts.uvs = counts.verts;
+	counts.uvConnects = counts.faceConnects;
+
+	return counts;
+}
+
+void Branchlets::fillOne(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset, int sides, MeshCounts& at) {
+
+	const int segmentCount = static_cast<int>(branchSegments.size());
+
+	BRANCHLETS_COUNT(StatCounter::Branches, 1);
+	BRANCHLETS_COUNT(StatCounter::Segments, segmentCount);
+
+	makeVertexCoordsAndUVs(startPoint, branchSegments, sides, vOffset, at.verts, at.uvs);
+	makeConnects(getTopologyTemplate(segmentCount, sides), at);
+
+	at += countOne(segmentCount, sides);
 }
 
-BranchletStrips::BranchletStrips(const MPoint& startPoint, const std::vector<BSegment>& stripSegments, float vOffset) {
+void Branchlets::fillFromFrames(const BBranch& branch, const std::vector<RingFrame>& frames, int sides, MeshCounts& at) {
 
-	this->addOne(startPoint, stripSegments, vOffset);
+	const int segmentCount = static_cast<int>(branch.segments.size());
+
+	BRANCHLETS_COUNT(StatCounter::Branches, 1);
+	BRANCHLETS_COUNT(StatCounter::Segments, segmentCount);
+	const RingTable& ringTable = getRingTable(sides);
+
+	const float uFaceWidth = 1.f / sides;
+
+	// Each ring's uvs are made straight after its vertices, as in makeVertexCoordsAndUVs()
+	int vertIndex = at.verts;
+	int uvIndex = at.uvs;
+	for (int ring = 0; ring <= segmentCount; ring++) {
+
+		const int ringVertIndex = vertIndex;
+		makeVertexRing(frames[ring], ringTable, vertIndex);
+		makeRingUVs(branch.segments, ring, ringTable, uFaceWidth, branch.vOffset, ringVertIndex, uvIndex);
+
+		if (mesh.withNormals)
+			makeRingNormals(branch.segments, ring, frames[ring], ringTable, ringVertIndex);
+
+		uvIndex += sides + 1;
+	}
+
+	BVector capVert = findCapVertex(branch.segments, frames.back().center);
+	mesh.setVert(vertIndex, capVert.x, capVert.y, capVert.z);
+	makeCapUVs(branch.segments, ringTable, uFaceWidth, uvIndex);
+
+	if (mesh.withNormals)
+		makeCapNormal(branch.segments, frames.back(), sides, vertIndex);
+
+	makeConnects(getTopologyTemplate(segmentCount, sides), at);
+
+	at += countOne(segmentCount, sides);
 }
 
-void Branchlets::addOne(const MPoint& startPoint, const std::vector<BSegment>& branchSegments, float vOffset) {
+void BranchletStrips::fillOne(const BVector& startPoint, const std::vector<BSegment>& stripSegments, float vOffset, MeshCounts& at) {
 
-	const int segmentCount = static_cast<int>(branchSegments.size());
-	const int initialVertCount = verts.length();
-	const int initialUVCount = us.length();
+	const int segmentCount = static_cast<int>(stripSegments.size());
+
+	BRANCHLETS_COUNT(StatCounter::Branches, 1);
+	BRANCHLETS_COUNT(StatCounter::Segments, segmentCount);
+
+	makeVertexCoordsAndUVs(startPoint, stripSegments, vOffset, at.verts, at.uvs);
+	makeConnects(getTopologyTemplate(segmentCount, 2), at);
+
+	at += countOne(segmentCount);
+}
+
+bool Branchlets::applySegmentEdit(int branchIndex, int firstSegment, const std::vector<BSegment>& segments, int& firstRing, int& lastRing) {
+
+	if (branchIndex < 0 || branchIndex >= recordCount) {
+
+		displayWarning("Cannot update branchlet " + std::to_string(branchIndex) + " because there are only " + std::to_string(recordCount));
+		return false;
+	}
+
+	const BranchRecord& record = records[branchIndex];
+	BSegment* segs = recordSegments.data() + record.firstSegment;
+	const int segmentCount = record.segmentCount;
+
+	if (firstSegment < 0 || firstSegment + static_cast<int>(segments.size()) > segmentCount) {
+
+		displayWarning("Cannot update branchlet " + std::to_string(branchIndex) + " because its segment count would change");
+		return false;
+	}
+
+	firstRing = segmentCount + 1;
+	lastRing = -1;
+
+	for (int i = 0; i < static_cast<int>(segments.size()); i++) {
+
+		BSegment& seg = segs[firstSegment + i];
+		const bool vectorChanged = seg.v != segments[i].v;
+		const bool radiusChanged = seg.r != segments[i].r;
+
+		if (!vectorChanged && !radiusChanged)
+			continue;
+
+		seg = segments[i];
+
+		// A segment shapes the rings at its base and its top, and the last segment also places the cap vertex.
+		// Changing a segment's vector moves every ring above it as well
+		firstRing = std::min(firstRing, firstSegment + i);
+		if (vectorChanged || firstSegment + i == segmentCount - 1)
+			lastRing = segmentCount + 1;
+		else
+			lastRing = std::max(lastRing, firstSegment + i + 1);
+	}
+
+	if (lastRing >= 0)
+		bvhCurrent = false;
+
+	return lastRing >= 0;
+}
+
+// How far the vertices of ring 'ring' of a branchlet can be from its center.  A ring between two segments is wider than the
+// tube across the bend, by 1 / cos(half the bend), unless it is left round for the same reason findEllipseVectors() leaves it
+static double ringReach(const BSegment* segs, int segmentCount, int ring) {
+
+	if (ring == 0)
+		return segs[0].r;
+	if (ring >= segmentCount)
+		return segs[segmentCount - 1].r;
+
+	const BSegment& bottomSeg = segs[ring - 1];
+	const BSegment& topSeg = segs[ring];
+	const BVector bottom = bottomSeg.v.normal();
+	const BVector top = topSeg.v.normal();
+
+	const double sinBend = (bottom ^ top).length();
+	const double cosHalfBend = (bottom + top).length() / 2.;
+
+	if (sinBend * topSeg.v.length() < bottomSeg.r * 1.1 || cosHalfBend <= 0.)
+		return topSeg.r;
+
+	return std::max(bottomSeg.r, topSeg.r) / cosHalfBend;
+}
+
+const CapsuleBvh& Branchlets::capsuleBvh() {
+
+	if (bvhCurrent)
+		return bvh;
+
+	std::vector<Capsule> capsules;
+
+	for (int i = 0; i < recordCount; i++) {
+
+		const BranchRecord& record = records[i];
+		BVector segmentStart = record.startPoint;
+
+		const BSegment* segs = recordSegments.data() + record.firstSegment;
+
+		for (int j = 0; j < record.segmentCount; j++) {
+
+			const BSegment& seg = segs[j];
+
+			// The tube tapers between the rings at the segment's two ends, which are its own radius and the next segment's, so the
+			// capsule reaches as far as the wider of them, stretched where it joins another segment
+			Capsule capsule;
+			capsule.start = segmentStart;
+			capsule.end = segmentStart + seg.v;
+			capsule.radius = static_cast<float>(std::max(ringReach(segs, record.segmentCount, j), ringReach(segs, record.segmentCount, j + 1)));
+			capsule.branch = i;
+			capsule.segment = j;
+			capsules.push_back(capsule);
+
+			segmentStart = capsule.end;
+		}
+	}
+
+	bvh.build(capsules);
+	bvhCurrent = true;
+
+	return bvh;
+}
+
+void Branchlets::updateBranch(int branchIndex, int firstSegment, const std::vector<BSegment>& segments) {
+
+	BRANCHLETS_TIME(StatPhase::UpdateBranch);
+
+	int firstRing, lastRing;
+	if (!applySegmentEdit(branchIndex, firstSegment, segments, firstRing, lastRing))
+		return;
+
+	const BranchRecord& record = records[branchIndex];
+	const int segmentCount = record.segmentCount;
+	const int sides = record.sides;
+	const MeshCounts count = countOne(segmentCount, sides);
+
+	const BSegment* segs = recordSegments.data() + record.firstSegment;
+	editSegments.assign(segs, segs + segmentCount);
+
+	// The rings are oriented the way they were when the branchlet was added, whatever the mode is now
+	const FrameMode currentMode = frameMode;
+	frameMode = record.frameMode;
+
+	makeVertexCoords(record.startPoint, editSegments, sides, record.at.verts, firstRing, lastRing);
+
+	// Every v coordinate above the first changed ring builds on the ones below it, so they all change
+	makeUVs(editSegments, segmentCount, sides, 1., record.vOffset, record.at.verts, record.at.uvs, firstRing);
+
+	frameMode = currentMode;
+
+	IndexRange verts = { record.at.verts + (firstRing * sides), record.at.verts + std::min((lastRing + 1) * sides, count.verts) };
+	IndexRange uvs = { record.at.uvs + (firstRing * (sides + 1)), record.at.uvs + count.uvs };
+	markDirty(verts, uvs);
+}
+
+void BranchletStrips::updateBranch(int branchIndex, int firstSegment, const std::vector<BSegment>& segments) {
+
+	BRANCHLETS_TIME(StatPhase::UpdateBranch);
+
+	int firstRing, lastRing;
+	if (!applySegmentEdit(branchIndex, firstSegment, segments, firstRing, lastRing))
+		return;
+
+	const BranchRecord& record = records[branchIndex];
+	const int segmentCount = record.segmentCount;
+	const MeshCounts count = countOne(segmentCount);
+
+	const BSegment* segs = recordSegments.data() + record.firstSegment;
+	editSegments.assign(segs, segs + segmentCount);
+
+	makeVertexCoords(record.startPoint, editSegments, 2, record.at.verts, firstRing, lastRing);
+	makeUVs(editSegments, segmentCount, 1., record.vOffset, record.at.verts, record.at.uvs, firstRing);
+
+	IndexRange verts = { record.at.verts + (firstRing * 2), record.at.verts + std::min((lastRing + 1) * 2, count.verts) };
+	IndexRange uvs = { record.at.uvs + (firstRing * 2), record.at.uvs + count.uvs };
+	markDirty(verts, uvs);
+}
+
+std::unique_ptr<Branchlets> BranchletsPool::acquire(int sides) {
+
+	if (sides < 2)
+		return nullptr;
+
+	std::vector<std::unique_ptr<Branchlets>>& pooled = sides == 2 ? strips : tubes;
+
+	if (pooled.empty()) {
+
+		if (sides == 2)
+			return std::make_unique<BranchletStrips>();
+		else
+			return std::make_unique<Branchlets>(sides);
+	}
+
+	std::unique_ptr<Branchlets> branchlets = std::move(pooled.back());
+	pooled.pop_back();
+
+	branchlets->sides = sides;
+	return branchlets;
+}
+
+void BranchletsPool::release(std::unique_ptr<Branchlets> branchlets) {
+
+	if (branchlets == nullptr)
+		return;
+
+	// Everything a caller can set is put back as a new object has it, so that what acquire() hands out doesn't depend on who had
+	// it before.  reset() also clears the dirty ranges, and the hierarchy's arrays keep their memory like the mesh's
+	branchlets->reset();
+	branchlets->setExporter(nullptr);
+	branchlets->setNormals(false);
+	branchlets->setFrameMode(FrameMode::Ellipse);
+	branchlets->setCache(nullptr);
+	branchlets->bvh.clear();
+
+	if (branchlets->sideCount() == 2)
+		strips.push_back(std::move(branchlets));
+	else
+		tubes.push_back(std::move(branchlets));
+}
+
+BBranch& BranchArena::add(const BVector& startPoint, float vOffset) {
+
+	if (spare.empty()) {
+
+		branchList.emplace_back();
+	}
+	else {
+
+		branchList.push_back(std::move(spare.back()));
+		spare.pop_back();
+	}
+
+	BBranch& branch = branchList.back();
+	branch.startPoint = startPoint;
+	branch.segments.clear();
+	branch.vOffset = vOffset;
+
+	return branch;
+}
+
+void BranchArena::reset() {
+
+	for (BBranch& branch : branchList)
+		spare.push_back(std::move(branch));
+
+	branchList.clear();
+}
+
+std::unique_ptr<Branchlets> BranchletCreator::makeEmpty(int sides) {
+
+	if (pool != nullptr)
+		return pool->acquire(sides);
+	else if (sides > 2)
+		return std::make_unique<Branchlets>(sides);
+	else
+		return std::make_unique<BranchletStrips>();
+}
+
+std::unique_ptr<Branchlets> BranchletCreator::createDefault(int sides) {
+
+	if (sides < 2) {
+
+		MMesh::displayWarning("Cannot create Branchlets with less than 2 sides");
+		return std::make_unique<Branchlets>();
+	}
+
+	return makeEmpty(sides);
+}
+
+std::unique_ptr<Branchlets> BranchletCreator::create(const BVector& startPoint, int sides, const std::vector<BSegment>& segments, float vOffset) {
+
+	std::unique_ptr<Branchlets> branchlets = createDefault(sides);
+	if (sides >= 2)
+		branchlets->addOne(startPoint, segments, vOffset);
+
+	return branchlets;
+}
+
+std::unique_ptr<Branchlets> BranchletCreator::createMany(int sides, const std::vector<BBranch>& branches, unsigned threadCount) {
+
+	std::unique_ptr<Branchlets> branchlets = createDefault(sides);
+	if (sides >= 2)
+		branchlets->addMany(branches, threadCount);
+
+	return branchlets;
+}
+
+std::unique_ptr<Branchlets> BranchletCreator::createMany(int sides, const std::vector<BBranch>& branches, const std::vector<int>& branchIndices, unsigned threadCount) {
 
-	makeVertexCoords(startPoint, branchSegments, sides);
-	makeFaceConnects(segmentCount, sides, initialVertCount);
-	makeFaceCounts(segmentCount, sides);
-	makeUVs(branchSegments, segmentCount, sides, 1., vOffset);
-	makeUVConnects(sides, segmentCount, initialUVCount);
+	std::unique_ptr<Branchlets> branchlets = createDefault(sides);
+	if (sides >= 2)
+		branchlets->addMany(branches, branchIndices, threadCount);
+
+	return branchlets;
+}
+
+void Branchlets::makeVertexCoords(const BVector startPoint, const std::vector<BSegment>& segs, const int sides, int vertIndex) {
+
+	makeVertexCoords(startPoint, segs, sides, vertIndex, 0, static_cast<int>(segs.size()) + 1);
+}
+
+void Branchlets::makeVertexCoords(const BVector startPoint, const std::vector<BSegment>& segs, const int sides, int vertIndex, int firstRing, int lastRing) {
+
+	BRANCHLETS_TIME(StatPhase::MakeVertexCoords);
+
+	const RingTable& ringTable = getRingTable(sides);
+	const int segmentCount = static_cast<int>(segs.size());
+
+	// Find the center of the first ring, adding the segments in the same order as when every ring is made so the result is identical.
+	// A rotation minimizing basis depends on every ring below, so it is carried up to the first ring too
+	BVector ringCenter = startPoint;
+	RingBasis basis;
+	for (int i = 0; i < firstRing && i < segmentCount; i++) {
+
+		if (frameMode == FrameMode::RotationMinimizing)
+			carryRingBasis(segs, i, basis);
+
+		ringCenter += segs[i].v;
+	}
+
+	vertIndex += firstRing * sides;
+
+	RingFrame frame;
+	for (int ring = firstRing; ring <= lastRing && ring <= segmentCount; ring++) {
+
+		const int ringVertIndex = vertIndex;
+		frame = findRingFrame(segs, ring, ringCenter, basis);
+		makeVertexRing(frame, ringTable, vertIndex);
+
+		if (mesh.withNormals)
+			makeRingNormals(segs, ring, frame, ringTable, ringVertIndex);
+
+		if (ring < segmentCount)
+			ringCenter += segs[ring].v;
+	}
+
+	// Make the cap vertex.  Its normal and tangent need the last ring's frame, which is only found again if that ring wasn't redone
+	if (lastRing > segmentCount) {
+
+		BVector capVert = findCapVertex(segs, ringCenter);
+		mesh.setVert(vertIndex, capVert.x, capVert.y, capVert.z);
+
+		if (mesh.withNormals) {
+
+			if (firstRing > segmentCount)
+				frame = findRingFrame(segs, segmentCount, ringCenter, basis);
+
+			makeCapNormal(segs, frame, ringTable.sides, vertIndex);
+		}
+	}
 }
 
-void BranchletStrips::addOne(const MPoint& startPoint, const std::vector<BSegment>& stripSegments, float vOffset) {
+void Branchlets::findRingFrames(const BVector& startPoint, const std::vector<BSegment>& segs, std::vector<RingFrame>& frames) {
+
+	const int segmentCount = static_cast<int>(segs.size());
+	BVector ringCenter = startPoint;
+	RingBasis basis;
 
-	int segmentCount = static_cast<int>(stripSegments.size());
-	const int initialVertCount = verts.length();
-	const int initialUVCount = us.length();
+	frames.resize(segmentCount + 1);
+	for (int ring = 0; ring <= segmentCount; ring++) {
 
-	makeVertexCoords(startPoint, stripSegments, 2);
-	makeFaceConnects(segmentCount, initialVertCount);
-	makeFaceCounts(segmentCount);
-	makeUVs(stripSegments, segmentCount, 1., vOffset);
-	makeUVConnects(segmentCount, initialUVCount);
+		frames[ring] = findRingFrame(segs, ring, ringCenter, basis);
+
+		if (ring < segmentCount)
+			ringCenter += segs[ring].v;
+	}
 }
 
-Branchlets BranchletCreator::createDefault(int sides) {
+Branchlets::RingFrame Branchlets::findRingFrame(const std::vector<BSegment>& segs, int ring, const BVector& ringCenter, RingBasis& basis) {
+
+	if (frameMode == FrameMode::RotationMinimizing) {
+
+		carryRingBasis(segs, ring, basis);
+		return findRotationMinimizingFrame(segs, ring, ringCenter, basis);
+	}
+
+	BVector major, minor;
 
-	if (sides > 2)
-		return Branchlets(sides);
-	else if (sides == 2)
-		return BranchletStrips();
+	if (ring == 0) {
+
+		// The first ring of vertices
+		findEllipseVectors(major, minor, segs[0]);
+		return findRingFrame(major, minor, ringCenter, segs[0].v);
+	}
+	else if (ring < static_cast<int>(segs.size())) {
+
+		// A vertex ring between the top and bottom of the branchlet
+		findEllipseVectors(major, minor, ringCenter, segs[ring - 1], segs[ring]);
+		return findRingFrame(major, minor, ringCenter, segs[ring].v);
+	}
 	else {
-		MGlobal::displayWarning(MString() + "Cannot create Branchlets with less than 2 sides");
-		return Branchlets();
+
+		// The last ring of vertices
+		findEllipseVectors(major, minor, segs.back());
+		return findRingFrame(major, minor, ringCenter, segs.back().v);
 	}
 }
 
-Branchlets BranchletCreator::create(const MPoint& startPoint, int sides, const std::vector<BSegment>& segments, float vOffset) {
+void Branchlets::carryRingBasis(const std::vector<BSegment>& segs, int ring, RingBasis& basis) {
+
+	const int segmentCount = static_cast<int>(segs.size());
+
+	// The end rings face along their segments, and the rest face halfway between the segments they join
+	BVector tangent;
+	if (ring == 0) {
+
+		tangent = segs[0].v.normal();
+	}
+	else if (ring < segmentCount) {
+
+		tangent = segs[ring - 1].v.normal() + segs[ring].v.normal();
+		if (tangent * tangent < 1e-12) // The segments double back on each other
+			tangent = segs[ring].v;
+
+		tangent = tangent.normal();
+	}
+	else {
+
+		tangent = segs.back().v.normal();
+	}
+
+	BVector reference;
+	if (ring == 0) {
 
-	if (sides > 2)
-		return Branchlets(startPoint, sides, segments, vOffset);
-	else if (sides == 2)
-		return BranchletStrips(startPoint, segments, vOffset);
+		// Start from the same vector as findEllipseVectors() does for the first ring
+		reference = tangent ^ BVector::xAxis;
+		if (reference.length() < .001) // In case the axis is directly on the x-axis
+			reference = tangent ^ BVector::yAxis;
+	}
 	else {
-		MGlobal::displayWarning(MString() + "Cannot create Branchlets with less than 2 sides");
-		return Branchlets();
+
+		// Reflect the ring below through the plane halfway between the two ring centers, which leaves its tangent pointing back
+		// along the segment, and then through the plane that takes that tangent onto this ring's
+		const BVector& step = segs[ring - 1].v;
+		const double stepSquared = step * step;
+
+		reference = basis.reference;
+		BVector reflectedTangent = basis.tangent;
+
+		if (stepSquared > 0.) {
+
+			reference -= step * ((2. / stepSquared) * (step * reference));
+			reflectedTangent -= step * ((2. / stepSquared) * (step * reflectedTangent));
+		}
+
+		const BVector between = tangent - reflectedTangent;
+		const double betweenSquared = between * between;
+
+		if (betweenSquared > 0.)
+			reference -= between * ((2. / betweenSquared) * (between * reference));
+
+		// Keep rounding from building up over long branchlets
+		reference -= tangent * (tangent * reference);
 	}
+
+	basis.tangent = tangent;
+	basis.reference = reference.normal();
 }
 
-void Branchlets::makeVertexCoords(const MPoint startPoint, const std::vector<BSegment>& segs, const int sides) {
+Branchlets::RingFrame Branchlets::findRotationMinimizingFrame(const std::vector<BSegment>& segs, int ring, const BVector& ringCenter, const RingBasis& basis) {
+
+	const int segmentCount = static_cast<int>(segs.size());
+	const double radius = ring < segmentCount ? segs[ring].r : segs.back().r;
+
+	// The tangent, reference and their cross product are right handed, as the ellipse frames are, so faces wind the same way
+	RingFrame frame;
+	frame.center = ringCenter;
+	frame.e0 = basis.reference * radius;
+	frame.e1 = (basis.tangent ^ basis.reference) * radius;
 
-	MPoint ringCenter = startPoint;
-	MVector major, minor;
+	if (ring > 0 && ring < segmentCount) {
 
-	// Make the first ring of vertices
-	findEllipseVectors(major, minor, segs[0]);
-	makeVertexRing(major, minor, ringCenter, sides, segs[0].v);
-	ringCenter += segs[0].v;
+		const BVector bottom = segs[ring - 1].v.normal();
+		const BVector top = segs[ring].v.normal();
+		const BVector bendAxis = bottom ^ top;
+		const double sinBend = bendAxis.length();
 
-	// Make all vertex rings between the top and bottom of the branchlet
-	for (int i = 0; i < static_cast<int>(segs.size()) - 1; i++) {
+		// The same test as findEllipseVectors(): where the top segment is too short or bends too far for the tubes to meet cleanly,
+		// the ring is left round
+		if (sinBend > 0. && sinBend * segs[ring].v.length() >= segs[ring - 1].r * 1.1) {
 
-		findEllipseVectors(major, minor, ringCenter, segs[i], segs[i + 1]);
-		makeVertexRing(major, minor, ringCenter, sides, segs[i + 1].v);
+			// Across the bend, the ring is wider than the tube by 1 / cos(half the bend), which is the cosine of the tangent and either segment
+			const BVector across = (bendAxis / sinBend) ^ basis.tangent;
+			const double stretch = (1. / (basis.tangent * top)) - 1.;
 
-		ringCenter += segs[i + 1].v;
+			frame.e0 += across * (stretch * (across * frame.e0));
+			frame.e1 += across * (stretch * (across * frame.e1));
+		}
 	}
 
-	// Make the last ring of vertices
-	findEllipseVectors(major, minor, segs.back());
-	makeVertexRing(major, minor, ringCenter, sides, segs.back().v);
+	return frame;
+}
+
+BVector Branchlets::findCapVertex(const std::vector<BSegment>& segs, const BVector& lastRingCenter) {
 
-	// Make the cap vertex
-	verts.append(ringCenter + (segs.back().v.normal() * segs.back().r));
+	return lastRingCenter + (segs.back().v.normal() * segs.back().r);
 }
 
-void Branchlets::findEllipseVectors(MVector& major, MVector& minor, BSegment seg) {
+void Branchlets::findEllipseVectors(BVector& major, BVector& minor, BSegment seg) {
+
+	BRANCHLETS_TIME(StatPhase::FindEllipseVectors);
 
-	MVector cp = seg.v ^ MVector(1., 0., 0.);
+	BVector cp = seg.v ^ BVector(1., 0., 0.);
 	if (cp.length() < .001) // In case the axis is directly on the x-axis
-		cp = seg.v ^ MVector(0., 1., 0.);
+		cp = seg.v ^ BVector(0., 1., 0.);
 
 	minor = cp.normal() * seg.r;
 
-	MQuaternion rotation((PI / 2.f), minor);
+	BQuaternion rotation((PI / 2.f), minor);
 	major = (seg.v.normal() * seg.r).rotateBy(rotation);
 }
 
-void Branchlets::findEllipseVectors(MVector& major, MVector& minor, const MPoint& center, const BSegment& bottomSeg, const BSegment& topSeg) {
+void Branchlets::findEllipseVectors(BVector& major, BVector& minor, const BVector& center, const BSegment& bottomSeg, const BSegment& topSeg) {
+
+	BRANCHLETS_TIME(StatPhase::FindEllipseVectors);
 
 	double B = bottomSeg.v.angle(topSeg.v); // the angle between the two segments, remember it's measured as if they both face out from the same start point
 
@@ -110,6 +1274,8 @@ void Branchlets::findEllipseVectors(MVector& major, MVector& minor, const MPoint
 
 	if (d < bottomSeg.r * 1.1) { // topSeg is too short or angle is too extreme to intersect
 
+		BRANCHLETS_COUNT(StatCounter::EllipseFallbacks, 1);
+
 		findEllipseVectors(major, minor, BSegment(bottomSeg.v + topSeg.v, topSeg.r));
 		return;
 	}
@@ -122,303 +1288,362 @@ void Branchlets::findEllipseVectors(MVector& major, MVector& minor, const MPoint
 
 	// Find points p and q
 	double amountToRotate = (PI / 2.);
-	MQuaternion rotation(amountToRotate, minor);
-	MPoint p = (center - bottomSeg.v) + (bottomSeg.v.normal() * bottomSeg.r).rotateBy(rotation);
-	MPoint q = center + (topSeg.v.normal() * topSeg.r).rotateBy(rotation);
+	BQuaternion rotation(amountToRotate, minor);
+	BVector p = (center - bottomSeg.v) + (bottomSeg.v.normal() * bottomSeg.r).rotateBy(rotation);
+	BVector q = center + (topSeg.v.normal() * topSeg.r).rotateBy(rotation);
 
 	// Find a second angle of the triangle
-	MVector pToQ = (q - p);
+	BVector pToQ = (q - p);
 	double A = PI - (bottomSeg.v.angle(q - p) + B);
 
 	// Use the law of sines to find the distance from p, along the bottom segment's vector, to a point of maximum curvature.
 	double a = pToQ.length() * (std::sin(A) / std::sin(B));
 
-	MPoint r = p + (bottomSeg.v.normal() * a);
+	BVector r = p + (bottomSeg.v.normal() * a);
 	major = r - center;
 }
 
-void Branchlets::makeVertexRing(const MVector& major, const MVector& minor, const MPoint& center, int sides, const MVector& nextSegVect) {
+void Branchlets::makeVertexRing(const BVector& major, const BVector& minor, const BVector& center, const RingTable& ringTable, const BVector& nextSegVect, int& vertIndex) {
+
+	makeVertexRing(findRingFrame(major, minor, center, nextSegVect), ringTable, vertIndex);
+}
+
+Branchlets::RingFrame Branchlets::findRingFrame(const BVector& major, const BVector& minor, const BVector& center, const BVector& nextSegVect) {
 
 	// We can use the parametric equation of an ellipse to calculate the vertices. That is: p(t) = c + cos(t)u + sin(t)v, where p is the vertex
 	// coordinate as a function of t, the world space polar angle about the center of the ellipse.  To ensure that vertices on one ring are
-	// correctly aligned with those one the next ring up, create the shape of the ring in world space first by rotating minor and major, then 
-	// rotate back before setting the vertex's coords
+	// correctly aligned with those one the next ring up, the ring starts at the polar angle that major has once the ring is rotated into
+	// world space
 
-	MQuaternion segToWorld(nextSegVect, MVector::yAxis);
-	MVector minorInWorld = minor.rotateBy(segToWorld);
-	MVector majorInWorld = major.rotateBy(segToWorld);
+	BQuaternion segToWorld(nextSegVect, BVector::yAxis);
+	BVector majorInWorld = major.rotateBy(segToWorld);
 
 	// Major and minor are the vectors from the center of the ellipse to the points of maximum and minimum curvature.
 	// Since these vectors' polar angles change from one segment to the next, and since the resulting vertex ring depends 
 	// on these angles, we need to offset the starting angle accordingly.
 	double polarOffset = findVectorPolar(majorInWorld.x, majorInWorld.z);
-	double angle = 0. + polarOffset;
-	double angleIncrement = ((PI * 2.f) / sides);
 
-	for (int i = 0; i < sides; i++) {
+	// Rotating each vertex back out of world space undoes the rotation above, so vertex i is just c + cos(polarOffset + a)major + sin(polarOffset + a)minor,
+	// where a is its angle from the first vertex.  Expanding the sums of angles gives two basis vectors that are fixed for the whole ring, leaving
+	// only cos(a) and sin(a), which depend on nothing but the number of sides, to change from one vertex to the next
+	double cosOffset = std::cos(polarOffset);
+	double sinOffset = std::sin(polarOffset);
+	RingFrame frame;
+	frame.center = center;
+	frame.e0 = (cosOffset * major) + (sinOffset * minor);
+	frame.e1 = (cosOffset * minor) - (sinOffset * major);
+
+	return frame;
+}
+
+void Branchlets::makeVertexRing(const RingFrame& frame, const RingTable& ringTable, int& vertIndex) {
 
-		MVector toVertex = (std::cos(angle) * majorInWorld) + (std::sin(angle) * minorInWorld);
+	BRANCHLETS_TIME(StatPhase::MakeVertexRing);
+	BRANCHLETS_COUNT(StatCounter::Rings, 1);
 
-		toVertex = toVertex.rotateBy(segToWorld.inverse());
-		verts.append(center + toVertex);
+	const double c[3] = { frame.center.x, frame.center.y, frame.center.z };
+	const double u[3] = { frame.e0.x, frame.e0.y, frame.e0.z };
+	const double v[3] = { frame.e1.x, frame.e1.y, frame.e1.z };
 
-		angle += angleIncrement;
-	}
+	makeRingPositions(ringTable, c, u, v, &mesh.xs[vertIndex], &mesh.ys[vertIndex], &mesh.zs[vertIndex]);
+
+	vertIndex += ringTable.sides;
 }
 
-void Branchlets::makeFaceConnects(const int segmentCount, const int sides, const int initialVertCount) {
+// The part of 'v' at right angles to the unit vector 'axis'
+static BVector perpendicularTo(const BVector& v, const BVector& axis) {
 
-	// For each 4 sided face added we have to specify the indices of the verts that make up its 4 corners - these indices are the faceConnects
-	// For each face, they start on the lower left and move counter-clockwise
-	for (int i = 0; i < segmentCount; i++) {
+	return v - (axis * (axis * v));
+}
 
-		const int firstCornerIndex = (i * sides) + initialVertCount;
-		int nextCornerIndex = firstCornerIndex;
+void Branchlets::makeRingNormals(const std::vector<BSegment>& segs, int ring, const RingFrame& frame, const RingTable& ringTable, int vertIndex) {
 
-		for (int j = 0; j < sides - 1; j++) {
+	const int segmentCount = static_cast<int>(segs.size());
 
-			faceConnects.append(nextCornerIndex);
-			faceConnects.append(nextCornerIndex + 1);
-			faceConnects.append(nextCornerIndex + 1 + sides);
-			faceConnects.append(nextCornerIndex + sides);
+	// The directions of the tubes that meet at the ring, which are the same segment for the first and last rings
+	const BVector below = segs[ring > 0 ? ring - 1 : 0].v.normal();
+	const BVector above = segs[ring < segmentCount ? ring : segmentCount - 1].v.normal();
 
-			nextCornerIndex++;
-		}
+	if (ringTable.sides == 2) {
 
-		//The pattern for faceConnects is a bit different for the last side in every ring of sides
-		faceConnects.append(nextCornerIndex);
-		faceConnects.append(firstCornerIndex);
-		faceConnects.append(firstCornerIndex + sides);
-		faceConnects.append(nextCornerIndex + sides);
-	}
+		// A strip is flat, so both of its vertices face out of its plane.  u runs from the first vertex to the second
+		BVector along = below + above;
+		along = (along * along) > 1e-12 ? along.normal() : above;
 
-	// Finally add the face connects for the triangles connecting the last vertex ring and the cap vertex
-	const int firstCornerIndex = (segmentCount * sides) + initialVertCount;
-	const int capVertIndex = firstCornerIndex + sides;
-	int nextCornerIndex = firstCornerIndex;
+		const BVector tangent = (-frame.e0).normal();
+		const BVector normal = (tangent ^ along).normal();
 
-	for (int i = 0; i < sides - 1; i++) {
+		for (int i = 0; i < 2; i++) {
 
-		faceConnects.append(nextCornerIndex);
-		faceConnects.append(nextCornerIndex + 1);
-		faceConnects.append(capVertIndex);
+			mesh.setNormal(vertIndex + i, normal.x, normal.y, normal.z);
+			mesh.setTangent(vertIndex + i, tangent.x, tangent.y, tangent.z);
+		}
 
-		nextCornerIndex++;
+		return;
 	}
 
-	faceConnects.append(nextCornerIndex);
-	faceConnects.append(firstCornerIndex);
-	faceConnects.append(capVertIndex);
+	// Vertex i is center + cos(a)e0 + sin(a)e1, so the part of it at right angles to either tube is the same sum of the parts of e0
+	// and e1 at right angles to that tube.  The first and last rings are on a single tube
+	const BVector e0Below = perpendicularTo(frame.e0, below);
+	const BVector e1Below = perpendicularTo(frame.e1, below);
+	const BVector e0Above = perpendicularTo(frame.e0, above);
+	const BVector e1Above = perpendicularTo(frame.e1, above);
+	const bool oneTube = ring == 0 || ring >= segmentCount;
+
+	const double u[3] = { frame.e0.x, frame.e0.y, frame.e0.z };
+	const double v[3] = { frame.e1.x, frame.e1.y, frame.e1.z };
+	const double uBelow[3] = { e0Below.x, e0Below.y, e0Below.z };
+	const double vBelow[3] = { e1Below.x, e1Below.y, e1Below.z };
+	const double uAbove[3] = { e0Above.x, e0Above.y, e0Above.z };
+	const double vAbove[3] = { e1Above.x, e1Above.y, e1Above.z };
+
+	makeRingNormalsAndTangents(ringTable, u, v, uBelow, vBelow, oneTube ? nullptr : uAbove, oneTube ? nullptr : vAbove,
+		&mesh.nxs[vertIndex], &mesh.nys[vertIndex], &mesh.nzs[vertIndex], &mesh.txs[vertIndex], &mesh.tys[vertIndex], &mesh.tzs[vertIndex]);
 }
 
-void BranchletStrips::makeFaceConnects(const int segmentCount, const int initialVertCount) {
+void Branchlets::makeCapNormal(const std::vector<BSegment>& segs, const RingFrame& lastFrame, int sides, int vertIndex) {
 
-	int nextCornerIndex;
+	const BVector tip = segs.back().v.normal();
 
-	for (int i = 0; i < segmentCount; i++) {
-
-		nextCornerIndex = (i * 2) + initialVertCount;
-		faceConnects.append(nextCornerIndex);
-		faceConnects.append(nextCornerIndex + 1);
-		faceConnects.append(nextCornerIndex + 1 + 2);
-		faceConnects.append(nextCornerIndex + 2);
-	}
+	// The tip of a strip is flat like the rest of it.  The tip of a tube faces along the last segment, and takes the tangent of
+	// the last ring's first vertex, turned to lie flat on it
+	BVector normal = tip;
+	BVector tangent;
 
-	nextCornerIndex = (segmentCount * 2) + initialVertCount;
-	faceConnects.append(nextCornerIndex);
-	faceConnects.append(nextCornerIndex + 1);
-	faceConnects.append(nextCornerIndex + 2);
-}
+	if (sides == 2) {
 
-void Branchlets::makeFaceCounts(const int segmentCount, const int sides) {
+		tangent = (-lastFrame.e0).normal();
+		normal = (tangent ^ tip).normal();
+	}
+	else {
 
-	for (int i = 0; i < segmentCount * sides; i++)
-		faceCounts.append(4);
+		tangent = perpendicularTo(lastFrame.e1, tip).normal();
+	}
 
-	for (int i = 0; i < sides; i++)
-		faceCounts.append(3);
+	mesh.setNormal(vertIndex, normal.x, normal.y, normal.z);
+	mesh.setTangent(vertIndex, tangent.x, tangent.y, tangent.z);
 }
 
-void BranchletStrips::makeFaceCounts(const int segmentCount) {
+void Branchlets::makeConnects(const TopologyTemplate& topology, const MeshCounts& at) {
 
-	for (int i = 0; i < segmentCount; i++)
-		faceCounts.append(4);
+	BRANCHLETS_TIME(StatPhase::MakeConnects);
 
-	faceCounts.append(3);
+	// The template's vertex and uv indices start at 0, so they are offset by the number of vertices and uvs that come before this branchlet
+	copyWithOffset(topology.faceConnects.data(), static_cast<int>(topology.faceConnects.size()), at.verts, &mesh.faceConnects[at.faceConnects]);
+	copyWithOffset(topology.faceCounts.data(), static_cast<int>(topology.faceCounts.size()), 0, &mesh.faceCounts[at.faces]);
+	copyWithOffset(topology.uvConnects.data(), static_cast<int>(topology.uvConnects.size()), at.uvs, &mesh.uvConnects[at.uvConnects]);
 }
 
 // This scales uv's so that all u's are within the 0-1 space on the uv map.  v's will match the scaling, so because the mesh is
 // a long tube, they may be well outside of 0-1 space
-void Branchlets::makeUVs(const std::vector<BSegment>& segs, int segmentCount, int sides, float uWidthMultiplier, float vOffset)
+void Branchlets::makeUVs(const std::vector<BSegment>& segs, int segmentCount, int sides, float uWidthMultiplier, float vOffset, const int initialVertCount, const int initialUVCount, int firstRing)
 {
+	BRANCHLETS_TIME(StatPhase::MakeUVs);
+
+	const RingTable& ringTable = getRingTable(sides);
 	float uFaceWidth = (1.f / sides) * uWidthMultiplier;
-	float vScaler = getVScaler(segs[0].r, uFaceWidth, sides, 1.);
 
-	int segmentIndex = 0;
-	int sideInd = 0;
+	// Assuming there is always a single cap vert, we loop through all rings but that cap vert and calculate its uv's separately.
+	// The index difference between vertices on adjacent rings is equal to sides, while the index difference between UVs on adjacent rings
+	// is equal to sides + 1, because we are adding one uv for each ring due to the vertical seam
+	for (int ring = firstRing; ring <= segmentCount; ring++)
+		makeRingUVs(segs, ring, ringTable, uFaceWidth, vOffset, initialVertCount + (ring * sides), initialUVCount + (ring * (sides + 1)));
 
-	// Assuming there is always a single cap vert, we loop through all but that cap vert and calculate its uv's separately
-	for (int vertInd = 0; vertInd < (segmentCount + 1) * sides; vertInd++) {
+	makeCapUVs(segs, ringTable, uFaceWidth, initialUVCount + ((segmentCount + 1) * (sides + 1)));
+}
 
-		us.append(sideInd * uFaceWidth);
+template <int Sides, bool Strip>
+void Branchlets::makeRingUVsFor(const std::vector<BSegment>& segs, int ring, const RingTable& ringTable, float uFaceWidth, float vOffset, int vertIndex, int uvIndex) {
 
-		if (segmentIndex > 0) {
+	static_assert(!Strip || Sides == 2, "A strip has 2 sides");
 
-			// The index difference between vertices on adjacent rings is equal to sides, while the index difference between UVs on adjacent rings
-			// is equal to sides + 1, because we are adding one uv for each ring due to the vertical seam
-			float distToVertBelow = verts[vertInd].distanceTo(verts[vertInd - sides]);
+	const int sides = Sides > 0 ? Sides : ringTable.sides;
 
-			vs.append(vs[vs.length() - (sides + 1)] + (distToVertBelow * vScaler));
-		}
-		else {
+	// Since a tube has a single vertical seam, it has one additional uv per ring.  A strip doesn't wrap around, so it has no seam
+	const int uvsPerRing = Strip ? sides : sides + 1;
+	float* us = &mesh.us[uvIndex];
+	float* vs = &mesh.vs[uvIndex];
 
-			vs.append(vOffset);
-		}
+	for (int sideInd = 0; sideInd < uvsPerRing; sideInd++)
+		us[sideInd] = sideInd * uFaceWidth;
 
-		sideInd++;
+	if (ring == 0) {
 
-		if (sideInd == sides) {
+		for (int sideInd = 0; sideInd < uvsPerRing; sideInd++)
+			vs[sideInd] = vOffset;
 
-			// Since this is a cylinder with a single vertical seam, we will have one additional uv per ring
-			us.append(sideInd * uFaceWidth);
-			if (segmentIndex > 0) {
+		return;
+	}
 
-				// the v value is the same as the v on the uv on the opposite side of the 0-1 space
-				vs.append(vs[vs.length() - sides]);
-			}
-			else {
+	// As we go up the mesh, the rings' radii tend to shrink, so we should adjust the vScaler so that the texture
+	// doesn't appear too smushed (this is inevitable on faces between different sized rings)
+	// The texture itself will shrink farther up the branch, but at least it will do so uniformly
+	// Note that we could adjust the uFaceWidth as well, which would keep the texture the same size for the whole mesh,
+	// however this would make the seam visible - pick your poison
+	const int segmentCount = static_cast<int>(segs.size());
+	float vScaler = getVScaler(segs[std::min(ring, segmentCount - 1)].r, uFaceWidth, ringTable);
+
+	// The distance to each vertex's neighbour on the ring below is worked out here rather than with MeshBuffer::distanceBetween(),
+	// so that the loop can be unrolled and vectorized when the number of sides is fixed
+	const float* xs = &mesh.xs[vertIndex];
+	const float* ys = &mesh.ys[vertIndex];
+	const float* zs = &mesh.zs[vertIndex];
+	const float* vsBelow = vs - uvsPerRing;
+
+	for (int sideInd = 0; sideInd < sides; sideInd++) {
+
+		float dx = xs[sideInd] - xs[sideInd - sides];
+		float dy = ys[sideInd] - ys[sideInd - sides];
+		float dz = zs[sideInd] - zs[sideInd - sides];
+
+		float distToVertBelow = std::sqrt((dx * dx) + (dy * dy) + (dz * dz));
+		vs[sideInd] = vsBelow[sideInd] + (distToVertBelow * vScaler);
+	}
 
-				vs.append(vOffset);
-			}
+	// the v value of the seam is the same as the v on the uv on the opposite side of the 0-1 space
+	if (!Strip)
+		vs[sides] = vs[0];
+}
 
-			sideInd = 0;
-			segmentIndex++;
+template <int Sides, bool Strip>
+void Branchlets::makeCapUVsFor(const std::vector<BSegment>& segs, const RingTable& ringTable, float uFaceWidth, int uvIndex) {
 
-			// As we go up the mesh, the rings' radii tend to shrink, so we should adjust the vScaler so that the texture
-			// doesn't appear too smushed (this is inevitable on faces between different sized rings)
-			// The texture itself will shrink farther up the branch, but at least it will do so uniformly
-			// Note that we could adjust the uFaceWidth as well, which would keep the texture the same size for the whole mesh,
-			// however this would make the seam visible - pick your poison
-			if (segmentIndex < segmentCount)
-				vScaler = getVScaler(segs[segmentIndex].r, uFaceWidth, sides, 1.);
-		}
-	}
+	const int sides = Sides > 0 ? Sides : ringTable.sides;
+	const int uvsPerRing = Strip ? sides : sides + 1;
+	const int capUVs = Strip ? 1 : sides;
 
-	// Now we need a uv for the cap vert for each top face
+	float vScaler = getVScaler(segs.back().r, uFaceWidth, ringTable);
 
 	// The distance in maya to the cap vert from the ring below it is radius * sqrt(2), because we add 1 radius length when placing
 	// the cap vert, so an isosceles triangle is formed with the two equal sides forming a right angle.  Note however that this is
 	// only completely accurate if the mesh is perfectly cylindrical (i.e. infinite sides) - so what we have is an approximation
-	float vLengthToCap = vScaler * segs.back().r * std::sqrtf(2.f);
+	float vLengthToCap = vScaler * segs.back().r * std::sqrt(2.f);
 
-	for (int i = 0; i < sides; i++) {
+	float* us = &mesh.us[uvIndex];
+	float* vs = &mesh.vs[uvIndex];
+	const float* vsBelow = vs - uvsPerRing;
 
-		us.append((i * uFaceWidth) + (uFaceWidth * .5f));
+	for (int i = 0; i < capUVs; i++) {
+
+		us[i] = (i * uFaceWidth) + (uFaceWidth * .5f);
 
 		// Take the average v value of the two lower v's to account for any skew
-		float vBetweenLowerUVs = (vs[vs.length() - (sides + 1)] + vs[(vs.length() - (sides + 1)) + 1]) / 2.f;
-		vs.append(vBetweenLowerUVs + vLengthToCap);
+		float vBetweenLowerUVs = (vsBelow[i] + vsBelow[i + 1]) / 2.f;
+		vs[i] = vBetweenLowerUVs + vLengthToCap;
 	}
 }
 
-void BranchletStrips::makeUVs(const std::vector<BSegment>& segs, int segmentCount, float uWidthMultiplier, float vOffset)
-{
-	float uFaceWidth = uWidthMultiplier;
-	float vScaler = getVScaler(segs[0].r, uFaceWidth, 2, 1.);
+template <int Sides, bool Strip>
+void Branchlets::makeVertexCoordsAndUVsFor(const BVector& startPoint, const std::vector<BSegment>& segs, int sides, float vOffset, int vertIndex, int uvIndex) {
 
-	// To simplify the upcoming loop, make the first two uv's here
-	us.append(0.); vs.append(vOffset);
-	us.append(uFaceWidth); vs.append(vOffset);
+	if (Sides > 0)
+		sides = Sides;
 
-	for (int segmentIndex = 1; segmentIndex < segmentCount + 1; segmentIndex++) {
+	const RingTable& ringTable = getRingTableFor<Sides>(sides);
+	const int segmentCount = static_cast<int>(segs.size());
+	const int uvsPerRing = Strip ? sides : sides + 1;
+	const float uFaceWidth = Strip ? 1.f : 1.f / sides;
 
-		// For a strip, all even indexed u's will be 0., and all odds will be uFaceWidth.
-		us.append(0.);
-		us.append(uFaceWidth);
+	BVector ringCenter = startPoint;
+	RingBasis basis;
+	RingFrame frame;
+	for (int ring = 0; ring <= segmentCount; ring++) {
 
-		if (segmentIndex < segmentCount)
-			vScaler = getVScaler(segs[segmentIndex].r, uFaceWidth, 2, 1.);
-		else
-			vScaler = getVScaler(segs[segmentIndex - 1].r, uFaceWidth, 2, 1.);
+		const int ringVertIndex = vertIndex;
+		frame = findRingFrame(segs, ring, ringCenter, basis);
+		makeVertexRing(frame, ringTable, vertIndex);
+		makeRingUVsFor<Sides, Strip>(segs, ring, ringTable, uFaceWidth, vOffset, ringVertIndex, uvIndex);
 
-		int vertInd = segmentIndex * 2;
-		float distToVertBelow = verts[vertInd].distanceTo(verts[vertInd - 2]);
-		vs.append(vs[vs.length() - 2] + (distToVertBelow * vScaler));
-		vertInd++;
-		distToVertBelow = verts[vertInd].distanceTo(verts[vertInd - 2]);
-		vs.append(vs[vs.length() - 2] + (distToVertBelow * vScaler));
+		// The frame that placed the ring gives its normals and tangents exactly, while it is still at hand
+		if (mesh.withNormals)
+			makeRingNormals(segs, ring, frame, ringTable, ringVertIndex);
+
+		uvIndex += uvsPerRing;
+
+		if (ring < segmentCount)
+			ringCenter += segs[ring].v;
 	}
 
-	float vLengthToCap = vScaler * segs.back().r * std::sqrtf(2.);
+	BVector capVert = findCapVertex(segs, ringCenter);
+	mesh.setVert(vertIndex, capVert.x, capVert.y, capVert.z);
+	makeCapUVsFor<Sides, Strip>(segs, ringTable, uFaceWidth, uvIndex);
+
+	if (mesh.withNormals)
+		makeCapNormal(segs, frame, sides, vertIndex);
+}
+
+// The generic path is also timed on its own by the benchmark
+template void Branchlets::makeVertexCoordsAndUVsFor<0, false>(const BVector& startPoint, const std::vector<BSegment>& segs, int sides, float vOffset, int vertIndex, int uvIndex);
+
+void Branchlets::makeRingUVs(const std::vector<BSegment>& segs, int ring, const RingTable& ringTable, float uFaceWidth, float vOffset, int vertIndex, int uvIndex) {
 
-	us.append(uFaceWidth * .5f);
+	dispatchSides(ringTable.sides, [&](auto fixedSides) {
 
-	float vBetweenLowerUVs = (vs[vs.length() - 2] + vs[vs.length() - 1]) / 2.f;
-	vs.append(vBetweenLowerUVs + vLengthToCap);
+		makeRingUVsFor<decltype(fixedSides)::value, false>(segs, ring, ringTable, uFaceWidth, vOffset, vertIndex, uvIndex);
+	});
 }
 
-float Branchlets::getVScaler(float vertRingRadius, float uFaceWidth, int sides, float textureWtoHRatio) {
+void Branchlets::makeCapUVs(const std::vector<BSegment>& segs, const RingTable& ringTable, float uFaceWidth, int uvIndex) {
 
-	float wedgeAngle = (PI * 2.f) / sides;
-	float radSqu = vertRingRadius * vertRingRadius;
-	float faceWidthInMaya = std::sqrtf((radSqu + radSqu) - (2.f * radSqu * std::cosf(wedgeAngle)));//law of cosines
-	return (uFaceWidth / faceWidthInMaya) * textureWtoHRatio;
+	dispatchSides(ringTable.sides, [&](auto fixedSides) {
+
+		makeCapUVsFor<decltype(fixedSides)::value, false>(segs, ringTable, uFaceWidth, uvIndex);
+	});
 }
 
-void Branchlets::makeUVConnects(const int sides, const int segmentCount, const int initialUVCount) {
+void Branchlets::makeVertexCoordsAndUVs(const BVector& startPoint, const std::vector<BSegment>& segs, int sides, float vOffset, int vertIndex, int uvIndex) {
+
+	BRANCHLETS_TIME(StatPhase::MakeVertexCoords);
 
-	// This works much like creating faceConnects, except we have one additional column of uv's due to the vertical seam,
-	// meaning the uv's don't wrap around. So the code is the same for each face
+	dispatchSides(sides, [&](auto fixedSides) {
 
-	int uvSides = sides + 1;
-	int uvLowerLeftCornerIndex = initialUVCount;
+		makeVertexCoordsAndUVsFor<decltype(fixedSides)::value, false>(startPoint, segs, sides, vOffset, vertIndex, uvIndex);
+	});
+}
 
-	for (int i = 0; i < segmentCount; i++) {
+void BranchletStrips::makeUVs(const std::vector<BSegment>& segs, int segmentCount, float uWidthMultiplier, float vOffset, const int initialVertCount, const int initialUVCount, int firstRing)
+{
+	BRANCHLETS_TIME(StatPhase::MakeUVs);
 
-		for (int j = 0; j < sides; j++) {
+	float uFaceWidth = uWidthMultiplier;
 
-			uvConnects.append(uvLowerLeftCornerIndex);
-			uvConnects.append(uvLowerLeftCornerIndex + 1);
-			uvConnects.append(uvLowerLeftCornerIndex + 1 + uvSides);
-			uvConnects.append(uvLowerLeftCornerIndex + uvSides);
+	// A strip has no seam, so the vertices and uvs of each pair have the same offsets
+	for (int ring = firstRing; ring <= segmentCount; ring++)
+		makeRingUVs(segs, ring, uFaceWidth, vOffset, initialVertCount + (ring * 2), initialUVCount + (ring * 2));
 
-			uvLowerLeftCornerIndex++;
-		}
+	makeCapUVs(segs, uFaceWidth, initialUVCount + ((segmentCount + 1) * 2));
+}
 
-		uvLowerLeftCornerIndex++;
-	}
+void BranchletStrips::makeRingUVs(const std::vector<BSegment>& segs, int ring, float uFaceWidth, float vOffset, int vertIndex, int uvIndex) {
 
-	for (int i = 0; i < sides; i++) {
+	makeRingUVsFor<2, true>(segs, ring, getRingTableFor<2>(2), uFaceWidth, vOffset, vertIndex, uvIndex);
+}
 
-		uvConnects.append(uvLowerLeftCornerIndex);
-		uvConnects.append(uvLowerLeftCornerIndex + 1);
-		uvConnects.append(uvLowerLeftCornerIndex + uvSides);
+void BranchletStrips::makeCapUVs(const std::vector<BSegment>& segs, float uFaceWidth, int uvIndex) {
 
-		uvLowerLeftCornerIndex++;
-	}
+	makeCapUVsFor<2, true>(segs, getRingTableFor<2>(2), uFaceWidth, uvIndex);
 }
 
-void BranchletStrips::makeUVConnects(const int segmentCount, const int initialUVCount) {
+void BranchletStrips::makeVertexCoordsAndUVs(const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int vertIndex, int uvIndex) {
 
-	// This works much like creating faceConnects, except we are doing it for the whole mesh in one go. Also
-	// we have one additional column of uv's due to the vertical seam, meaning the uv's don't wrap around so
-	// the code is the same for each face
+	BRANCHLETS_TIME(StatPhase::MakeVertexCoords);
 
-	int uvLowerLeftCornerIndex = initialUVCount;
+	makeVertexCoordsAndUVsFor<2, true>(startPoint, segs, 2, vOffset, vertIndex, uvIndex);
+}
 
-	for (int i = 0; i < segmentCount; i++) {
+float Branchlets::getVScaler(float vertRingRadius, float uFaceWidth, int sides, float textureWtoHRatio) {
 
-		uvConnects.append(uvLowerLeftCornerIndex);
-		uvConnects.append(uvLowerLeftCornerIndex + 1);
-		uvConnects.append(uvLowerLeftCornerIndex + 3);
-		uvConnects.append(uvLowerLeftCornerIndex + 2);
+	float wedgeAngle = (PI * 2.f) / sides;
+	float radSqu = vertRingRadius * vertRingRadius;
+	float faceWidthInMaya = std::sqrt((radSqu + radSqu) - (2.f * radSqu * std::cos(wedgeAngle)));//law of cosines
+	return (uFaceWidth / faceWidthInMaya) * textureWtoHRatio;
+}
 
-		uvLowerLeftCornerIndex += 2;
-	}
+float Branchlets::getVScaler(float vertRingRadius, float uFaceWidth, const RingTable& ringTable) {
 
-	uvConnects.append(uvLowerLeftCornerIndex);
-	uvConnects.append(uvLowerLeftCornerIndex + 1);
-	uvConnects.append(uvLowerLeftCornerIndex + 2);
+	float radSqu = vertRingRadius * vertRingRadius;
+	float faceWidthInMaya = std::sqrt((radSqu + radSqu) - (2.f * radSqu * ringTable.cosWedge));//law of cosines
+	return uFaceWidth / faceWidthInMaya;
 }
 
 const float Branchlets::PI = 3.1415926f;
@@ -440,10 +1665,10 @@ double Branchlets::findVectorPolar(double x, double z)
 	return pol;
 }
 
-MVector Branchlets::projectByNormal(const MVector& p, const MVector& q, const MPoint& s) {
+BVector Branchlets::projectByNormal(const BVector& p, const BVector& q, const BVector& s) {
 
 	double angle = q.angle(p);
 	double distanceToPlane = std::sin((PI / 2.) - angle) * p.length();
-	MPoint pointOnPlane = (s + p) - (q.normal() * distanceToPlane);
+	BVector pointOnPlane = (s + p) - (q.normal() * distanceToPlane);
 	return pointOnPlane - s;
 }
\ No newline at end of file
@@ -1,71 +1,333 @@
 #pragma once
 
-#include <maya/MVector.h>
-#include <maya/MQuaternion.h>
-#include <maya/MGlobal.h>
-
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <memory>
 
+#include "BMath.h"
+#include "CapsuleBvh.h"
 #include "MMesh.h"
+#include "MeshCache.h"
+#include "RingKernel.h"
+#include "Topology.h"
+
+class BranchletInstances;
+class SegmentStream;
 
 // The building block of Branchlets.  A list of these is input to the Branchlet constructor.
 struct BSegment {
 
 	// A vector describing the direction and length of a branchlet segment
-	MVector v;
+	BVector v;
 
 	// The radius of the segment
 	float r;
 
-	BSegment(const MVector& V, float R) : v(V), r(R) {}
+	BSegment(const BVector& V, float R) : v(V), r(R) {}
+};
+
+// Everything needed to add one branchlet to a mesh.  A list of these is input to BranchletCreator::createMany()
+struct BBranch {
+
+	// The point at the base of the first segment
+	BVector startPoint;
+
+	// The segments of the branchlet, from base to tip
+	std::vector<BSegment> segments;
+
+	// The v coordinate of the bottom vertex ring
+	float vOffset = 0.f;
+
+	BBranch() {}
+
+	BBranch(const BVector& StartPoint, const std::vector<BSegment>& Segments, float VOffset) : startPoint(StartPoint), segments(Segments), vOffset(VOffset) {}
+};
+
+// Some or all of a list of branches, picked out by their indices without copying them.  Branch i of the selection is
+// branches[indices[i]], or branches[i] when there are no indices
+class BranchSelection {
+
+	const std::vector<BBranch>& list;
+	const std::vector<int>* indices;
+
+public:
+
+	BranchSelection(const std::vector<BBranch>& List, const std::vector<int>* Indices = nullptr) : list(List), indices(Indices) {}
+
+	int size() const { return static_cast<int>(indices != nullptr ? indices->size() : list.size()); }
+
+	const BBranch& operator[](int i) const { return indices != nullptr ? list[(*indices)[i]] : list[i]; }
+};
+
+// How Branchlets orients each vertex ring, set with Branchlets::setFrameMode()
+enum class FrameMode {
+
+	// Each ring between two segments is the ellipse where their tubes meet, found with trig, and is turned so that its first vertex
+	// is at the same polar angle about the y axis as the rings around it.  Rings can twist where segments face downwards
+	Ellipse,
+
+	// A frame is carried up each branchlet from ring to ring by reflecting it in the plane between them and then in the plane
+	// between their directions (the double reflection method of Wang et al., "Computation of Rotation Minimizing Frames", 2008).
+	// This takes only dot and cross products and a square root or two per ring, and rings never twist
+	RotationMinimizing
+};
+
+// How to choose the number of sides of each branchlet from its radius, for Branchlets::addMany() and Branchlets::createLevels().
+// A ring of n sides around a circle of radius r strays from it by at most r * (1 - cos(pi / n)), so each branchlet gets the fewest
+// sides that keep its thickest ring within 'maxError' of a true circle
+struct LodSettings {
+
+	// The largest distance allowed between a ring and the circle it stands for, in world units
+	float maxError = .01f;
+
+	// If more than 0, maxError is in pixels instead, and this is the width of a pixel at a distance of 1 from 'viewPoint'
+	// (2 * tan(fieldOfView / 2) / imageWidth).  Each branchlet's error is then measured at its closest ring to 'viewPoint'
+	float pixelSize = 0.f;
+	BVector viewPoint;
+
+	int minSides = 3;
+	int maxSides = 16;
 };
 
 // Computes and stores all data needed to create n-sided closed tube-like meshes using Maya's MFnMesh::create()
+// The geometry itself only uses BVector and BQuaternion, so this also builds without Maya when BRANCHLETS_HEADLESS is defined
 // Note that this may represent a single branchlet or many branchlets, as more may be added with addOne(),
 // however it will always hold a single set of arguments for a single MObject
 class Branchlets : public MMesh {
 
+	// Times the individual phases of generation (see Benchmark/)
+	friend class BranchletsBenchmark;
+
+	// Sets the number of sides of the objects it hands out
+	friend class BranchletsPool;
+
+	// Reads the records and arrays it compacts
+	friend class CompactMesh;
+
 	int sides = 0;
 
-	// Calculate all face connects for a branchlet
-	void makeFaceConnects(const int segmentCount, const int sides, const int initialVertCount);
+	FrameMode frameMode = FrameMode::Ellipse;
+
+	// Calculate the uv coordintes for a branchlet from vertex ring 'firstRing' up, writing them from 'initialUVCount' onward.
+	// The v coordinates of every ring build on those of the ring below, so the rings below 'firstRing' must already be filled in
+	void makeUVs(const std::vector<BSegment>& segs, int segmentCount, int sides, float uWidthMultiplier, float lowestV, const int initialVertCount, const int initialUVCount, int firstRing);
 
-	// Calculate all face counts for a branchlet
-	void makeFaceCounts(const int segmentCount, const int sides);
+	// Calculate the u and v coordinates of vertex ring 'ring', whose vertices start at 'vertIndex' and uvs at 'uvIndex'.  Its vertices
+	// and the uvs of the ring below it must already be filled in
+	void makeRingUVs(const std::vector<BSegment>& segs, int ring, const RingTable& ringTable, float uFaceWidth, float vOffset, int vertIndex, int uvIndex);
 
-	// Calculate all uv coordintes for a branchlet
-	void makeUVs(const std::vector<BSegment>& segs, int segmentCount, int sides, float uWidthMultiplier, float lowestV);
+	// Calculate the uvs of the cap vertex, one for each top face, which start at 'uvIndex'
+	void makeCapUVs(const std::vector<BSegment>& segs, const RingTable& ringTable, float uFaceWidth, int uvIndex);
 
-	// Calculate all uv connects for a branchlet
-	void makeUVConnects(const int sides, const int segmentCount, const int initialUVCount);
+	// Calculate the vertex coordinates and uvs of a branchlet in a single pass, filling in each ring's uvs straight after its vertices,
+	// while they and the ring below are still in cache.  The result is identical to makeVertexCoords() followed by makeUVs()
+	void makeVertexCoordsAndUVs(const BVector& startPoint, const std::vector<BSegment>& segs, int sides, float vOffset, int vertIndex, int uvIndex);
+
+	// Fill in all elements of a branchlet starting at the indices in 'at', which are then advanced past them.  The arrays must already be long enough
+	void fillOne(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset, int sides, MeshCounts& at);
+
+	// Appends many branchlets at once, where 'branchSides' holds the number of sides of each
+	void addBranches(const BranchSelection& branches, const std::vector<int>& branchSides, unsigned threadCount);
+
+	// Find the number of sides 'lod' gives a branchlet
+	static int lodSides(const BBranch& branch, const LodSettings& lod);
+
+	// Add everything that a branchlet's geometry depends on to 'key'
+	static void addToCacheKey(MeshCacheKey& key, const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int branchSides);
 
 protected:
 
+	// What is needed to regenerate a branchlet in place after it has been added
+	struct BranchRecord {
+
+		BVector startPoint;
+		float vOffset = 0.f;
+
+		// Where the branchlet's segments start in recordSegments, and how many there are
+		int firstSegment = 0;
+		int segmentCount = 0;
+
+		// Where the branchlet's elements start in each array
+		MeshCounts at;
+
+		int sides = 0;
+
+		// The mode its rings were oriented with, which updates keep to
+		FrameMode frameMode = FrameMode::Ellipse;
+	};
+
+	// The plane of a vertex ring, in which vertex i is center + cos(a)e0 + sin(a)e1, where a is its angle from the first vertex.
+	// Nothing here depends on the number of sides, so the same frame gives a ring of any size
+	struct RingFrame {
+
+		BVector center;
+		BVector e0;
+		BVector e1;
+	};
+
+	// What FrameMode::RotationMinimizing carries from one ring to the next: the unit normal of the ring's plane, and a unit vector
+	// in that plane that marks where its first vertex is
+	struct RingBasis {
+
+		BVector tangent;
+		BVector reference;
+	};
+
+	// Every branchlet added, in order.  Nothing is kept while geometry is streamed to an exporter, since it is no longer held, and
+	// the records of branchlets added before an exporter was set are dropped when they are streamed with the next ones.
+	// Only the first 'recordCount' are in use; the rest are kept from before the last reset() so their memory can be reused
+	std::vector<BranchRecord> records;
+	int recordCount = 0;
+
+	// The segments of every record, one after another, so that adding a branchlet doesn't allocate any.  Only the first
+	// 'recordSegmentCount' are in use
+	std::vector<BSegment> recordSegments;
+	int recordSegmentCount = 0;
+
+	// The segments of the branchlet updateBranch() is regenerating, kept between calls
+	std::vector<BSegment> editSegments;
+
+	// Where each branchlet passed to addMany() starts in each array, and its number of sides.  Kept between calls so that
+	// rebuilding doesn't allocate them again
+	std::vector<MeshCounts> branchStarts;
+	std::vector<int> branchSides;
+
+	// The indices of the branchlets of a segment stream that addStream() is adding to this mesh
+	std::vector<int> streamBranches;
+
+	// Stream everything added so far to the exporter, if there is one, and drop the records of what it took
+	void flush();
+
+	// Make room for 'count' more records and return the index of the first of them
+	int addRecords(int count);
+
+	// Give the record at 'index' room for 'segmentCount' segments after those of every record placed before it.  Records are
+	// placed one at a time, in order, before any of them is set
+	void placeRecord(int index, int segmentCount);
+
+	// Fill in the record at 'index', which must have been placed with room for 'segs'.  Records with their own places can be
+	// set from several threads at once
+	void setRecord(int index, const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, const MeshCounts& at, int branchSides);
+
+	// The key of the cache file a list of branchlets is stored in, where 'branchSides' holds the number of sides of each, and the
+	// key of a single branchlet's entry.  A branchlet added with addOne() is stored in a file of its own under its entry's key,
+	// which is the same as the key of a list of just it
+	uint64_t cacheKey(const BranchSelection& branches, const std::vector<int>& branchSides) const;
+	uint64_t cacheKey(const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int branchSides) const;
+
+	// If there is a cache and it holds 'key', fill in every array from the indices in 'at' up to 'end' from it and return true
+	bool loadFromCache(uint64_t key, const MeshCounts& at, const MeshCounts& end);
+
+	// If there is a cache, store every array from the indices in 'at' up to 'end' in it under 'key', and show any warnings it
+	// has kept.  Like every use of the cache, this is only done on the thread that called addOne() or addMany()
+	void storeInCache(uint64_t key, const MeshCounts& at, const MeshCounts& end);
+
+	// The entry of each branchlet passed to addMany() in the cache, and whether it was found there.  Kept between calls, like
+	// 'branchStarts'
+	std::vector<MeshCacheRange> cacheRanges;
+	std::vector<char> cacheHits;
+
+	// Look up each of 'branches', laid out from 'branchStarts' up to 'end', in the cache and fill in those that are there, setting
+	// 'cacheHits'.  Without a cache nothing is found
+	void loadBranchesFromCache(const BranchSelection& branches, const std::vector<int>& branchSides, const MeshCounts& end);
+
+	// Store every branchlet of 'branches' that loadBranchesFromCache() didn't find together in one file of the cache, and show
+	// any warnings it has kept
+	void storeBranchesInCache(const BranchSelection& branches, const std::vector<int>& branchSides);
+
+	// Where finished branchlets are looked up before they are generated, if anywhere
+	MeshCache* cache = nullptr;
+
+	// The capsules around every segment, built by capsuleBvh() when asked for and rebuilt after anything changes
+	CapsuleBvh bvh;
+	bool bvhCurrent = false;
+
 	const static float PI;
 
-	// Calculate all the vertex coordinates for a branchlet
-	void makeVertexCoords(const MPoint startPoint, const std::vector<BSegment>& segs, const int sides);
+	// Replace segments of the branchlet at 'branchIndex' from 'firstSegment' on with 'segments', and find the range of vertex rings
+	// this changes.  The cap vertex counts as the ring after the last.  Returns false if there is nothing to update
+	bool applySegmentEdit(int branchIndex, int firstSegment, const std::vector<BSegment>& segments, int& firstRing, int& lastRing);
+
+	// Copy the face counts, face connects and uv connects of a branchlet from its template, starting at the indices in 'at'
+	void makeConnects(const TopologyTemplate& topology, const MeshCounts& at);
+
+	// Calculate all the vertex coordinates for a branchlet, writing them from 'vertIndex' onward
+	void makeVertexCoords(const BVector startPoint, const std::vector<BSegment>& segs, const int sides, int vertIndex);
+
+	// Calculate the vertex coordinates of rings 'firstRing' to 'lastRing' of a branchlet whose vertices start at 'vertIndex'.
+	// The cap vertex counts as the ring after the last
+	void makeVertexCoords(const BVector startPoint, const std::vector<BSegment>& segs, const int sides, int vertIndex, int firstRing, int lastRing);
 
 	// Find the vectors from the center of the circle on the plane whose normal is defined by 'seg' to two points 90 degrees apart along its perimeter
-	void findEllipseVectors(MVector& major, MVector& minor, BSegment seg);
+	void findEllipseVectors(BVector& major, BVector& minor, BSegment seg);
 
 	// Find the vectors from the center of the ellipse on the plane whose normal is defined by 'topSeg' to the points of maximum (major) and minimum (minor) curvature
-	void findEllipseVectors(MVector& major, MVector& minor, const MPoint& center, const BSegment& bottomSeg, const BSegment& topSeg);
+	void findEllipseVectors(BVector& major, BVector& minor, const BVector& center, const BSegment& bottomSeg, const BSegment& topSeg);
+
+	// Use the parametric equation for an ellipse in 3D space to calculate the coordinates of 'ringTable.sides' vertices along its perimeter
+	void makeVertexRing(const BVector& major, const BVector& minor, const BVector& center, const RingTable& ringTable, const BVector& topSegVect, int& vertIndex);
+
+	// Calculate the coordinates of 'ringTable.sides' vertices around a ring whose frame is already known
+	void makeVertexRing(const RingFrame& frame, const RingTable& ringTable, int& vertIndex);
+
+	// Calculate the normal and tangent of each vertex of ring 'ring' from the frame that placed it.  A vertex between two segments is
+	// on both of their tubes, so its normal is halfway between theirs.  A ring of 2 vertices is the width of a strip, which faces out
+	// of its plane.  Only called when the mesh keeps normals
+	void makeRingNormals(const std::vector<BSegment>& segs, int ring, const RingFrame& frame, const RingTable& ringTable, int vertIndex);
+
+	// Calculate the normal and tangent of the cap vertex, which faces along the last segment, given the frame of the last ring
+	void makeCapNormal(const std::vector<BSegment>& segs, const RingFrame& lastFrame, int sides, int vertIndex);
+
+	// Find the frame of the ellipse with the given axes, rotated so that its first vertex lines up with those of the rings around it
+	RingFrame findRingFrame(const BVector& major, const BVector& minor, const BVector& center, const BVector& topSegVect);
+
+	// Find the frame of vertex ring 'ring' of a branchlet, whose center is 'ringCenter'.  Rings must be found in order from the base,
+	// since with FrameMode::RotationMinimizing 'basis' is carried from one to the next
+	RingFrame findRingFrame(const std::vector<BSegment>& segs, int ring, const BVector& ringCenter, RingBasis& basis);
+
+	// Carry 'basis' from vertex ring 'ring - 1' to 'ring', or start it for ring 0
+	void carryRingBasis(const std::vector<BSegment>& segs, int ring, RingBasis& basis);
+
+	// Find the frame of vertex ring 'ring' from its rotation minimizing basis.  Rings between two segments lie on the plane halfway
+	// between them, stretched across the bend so the tube keeps its radius, as the ellipses of FrameMode::Ellipse are
+	RingFrame findRotationMinimizingFrame(const std::vector<BSegment>& segs, int ring, const BVector& ringCenter, const RingBasis& basis);
+
+	// Find the frames of every vertex ring of a branchlet, from base to tip
+	void findRingFrames(const BVector& startPoint, const std::vector<BSegment>& segs, std::vector<RingFrame>& frames);
+
+	// Find the position of the cap vertex, given the center of the last ring
+	BVector findCapVertex(const std::vector<BSegment>& segs, const BVector& lastRingCenter);
 
-	// Use the parametric equation for an ellipse in 3D space to calculate the coordinates of 'sides' vertices along its perimeter
-	void makeVertexRing(const MVector& major, const MVector& minor, const MPoint& center, int sides, const MVector& topSegVect);
+	// Fill in all elements of a branchlet from its ring frames, as fillOne() does
+	void fillFromFrames(const BBranch& branch, const std::vector<RingFrame>& frames, int sides, MeshCounts& at);
+
+	// makeRingUVs() for 'Sides' sides known at compile time (see FixedSides.h), or ringTable.sides when 'Sides' is 0.  With 'Strip'
+	// set, the uvs are laid out as BranchletStrips' are, with no seam
+	template <int Sides, bool Strip>
+	void makeRingUVsFor(const std::vector<BSegment>& segs, int ring, const RingTable& ringTable, float uFaceWidth, float vOffset, int vertIndex, int uvIndex);
+
+	// makeCapUVs() for 'Sides' sides known at compile time, as above.  A strip has a single cap face, and so a single cap uv
+	template <int Sides, bool Strip>
+	void makeCapUVsFor(const std::vector<BSegment>& segs, const RingTable& ringTable, float uFaceWidth, int uvIndex);
+
+	// makeVertexCoordsAndUVs() for 'Sides' sides known at compile time, as above.  This serves both Branchlets and BranchletStrips
+	template <int Sides, bool Strip>
+	void makeVertexCoordsAndUVsFor(const BVector& startPoint, const std::vector<BSegment>& segs, int sides, float vOffset, int vertIndex, int uvIndex);
 
 	// Find the amount with which to multiply the distance between v coords so that they are proportional to their length in Maya
 	float getVScaler(float vertRingRadius, float uFaceWidth, int sides, float textureWtoHRatio);
 
+	// The same as above for a texture ratio of 1, with the cosine of the wedge angle taken from 'ringTable' rather than computed
+	float getVScaler(float vertRingRadius, float uFaceWidth, const RingTable& ringTable);
+
 	// Find the polar angle of a vector in world space
 	double findVectorPolar(double x, double z);
 
 	// Project p onto the plane to which q is the normal vector, given a shared starting point
-	MVector projectByNormal(const MVector& p, const MVector& q, const MPoint& s);
+	BVector projectByNormal(const BVector& p, const BVector& q, const BVector& s);
 
 public:
 
@@ -73,46 +335,213 @@ public:
 
 	Branchlets(int SIDES) : sides(SIDES) {}
 
-	Branchlets(const MPoint& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset);
+	Branchlets(const BVector& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset);
+
+	// Declared so that declaring the destructor doesn't turn every move into a copy of every array
+	Branchlets(const Branchlets&) = default;
+
+	Branchlets(Branchlets&&) = default;
+
+	Branchlets& operator=(const Branchlets&) = default;
+
+	Branchlets& operator=(Branchlets&&) = default;
+
+	virtual ~Branchlets() {}
+
+	// The number of sides of each branchlet added with addOne(), or 2 for strips
+	int sideCount() const { return sides; }
+
+	// Choose how the vertex rings of branchlets added from now on are oriented.  Branchlets already added keep theirs, even when they are updated
+	void setFrameMode(FrameMode mode) { frameMode = mode; }
+
+	FrameMode getFrameMode() const { return frameMode; }
+
+	// Work out a unit normal and tangent for every vertex added from now on, from the frame of its ring as it is placed, so that
+	// nothing downstream has to find them by walking the mesh (see MeshBuffer::nxs).  Turn this on before adding anything, since
+	// branchlets already added get none.  The tangents follow the uv layout of both tubes and strips
+	void setNormals(bool enabled) { mesh.withNormals = enabled; }
+
+	bool hasNormals() const { return mesh.withNormals; }
+
+	// Look up each branchlet added with addOne() or addMany() in 'meshCache' before generating it, and store it there if it isn't
+	// found.  addMany() looks up every branchlet of the list at once, so that each file is read once, and stores the ones it
+	// generates together in one file, so a list with a few changed branchlets only generates and stores those.  Pass nullptr to
+	// stop using a cache.  Branchlets added with addStream() aren't cached, and neither is anything while normals are kept,
+	// since cache entries don't hold them
+	void setCache(MeshCache* meshCache) { cache = meshCache; }
+
+	// Remove every branchlet, keeping the memory of every array so that building again allocates nothing until it grows past them
+	void reset();
 
 	// Appends to the member variables to form another branchlet
-	void addOne(const MPoint& startPoint, const std::vector<BSegment>& branchSegments, float vOffset);
+	virtual void addOne(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset);
+
+	// Appends many branchlets at once.  Every array is resized a single time before any of them are filled, and each branchlet
+	// is then written to its own range of the arrays, spread over 'threadCount' threads (0 uses every hardware thread).
+	// The result is identical for any number of threads
+	virtual void addMany(const std::vector<BBranch>& branches, unsigned threadCount = 1);
+
+	// Appends many branchlets at once like the overload above, but gives each one its own number of sides, chosen by 'lod' from its radius
+	void addMany(const std::vector<BBranch>& branches, const LodSettings& lod, unsigned threadCount = 1);
+
+	// Appends the branchlets of 'branches' at 'branchIndices', in that order, like the first overload, reading them where they
+	// are rather than copying them into a list of their own
+	virtual void addMany(const std::vector<BBranch>& branches, const std::vector<int>& branchIndices, unsigned threadCount = 1);
+
+	// Appends branchlets 'firstBranch' to 'firstBranch + count - 1' of 'stream' like addMany().  Their segments are read from the
+	// stream's mapping and converted one branchlet at a time on the thread filling it in, so the stream is never held as BBranches.
+	// Branchlets with 2 sides are left for BranchletStrips::addStream(), and those with 0 sides get the sides of this object
+	virtual void addStream(const SegmentStream& stream, int firstBranch, int count, unsigned threadCount = 1);
+
+	// Appends a copy of each of 'instances' like addMany(), by turning and moving its prototype's vertices and offsetting its
+	// connects, spread over 'threadCount' threads.  Nothing is generated, so this is far faster than addMany() where few shapes
+	// are repeated many times.  'instances' must have the same number of sides as this object.  Each branchlet's record holds its
+	// prototype's segments turned into place, so it can be updated and is in capsuleBvh() like any other.  If this object keeps
+	// normals, the prototypes' are turned too.  Instances aren't cached
+	void addInstances(const BranchletInstances& instances, unsigned threadCount = 1);
+
+	// Create a Branchlets object for each level in 'levels', all holding 'branches'.  The ring frames, which take most of the work
+	// of placing vertices and don't depend on the number of sides, are found once per ring and shared by every level.  With
+	// 'normals' set every level keeps normals and tangents, as setNormals() does
+	static std::vector<Branchlets> createLevels(const std::vector<BBranch>& branches, const std::vector<LodSettings>& levels, unsigned threadCount = 1, FrameMode frameMode = FrameMode::Ellipse, bool normals = false);
+
+	// The fewest sides, from 'minSides' to 'maxSides', that keep a ring of 'radius' within 'maxError' of a true circle
+	static int sidesForError(float radius, float maxError, int minSides, int maxSides);
+
+	// Find how many elements a branchlet with 'segmentCount' segments adds to each array
+	static MeshCounts countOne(int segmentCount, int sides);
+
+	// The number of branchlets that can be changed with updateBranch()
+	int branchCount() const { return recordCount; }
+
+	// A hierarchy of capsules around every segment of every branchlet, for finding branchlets that intersect each other or other
+	// geometry, the branchlet nearest a point, or the branchlet under a ray.  Each capsule's branch is the branchlet's index in the
+	// order it was added.  It is only built the first time it is asked for after branchlets are added, updated or removed.
+	// Nothing is kept of branchlets streamed to an exporter, so they aren't in it
+	const CapsuleBvh& capsuleBvh();
+
+	// Replace the segments of the branchlet at 'branchIndex' (in the order they were added) from 'firstSegment' on with 'segments',
+	// without changing how many it has.  A segment only shapes the vertex rings at its two ends, though changing its vector also moves
+	// every ring above it, so only those rings and the v coordinates above them are recomputed.  Connectivity is left as it is.
+	// The changed vertices and uvs are marked dirty, so that updateMesh() can push just them to an existing mesh
+	virtual void updateBranch(int branchIndex, int firstSegment, const std::vector<BSegment>& segments);
 };
 
 // Like Branchlets, but with 2 sides
 class BranchletStrips : public Branchlets {
 
-	// Calculate all face connects for a strip
-	void makeFaceConnects(const int segmentCount, const int initialVertCount);
+	friend class BranchletsBenchmark;
+
+	// Calculate the uv coordintes for a strip from vertex pair 'firstRing' up, writing them from 'initialUVCount' onward
+	void makeUVs(const std::vector<BSegment>& segs, int segmentCount, float uWidthMultiplier, float lowestV, const int initialVertCount, const int initialUVCount, int firstRing);
+
+	// Calculate the u and v coordinates of the pair of vertices 'ring', as Branchlets::makeRingUVs() does for a ring
+	void makeRingUVs(const std::vector<BSegment>& segs, int ring, float uFaceWidth, float vOffset, int vertIndex, int uvIndex);
+
+	// Calculate the uv of the tip vertex, which is at 'uvIndex'
+	void makeCapUVs(const std::vector<BSegment>& segs, float uFaceWidth, int uvIndex);
 
-	// Calculate all face counts for a strip
-	void makeFaceCounts(const int segmentCount);
+	// Calculate the vertex coordinates and uvs of a strip in a single pass, as Branchlets::makeVertexCoordsAndUVs() does
+	void makeVertexCoordsAndUVs(const BVector& startPoint, const std::vector<BSegment>& segs, float vOffset, int vertIndex, int uvIndex);
 
-	// Calculate all uv coordintes for a strip
-	void makeUVs(const std::vector<BSegment>& segs, int segmentCount, float uWidthMultiplier, float lowestV);
+	// Fill in all elements of a strip starting at the indices in 'at', which are then advanced past them.  The arrays must already be long enough
+	void fillOne(const BVector& startPoint, const std::vector<BSegment>& stripSegments, float vOffset, MeshCounts& at);
 
-	// Calculate all uv connects for a strip
-	void makeUVConnects(const int segmentCount, const int initialUVCount);
+	// Appends many strips at once, as both addMany() overloads do
+	void addStrips(const BranchSelection& strips, unsigned threadCount);
 
 public:
 
-	BranchletStrips() {}
+	BranchletStrips() : Branchlets(2) {}
 
-	BranchletStrips(const MPoint& startPoint, const std::vector<BSegment>& branchSegments, float vOffset);
+	BranchletStrips(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset);
 
 	// Appends to the member variables to form another strip
-	void addOne(const MPoint& startPoint, const std::vector<BSegment>& branchSegments, float vOffset);
+	void addOne(const BVector& startPoint, const std::vector<BSegment>& branchSegments, float vOffset) override;
+
+	// Appends many strips at once.  Every array is resized a single time before any of them are filled, and each strip
+	// is then written to its own range of the arrays, spread over 'threadCount' threads (0 uses every hardware thread)
+	void addMany(const std::vector<BBranch>& strips, unsigned threadCount = 1) override;
+
+	// Appends the strips of 'strips' at 'stripIndices', in that order, as Branchlets::addMany() does
+	void addMany(const std::vector<BBranch>& strips, const std::vector<int>& stripIndices, unsigned threadCount = 1) override;
+
+	// Appends the branchlets of 'stream' with 2 sides, from 'firstBranch' to 'firstBranch + count - 1', as Branchlets::addStream() does
+	void addStream(const SegmentStream& stream, int firstBranch, int count, unsigned threadCount = 1) override;
+
+	// Find how many elements a strip with 'segmentCount' segments adds to each array
+	static MeshCounts countOne(int segmentCount);
+
+	// Replace the segments of the strip at 'branchIndex' from 'firstSegment' on, as Branchlets::updateBranch() does
+	void updateBranch(int branchIndex, int firstSegment, const std::vector<BSegment>& segments) override;
 };
 
+// Keeps Branchlets and BranchletStrips objects that are no longer needed, so that later builds can reuse their memory.  An
+// interactive tool that rebuilds the same tree over and over can release each result once it has made its mesh, and then after
+// the first few builds every array is already large enough and rebuilding allocates nothing
+class BranchletsPool {
+
+	std::vector<std::unique_ptr<Branchlets>> tubes;
+	std::vector<std::unique_ptr<Branchlets>> strips;
+
+public:
+
+	// Get an empty object for 'sides' sides, which is a BranchletStrips for 2 sides and a Branchlets otherwise.  It is taken from
+	// the pool if there is one there, and made new if not.  Returns nullptr for less than 2 sides
+	std::unique_ptr<Branchlets> acquire(int sides);
+
+	// Put an object in the pool to be handed out again by acquire().  It is emptied, and its exporter, cache, frame mode and
+	// normals are set back to those of a new object
+	void release(std::unique_ptr<Branchlets> branchlets);
+};
+
+// Reusable storage for the list of branches passed to addMany().  The branches and their segment lists are kept when reset()
+// is called, so filling it again for the next build reuses their memory rather than allocating new lists
+class BranchArena {
+
+	std::vector<BBranch> branchList;
+	std::vector<BBranch> spare;
+
+public:
+
+	// Start another branch.  Append its segments to the returned branch's 'segments', which is empty
+	BBranch& add(const BVector& startPoint, float vOffset);
+
+	// Every branch added since the last reset()
+	const std::vector<BBranch>& branches() const { return branchList; }
+
+	// Remove every branch, keeping them and their segment lists to be handed out again by add()
+	void reset();
+};
+
+// Creates Branchlets or BranchletStrips objects depending on the value of sides.  They are returned by pointer, so a BranchletStrips
+// keeps its own type and nothing is copied on the way out
 class BranchletCreator {
 
+	BranchletsPool* pool = nullptr;
+
+	// Get an empty object for 'sides' sides, from the pool if there is one
+	std::unique_ptr<Branchlets> makeEmpty(int sides);
+
 public:
 
 	BranchletCreator() {}
 
+	// Take objects from 'pool' rather than making new ones, so their memory is reused.  Give them back with BranchletsPool::release()
+	BranchletCreator(BranchletsPool* Pool) : pool(Pool) {}
+
 	// Creates a Branchlets or BranchletStrips object depending on the value of sides.  All member variables are empty.
-	Branchlets createDefault(int sides);
+	std::unique_ptr<Branchlets> createDefault(int sides);
 
 	// Creates a Branchlets or BranchletStrips object depending on the value of sides.
-	Branchlets create(const MPoint& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset);
+	std::unique_ptr<Branchlets> create(const BVector& startPoint, int sides, const std::vector<BSegment>& branchSegments, float vOffset);
+
+	// Creates a Branchlets or BranchletStrips object holding every branch in 'branches'.  The mesh arrays are counted
+	// and allocated once for the whole list, rather than growing with each branch.  Branches are generated on 'threadCount'
+	// threads, where 0 uses every hardware thread
+	std::unique_ptr<Branchlets> createMany(int sides, const std::vector<BBranch>& branches, unsigned threadCount = 1);
+
+	// Creates an object holding the branches of 'branches' at 'branchIndices', in that order, like the overload above but without
+	// copying them into a list of their own
+	std::unique_ptr<Branchlets> createMany(int sides, const std::vector<BBranch>& branches, const std::vector<int>& branchIndices, unsigned threadCount = 1);
 };
@@ -0,0 +1,553 @@
+#include "CapsuleBvh.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Deep enough for any tree built here, since splitting at the median halves the capsules at every level
+static const int maxStackDepth = 64;
+
+static double clamp01(double value) {
+
+	return std::min(1., std::max(0., value));
+}
+
+// The squared distance between the closest points of segments p1-q1 and p2-q2 (Ericson, Real-Time Collision Detection, 5.1.9)
+static double segmentDistanceSquared(const BVector& p1, const BVector& q1, const BVector& p2, const BVector& q2) {
+
+	const double epsilon = 1e-12;
+
+	const BVector d1 = q1 - p1;
+	const BVector d2 = q2 - p2;
+	const BVector r = p1 - p2;
+	const double a = d1 * d1;
+	const double e = d2 * d2;
+	const double f = d2 * r;
+
+	double s = 0.;
+	double t = 0.;
+
+	if (a <= epsilon && e <= epsilon)
+		return r * r;
+
+	if (a <= epsilon) {
+
+		t = clamp01(f / e);
+	}
+	else {
+
+		const double c = d1 * r;
+
+		if (e <= epsilon) {
+
+			s = clamp01(-c / a);
+		}
+		else {
+
+			// The segments' closest points on their lines, clamped to the first segment, then the second clamped and the first redone
+			const double b = d1 * d2;
+			const double denominator = (a * e) - (b * b);
+
+			s = denominator != 0. ? clamp01(((b * f) - (c * e)) / denominator) : 0.;
+			t = ((b * s) + f) / e;
+
+			if (t < 0.) {
+
+				t = 0.;
+				s = clamp01(-c / a);
+			}
+			else if (t > 1.) {
+
+				t = 1.;
+				s = clamp01((b - c) / a);
+			}
+		}
+	}
+
+	const BVector between = (p1 + (d1 * s)) - (p2 + (d2 * t));
+	return between * between;
+}
+
+// The squared distance from 'point' to the segment from 'start' to 'end'
+static double pointSegmentDistanceSquared(const BVector& point, const BVector& start, const BVector& end) {
+
+	const BVector segment = end - start;
+	const double lengthSquared = segment * segment;
+	const double t = lengthSquared > 0. ? clamp01(((point - start) * segment) / lengthSquared) : 0.;
+
+	const BVector between = point - (start + (segment * t));
+	return between * between;
+}
+
+// The distance along the ray from 'origin' along the unit vector 'direction' to where it enters 'capsule', or -1 if it misses
+// or starts inside it.  The capsule is a cylinder with a sphere at each end, and the ray enters it at the first of its entries
+// to those, with the cylinder's only counting between its ends
+static double rayCapsuleDistance(const BVector& origin, const BVector& direction, const Capsule& capsule) {
+
+	const BVector axis = capsule.end - capsule.start;
+	const BVector fromStart = origin - capsule.start;
+	const double radiusSquared = static_cast<double>(capsule.radius) * capsule.radius;
+
+	const double axisAxis = axis * axis;
+	const double axisDirection = axis * direction;
+	const double axisFromStart = axis * fromStart;
+
+	double best = -1.;
+
+	// The ray is parallel to the cylinder when a is 0, in which case it can only enter through the spheres
+	const double a = axisAxis - (axisDirection * axisDirection);
+	if (a > 1e-12 * axisAxis) {
+
+		const double b = (axisAxis * (direction * fromStart)) - (axisFromStart * axisDirection);
+		const double c = (axisAxis * (fromStart * fromStart)) - (axisFromStart * axisFromStart) - (radiusSquared * axisAxis);
+		const double h = (b * b) - (a * c);
+
+		if (h >= 0.) {
+
+			const double t = (-b - std::sqrt(h)) / a;
+			const double alongAxis = axisFromStart + (t * axisDirection);
+
+			if (t >= 0. && alongAxis > 0. && alongAxis < axisAxis)
+				best = t;
+		}
+	}
+
+	for (const BVector* center : { &capsule.start, &capsule.end }) {
+
+		const BVector fromCenter = origin - *center;
+		const double b = direction * fromCenter;
+		const double h = (b * b) - ((fromCenter * fromCenter) - radiusSquared);
+
+		if (h >= 0.) {
+
+			const double t = -b - std::sqrt(h);
+			if (t >= 0. && (best < 0. || t < best))
+				best = t;
+		}
+	}
+
+	return best;
+}
+
+static void capsuleBox(const Capsule& capsule, double min[3], double max[3]) {
+
+	const double start[3] = { capsule.start.x, capsule.start.y, capsule.start.z };
+	const double end[3] = { capsule.end.x, capsule.end.y, capsule.end.z };
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		min[axis] = std::min(start[axis], end[axis]) - capsule.radius;
+		max[axis] = std::max(start[axis], end[axis]) + capsule.radius;
+	}
+}
+
+static bool boxesOverlap(const double minA[3], const double maxA[3], const double minB[3], const double maxB[3]) {
+
+	return minA[0] <= maxB[0] && minB[0] <= maxA[0] && minA[1] <= maxB[1] && minB[1] <= maxA[1] && minA[2] <= maxB[2] && minB[2] <= maxA[2];
+}
+
+static double boxDistanceSquared(const double min[3], const double max[3], const BVector& point) {
+
+	const double p[3] = { point.x, point.y, point.z };
+	double distanceSquared = 0.;
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		const double outside = std::max(0., std::max(min[axis] - p[axis], p[axis] - max[axis]));
+		distanceSquared += outside * outside;
+	}
+
+	return distanceSquared;
+}
+
+// The distance along a ray to where it enters the box, or -1 if it misses it within 'maxDistance'.  'inverse' holds 1 over each
+// component of the ray's direction
+static double rayBoxDistance(const double min[3], const double max[3], const double origin[3], const double inverse[3], double maxDistance) {
+
+	double near = 0.;
+	double far = maxDistance;
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		double t0 = (min[axis] - origin[axis]) * inverse[axis];
+		double t1 = (max[axis] - origin[axis]) * inverse[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+
+		near = std::max(near, t0);
+		far = std::min(far, t1);
+
+		if (near > far)
+			return -1.;
+	}
+
+	return near;
+}
+
+void CapsuleBvh::build(const std::vector<Capsule>& capsules) {
+
+	capsuleList = capsules;
+	nodes.clear();
+
+	const int capsuleCount = static_cast<int>(capsules.size());
+	order.resize(capsuleCount);
+	boxes.resize(capsuleCount);
+	centers.resize(capsuleCount);
+
+	for (int i = 0; i < capsuleCount; i++) {
+
+		order[i] = i;
+		capsuleBox(capsules[i], boxes[i].min, boxes[i].max);
+		centers[i] = capsules[i].start + capsules[i].end;
+	}
+
+	if (capsuleCount > 0) {
+
+		nodes.reserve(2 * ((capsuleCount / leafSize) + 1));
+		nodes.emplace_back();
+		buildNode(0, 0, capsuleCount);
+	}
+
+	centers.clear();
+	centers.shrink_to_fit();
+}
+
+void CapsuleBvh::buildNode(int nodeIndex, int first, int count) {
+
+	Node node;
+	double centerMin[3];
+	double centerMax[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		node.box.min[axis] = centerMin[axis] = std::numeric_limits<double>::max();
+		node.box.max[axis] = centerMax[axis] = std::numeric_limits<double>::lowest();
+	}
+
+	for (int i = first; i < first + count; i++) {
+
+		const Box& box = boxes[order[i]];
+		const double center[3] = { centers[order[i]].x, centers[order[i]].y, centers[order[i]].z };
+
+		for (int axis = 0; axis < 3; axis++) {
+
+			node.box.min[axis] = std::min(node.box.min[axis], box.min[axis]);
+			node.box.max[axis] = std::max(node.box.max[axis], box.max[axis]);
+			centerMin[axis] = std::min(centerMin[axis], center[axis]);
+			centerMax[axis] = std::max(centerMax[axis], center[axis]);
+		}
+	}
+
+	if (count <= leafSize) {
+
+		node.first = first;
+		node.count = count;
+		nodes[nodeIndex] = node;
+		return;
+	}
+
+	// Split at the median center along the axis the centers spread farthest on.  Ties are broken by index so the tree is always the same
+	int axis = 0;
+	for (int a = 1; a < 3; a++)
+		if (centerMax[a] - centerMin[a] > centerMax[axis] - centerMin[axis])
+			axis = a;
+
+	auto centerOf = [&](int capsuleIndex) {
+
+		const BVector& center = centers[capsuleIndex];
+		return axis == 0 ? center.x : (axis == 1 ? center.y : center.z);
+	};
+
+	const int half = count / 2;
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](int a, int b) {
+
+		const double centerA = centerOf(a);
+		const double centerB = centerOf(b);
+		return centerA < centerB || (centerA == centerB && a < b);
+	});
+
+	const int firstChild = static_cast<int>(nodes.size());
+	node.first = firstChild;
+	node.count = 0;
+	nodes[nodeIndex] = node;
+
+	nodes.emplace_back();
+	nodes.emplace_back();
+	buildNode(firstChild, first, half);
+	buildNode(firstChild + 1, first + half, count - half);
+}
+
+void CapsuleBvh::clear() {
+
+	capsuleList.clear();
+	nodes.clear();
+	order.clear();
+	boxes.clear();
+}
+
+template <typename Accept, typename Found>
+void CapsuleBvh::findOverlaps(const Capsule& query, const Accept& accept, const Found& found) const {
+
+	if (nodes.empty())
+		return;
+
+	double queryMin[3];
+	double queryMax[3];
+	capsuleBox(query, queryMin, queryMax);
+
+	const double radiusSum = query.radius;
+	int stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		const Node& node = nodes[stack[--stackSize]];
+		if (!boxesOverlap(queryMin, queryMax, node.box.min, node.box.max))
+			continue;
+
+		if (node.count == 0) {
+
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++) {
+
+			const int capsuleIndex = order[i];
+			if (!accept(capsuleIndex))
+				continue;
+
+			const Capsule& capsule = capsuleList[capsuleIndex];
+			const double reach = radiusSum + capsule.radius;
+
+			if (segmentDistanceSquared(query.start, query.end, capsule.start, capsule.end) <= reach * reach)
+				found(capsuleIndex);
+		}
+	}
+}
+
+void CapsuleBvh::testLeaves(const Node& a, const Node& b, int minSegmentGap, std::vector<CapsulePair>& pairs) const {
+
+	for (int i = a.first; i < a.first + a.count; i++) {
+
+		const Capsule& capsuleA = capsuleList[order[i]];
+		const Box& boxA = boxes[order[i]];
+
+		for (int j = (&a == &b ? i + 1 : b.first); j < b.first + b.count; j++) {
+
+			const Capsule& capsuleB = capsuleList[order[j]];
+			const Box& boxB = boxes[order[j]];
+
+			if (!boxesOverlap(boxA.min, boxA.max, boxB.min, boxB.max))
+				continue;
+
+			if (capsuleA.branch == capsuleB.branch && std::abs(capsuleA.segment - capsuleB.segment) < minSegmentGap)
+				continue;
+
+			const double reach = static_cast<double>(capsuleA.radius) + capsuleB.radius;
+			if (segmentDistanceSquared(capsuleA.start, capsuleA.end, capsuleB.start, capsuleB.end) <= reach * reach)
+				pairs.push_back({ std::min(order[i], order[j]), std::max(order[i], order[j]) });
+		}
+	}
+}
+
+void CapsuleBvh::selfOverlaps(std::vector<CapsulePair>& pairs, int minSegmentGap) const {
+
+	pairs.clear();
+
+	if (nodes.empty())
+		return;
+
+	// Walk the tree against itself a pair of nodes at a time, so that whole subtrees far from each other are ruled out at once.
+	// A node paired with itself stands for the pairs within it, and is split into its children paired with themselves and each other
+	std::vector<std::pair<int, int>> stack;
+	stack.emplace_back(0, 0);
+
+	while (!stack.empty()) {
+
+		const int indexA = stack.back().first;
+		const int indexB = stack.back().second;
+		stack.pop_back();
+
+		const Node& a = nodes[indexA];
+		const Node& b = nodes[indexB];
+
+		if (!boxesOverlap(a.box.min, a.box.max, b.box.min, b.box.max))
+			continue;
+
+		if (indexA == indexB) {
+
+			if (a.count > 0) {
+
+				testLeaves(a, a, minSegmentGap, pairs);
+			}
+			else {
+
+				stack.emplace_back(a.first, a.first);
+				stack.emplace_back(a.first, a.first + 1);
+				stack.emplace_back(a.first + 1, a.first + 1);
+			}
+		}
+		else if (a.count > 0 && b.count > 0) {
+
+			testLeaves(a, b, minSegmentGap, pairs);
+		}
+		else if (b.count > 0 || (a.count == 0 && a.first < b.first)) {
+
+			// Split whichever node is higher in the tree, which is the one built first
+			stack.emplace_back(a.first, indexB);
+			stack.emplace_back(a.first + 1, indexB);
+		}
+		else {
+
+			stack.emplace_back(indexA, b.first);
+			stack.emplace_back(indexA, b.first + 1);
+		}
+	}
+
+	// Pairs come out in the order the tree was walked, so they are sorted to give a stable order
+	std::sort(pairs.begin(), pairs.end(), [](const CapsulePair& a, const CapsulePair& b) {
+
+		return a.first < b.first || (a.first == b.first && a.second < b.second);
+	});
+}
+
+void CapsuleBvh::overlaps(const std::vector<Capsule>& queries, std::vector<CapsulePair>& pairs) const {
+
+	pairs.clear();
+
+	for (int i = 0; i < static_cast<int>(queries.size()); i++) {
+
+		const size_t firstPair = pairs.size();
+
+		findOverlaps(queries[i], [](int) { return true; }, [&](int j) {
+
+			pairs.push_back({ i, j });
+		});
+
+		std::sort(pairs.begin() + firstPair, pairs.end(), [](const CapsulePair& a, const CapsulePair& b) { return a.second < b.second; });
+	}
+}
+
+CapsuleHit CapsuleBvh::nearest(const BVector& point, double maxDistance) const {
+
+	CapsuleHit hit;
+	hit.distance = maxDistance;
+
+	if (nodes.empty())
+		return hit;
+
+	int stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		const Node& node = nodes[stack[--stackSize]];
+
+		// A node's box holds every capsule's whole radius, so no surface in it can be closer than the box.  Capsules holding the point
+		// have negative distances, so a box holding it is never ruled out
+		const double boxDistance = std::sqrt(boxDistanceSquared(node.box.min, node.box.max, point));
+		if (boxDistance > 0. && boxDistance > hit.distance)
+			continue;
+
+		if (node.count == 0) {
+
+			// Visit the nearer child first, so that the farther one is more likely to be skipped
+			const Node& a = nodes[node.first];
+			const Node& b = nodes[node.first + 1];
+			const bool aFirst = boxDistanceSquared(a.box.min, a.box.max, point) <= boxDistanceSquared(b.box.min, b.box.max, point);
+
+			stack[stackSize++] = aFirst ? node.first + 1 : node.first;
+			stack[stackSize++] = aFirst ? node.first : node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++) {
+
+			const Capsule& capsule = capsuleList[order[i]];
+			const double distance = std::sqrt(pointSegmentDistanceSquared(point, capsule.start, capsule.end)) - capsule.radius;
+
+			if (distance < hit.distance || (distance == hit.distance && hit.found() && order[i] < hit.capsule)) {
+
+				hit.capsule = order[i];
+				hit.distance = distance;
+			}
+		}
+	}
+
+	return hit;
+}
+
+void CapsuleBvh::nearest(const std::vector<BVector>& points, std::vector<CapsuleHit>& hits, unsigned threadCount) const {
+
+	hits.resize(points.size());
+
+	parallelFor(static_cast<int>(points.size()), threadCount, [&](int i) {
+
+		hits[i] = nearest(points[i]);
+	});
+}
+
+CapsuleHit CapsuleBvh::raycast(const BVector& origin, const BVector& direction, double maxDistance) const {
+
+	CapsuleHit hit;
+	hit.distance = maxDistance;
+
+	const BVector unitDirection = direction.normal();
+	if (nodes.empty() || unitDirection.length() == 0.)
+		return hit;
+
+	const double o[3] = { origin.x, origin.y, origin.z };
+	const double inverse[3] = { 1. / unitDirection.x, 1. / unitDirection.y, 1. / unitDirection.z };
+
+	int stack[maxStackDepth];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		const Node& node = nodes[stack[--stackSize]];
+		if (rayBoxDistance(node.box.min, node.box.max, o, inverse, hit.distance) < 0.)
+			continue;
+
+		if (node.count == 0) {
+
+			const Node& a = nodes[node.first];
+			const Node& b = nodes[node.first + 1];
+			const double distanceA = rayBoxDistance(a.box.min, a.box.max, o, inverse, hit.distance);
+			const double distanceB = rayBoxDistance(b.box.min, b.box.max, o, inverse, hit.distance);
+			const bool aFirst = distanceB < 0. || (distanceA >= 0. && distanceA <= distanceB);
+
+			stack[stackSize++] = aFirst ? node.first + 1 : node.first;
+			stack[stackSize++] = aFirst ? node.first : node.first + 1;
+			continue;
+		}
+
+		for (int i = node.first; i < node.first + node.count; i++) {
+
+			const double distance = rayCapsuleDistance(origin, unitDirection, capsuleList[order[i]]);
+
+			if (distance >= 0. && (distance < hit.distance || (distance == hit.distance && hit.found() && order[i] < hit.capsule))) {
+
+				hit.capsule = order[i];
+				hit.distance = distance;
+			}
+		}
+	}
+
+	return hit;
+}
+
+void CapsuleBvh::raycast(const std::vector<BVector>& origins, const std::vector<BVector>& directions, std::vector<CapsuleHit>& hits, unsigned threadCount) const {
+
+	const int rayCount = static_cast<int>(std::min(origins.size(), directions.size()));
+	hits.resize(rayCount);
+
+	parallelFor(rayCount, threadCount, [&](int i) {
+
+		hits[i] = raycast(origins[i], directions[i]);
+	});
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "BMath.h"
+
+// The volume swept by a sphere of 'radius' from 'start' to 'end', which is how CapsuleBvh stands in for a segment of a branchlet
+struct Capsule {
+
+	BVector start;
+	BVector end;
+	float radius = 0.f;
+
+	// The branchlet (in the order it was added) and the segment within it that this capsule is around
+	int branch = 0;
+	int segment = 0;
+};
+
+// Two capsules that overlap, given by their indices in CapsuleBvh::capsules() or, for CapsuleBvh::overlaps(), in the query list
+struct CapsulePair {
+
+	int first = 0;
+	int second = 0;
+};
+
+// The result of a nearest point or ray query.  'distance' is from the point to the capsule's surface (negative inside it), or
+// along the ray to where it enters the capsule
+struct CapsuleHit {
+
+	int capsule = -1;
+	double distance = 0.;
+
+	bool found() const { return capsule >= 0; }
+};
+
+// A bounding volume hierarchy over capsules, for finding overlapping branchlets, the branchlet nearest a point, and the branchlet
+// a ray hits, without testing every pair.  Each node's box holds its children, and each leaf holds a few capsules.  It is split at
+// the median of the longest axis of the capsules' centers, which keeps it balanced however the capsules are spread
+class CapsuleBvh {
+
+	struct Box {
+
+		double min[3];
+		double max[3];
+	};
+
+	struct Node {
+
+		Box box;
+
+		// For a leaf, the first of its 'count' entries in 'order'.  For any other node, 'count' is 0 and this is the index of its
+		// first child, with the second straight after it
+		int first = 0;
+		int count = 0;
+	};
+
+	std::vector<Capsule> capsuleList;
+	std::vector<Node> nodes;
+
+	// Capsule indices, grouped so that each leaf's capsules are together
+	std::vector<int> order;
+
+	// The box around each capsule, by capsule index, which is checked before the exact test
+	std::vector<Box> boxes;
+
+	// Twice the center of each capsule, by capsule index.  Only kept while building
+	std::vector<BVector> centers;
+
+	// Build the node at 'nodeIndex' over order[first, first + count)
+	void buildNode(int nodeIndex, int first, int count);
+
+	// Test every capsule of leaf 'a' against every capsule of leaf 'b', or each pair within 'a' once if they are the same leaf
+	void testLeaves(const Node& a, const Node& b, int minSegmentGap, std::vector<CapsulePair>& pairs) const;
+
+	// Find every capsule whose box overlaps 'query''s and which overlaps it, and which 'accept' doesn't rule out
+	template <typename Accept, typename Found>
+	void findOverlaps(const Capsule& query, const Accept& accept, const Found& found) const;
+
+public:
+
+	// The most capsules in a leaf
+	static const int leafSize = 4;
+
+	// Build the hierarchy over 'capsules', replacing anything built before
+	void build(const std::vector<Capsule>& capsules);
+
+	void clear();
+
+	bool empty() const { return capsuleList.empty(); }
+
+	const std::vector<Capsule>& capsules() const { return capsuleList; }
+
+	// Find every pair of capsules that overlap, each pair once with first < second.  Segments of the same branchlet always touch
+	// their neighbours, so pairs from one branchlet whose segment numbers are less than 'minSegmentGap' apart are left out
+	void selfOverlaps(std::vector<CapsulePair>& pairs, int minSegmentGap = 2) const;
+
+	// Find every capsule that overlaps each of 'queries', such as capsules standing in for other geometry in the scene.  Each pair
+	// holds the index of the query first and of the capsule second
+	void overlaps(const std::vector<Capsule>& queries, std::vector<CapsulePair>& pairs) const;
+
+	// Find the capsule whose surface is nearest 'point', ignoring any farther than 'maxDistance'
+	CapsuleHit nearest(const BVector& point, double maxDistance = std::numeric_limits<double>::max()) const;
+
+	// Find the nearest capsule to each of 'points', spread over 'threadCount' threads
+	void nearest(const std::vector<BVector>& points, std::vector<CapsuleHit>& hits, unsigned threadCount = 1) const;
+
+	// Find the first capsule hit by the ray from 'origin' along 'direction', within 'maxDistance' of it.  A capsule holding the
+	// origin is not hit by it
+	CapsuleHit raycast(const BVector& origin, const BVector& direction, double maxDistance = std::numeric_limits<double>::max()) const;
+
+	// Cast a ray for each pair of 'origins' and 'directions', spread over 'threadCount' threads
+	void raycast(const std::vector<BVector>& origins, const std::vector<BVector>& directions, std::vector<CapsuleHit>& hits, unsigned threadCount = 1) const;
+};
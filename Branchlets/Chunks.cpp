@@ -0,0 +1,77 @@
+#include "Chunks.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+// Find the grid coordinate of 'value' along one axis, clamping far away points to the outermost cells rather than overflowing
+static int cellCoordinate(double value, float cellSize) {
+
+	const double cell = std::floor(value / cellSize);
+	return static_cast<int>(std::max(-1e9, std::min(1e9, cell)));
+}
+
+std::vector<BranchletChunk> chunkBranches(const std::vector<BBranch>& branches, int sides, const ChunkSettings& settings) {
+
+	// Sort branchlets into cells, keeping their order within each
+	std::map<std::tuple<int, int, int>, std::vector<int>> cells;
+	for (int i = 0; i < static_cast<int>(branches.size()); i++) {
+
+		std::tuple<int, int, int> cell(0, 0, 0);
+		if (settings.cellSize > 0.f) {
+
+			const BVector& start = branches[i].startPoint;
+			cell = std::make_tuple(cellCoordinate(start.x, settings.cellSize), cellCoordinate(start.y, settings.cellSize), cellCoordinate(start.z, settings.cellSize));
+		}
+
+		cells[cell].push_back(i);
+	}
+
+	std::vector<BranchletChunk> chunks;
+
+	for (const auto& cell : cells) {
+
+		// Start a new chunk for each cell, and again whenever the next branchlet would take the current chunk over budget
+		int chunkVerts = 0;
+		chunks.emplace_back();
+
+		for (int branchIndex : cell.second) {
+
+			const int segmentCount = static_cast<int>(branches[branchIndex].segments.size());
+			const int branchVerts = sides > 2 ? Branchlets::countOne(segmentCount, sides).verts : BranchletStrips::countOne(segmentCount).verts;
+
+			if (settings.maxVerts > 0 && chunkVerts > 0 && chunkVerts + branchVerts > settings.maxVerts) {
+
+				chunks.emplace_back();
+				chunkVerts = 0;
+			}
+
+			chunks.back().branchIndices.push_back(branchIndex);
+			chunkVerts += branchVerts;
+		}
+	}
+
+	return chunks;
+}
+
+void buildChunk(BranchletChunk& chunk, const std::vector<BBranch>& branches, int sides) {
+
+	// The chunk's branchlets are read straight from 'branches' by their indices
+	BranchletCreator creator;
+	chunk.mesh = creator.createMany(sides, branches, chunk.branchIndices, 1);
+	chunk.bounds = chunk.mesh->buffer().bounds();
+}
+
+std::vector<BranchletChunk> createChunks(const std::vector<BBranch>& branches, int sides, const ChunkSettings& settings, unsigned threadCount) {
+
+	std::vector<BranchletChunk> chunks = chunkBranches(branches, sides, settings);
+
+	parallelFor(static_cast<int>(chunks.size()), threadCount, [&](int i) {
+
+		buildChunk(chunks[i], branches, sides);
+	});
+
+	return chunks;
+}
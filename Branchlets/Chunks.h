@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Branchlets.h"
+
+// How chunkBranches() splits a list of branchlets into groups that each become a mesh of their own, so that a whole forest isn't
+// one enormous mesh.  Smaller meshes can be culled by the viewport one by one, stay under the mesh size limits of other programs,
+// and can be rebuilt on their own
+struct ChunkSettings {
+
+	// The edge length of the cubic grid cells that branchlets are sorted into by their start points.  0 keeps them all in one cell
+	float cellSize = 0.f;
+
+	// The most vertices a chunk may hold.  The branchlets of a cell are split over as many chunks as it takes, in the order they
+	// were given, though a single branchlet over the budget still gets a chunk to itself.  0 means no limit
+	int maxVerts = 0;
+};
+
+// One mesh's worth of branchlets
+struct BranchletChunk {
+
+	// The indices, in the list given to chunkBranches(), of the branchlets in this chunk, in order
+	std::vector<int> branchIndices;
+
+	// The chunk's mesh, once it has been built by buildChunk()
+	std::unique_ptr<Branchlets> mesh;
+
+	// The box around every vertex of 'mesh', found by buildChunk()
+	MeshBounds bounds;
+};
+
+// Split 'branches' into chunks for meshes of 'sides' sides, first by grid cell and then by vertex budget.  Cells come in order
+// of their x, then y, then z grid coordinates.  Only each chunk's branch indices are filled in
+std::vector<BranchletChunk> chunkBranches(const std::vector<BBranch>& branches, int sides, const ChunkSettings& settings);
+
+// Build the mesh and bounds of one chunk made by chunkBranches() from the same 'branches'.  Chunks don't depend on each other,
+// so they can be built on different threads, or built and handed to Maya one at a time
+void buildChunk(BranchletChunk& chunk, const std::vector<BBranch>& branches, int sides);
+
+// Split 'branches' into chunks and build every one of them, spreading the chunks over 'threadCount' threads (0 uses every
+// hardware thread).  The result is identical for any number of threads
+std::vector<BranchletChunk> createChunks(const std::vector<BBranch>& branches, int sides, const ChunkSettings& settings, unsigned threadCount = 1);
@@ -0,0 +1,210 @@
+#include "CompactMesh.h"
+#include "MeshExporter.h"
+#include "Topology.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The number of steps a 16 bit value is quantized to
+static const float quantizeSteps = 65535.f;
+
+// exportTo() writes pieces of about this many vertices
+static const int exportPieceVerts = 1 << 16;
+
+// The step that quantizes [min, max] to 16 bits.  A range of 0 gets a step of 0, which puts every value at min
+static float quantizeStep(float min, float max) {
+
+	return max > min ? (max - min) / quantizeSteps : 0.f;
+}
+
+// Quantizing and expanding are both done in double precision, so the only error besides the step is the final rounding to float
+static uint16_t quantize(float value, float min, float step) {
+
+	if (step <= 0.f)
+		return 0;
+
+	const double q = std::round((static_cast<double>(value) - min) / step);
+	return static_cast<uint16_t>(std::max(0., std::min(static_cast<double>(quantizeSteps), q)));
+}
+
+static float expandValue(uint16_t q, float min, float step) {
+
+	return static_cast<float>(min + (q * static_cast<double>(step)));
+}
+
+CompactMesh::CompactMesh(const Branchlets& source) {
+
+	const MeshBuffer& mesh = source.mesh;
+
+	// Check that the records describe the whole mesh before relying on them
+	MeshCounts recorded;
+	for (int i = 0; i < source.recordCount; i++) {
+
+		const Branchlets::BranchRecord& record = source.records[i];
+		const int segmentCount = record.segmentCount;
+		recorded += record.sides == 2 ? BranchletStrips::countOne(segmentCount) : Branchlets::countOne(segmentCount, record.sides);
+	}
+
+	const MeshCounts sourceCounts = mesh.counts();
+	if (source.recordCount == 0 || recorded.verts != sourceCounts.verts || recorded.uvs != sourceCounts.uvs || recorded.faceConnects != sourceCounts.faceConnects) {
+
+		MMesh::displayWarning("Only meshes that kept the records of their branchlets can be compacted");
+		return;
+	}
+
+	total = sourceCounts;
+
+	const MeshBounds bounds = mesh.bounds();
+	for (int axis = 0; axis < 3; axis++) {
+
+		boxMin[axis] = bounds.min[axis];
+		boxStep[axis] = quantizeStep(bounds.min[axis], bounds.max[axis]);
+	}
+
+	positions.resize(static_cast<size_t>(total.verts) * 3);
+	for (int i = 0; i < total.verts; i++) {
+
+		positions[(i * 3)] = quantize(mesh.xs[i], boxMin[0], boxStep[0]);
+		positions[(i * 3) + 1] = quantize(mesh.ys[i], boxMin[1], boxStep[1]);
+		positions[(i * 3) + 2] = quantize(mesh.zs[i], boxMin[2], boxStep[2]);
+	}
+
+	branches.resize(source.recordCount);
+	vCoords.resize(total.uvs);
+
+	for (int i = 0; i < source.recordCount; i++) {
+
+		const Branchlets::BranchRecord& record = source.records[i];
+		Branch& branch = branches[i];
+		branch.segmentCount = record.segmentCount;
+		branch.sides = record.sides;
+
+		const int firstUV = record.at.uvs;
+		const int lastUV = firstUV + countBranch(branch).uvs;
+		const auto range = std::minmax_element(mesh.vs.begin() + firstUV, mesh.vs.begin() + lastUV);
+
+		branch.vMin = *range.first;
+		branch.vStep = quantizeStep(*range.first, *range.second);
+
+		for (int uv = firstUV; uv < lastUV; uv++)
+			vCoords[uv] = quantize(mesh.vs[uv], branch.vMin, branch.vStep);
+	}
+}
+
+MeshCounts CompactMesh::countBranch(const Branch& branch) {
+
+	return branch.sides == 2 ? BranchletStrips::countOne(branch.segmentCount) : Branchlets::countOne(branch.segmentCount, branch.sides);
+}
+
+size_t CompactMesh::memoryBytes() const {
+
+	return (branches.capacity() * sizeof(Branch)) + (positions.capacity() * sizeof(uint16_t)) + (vCoords.capacity() * sizeof(uint16_t));
+}
+
+BVector CompactMesh::positionErrorBound() const {
+
+	return BVector(boxStep[0] * .5, boxStep[1] * .5, boxStep[2] * .5);
+}
+
+float CompactMesh::vErrorBound() const {
+
+	float largestStep = 0.f;
+	for (const Branch& branch : branches)
+		largestStep = std::max(largestStep, branch.vStep);
+
+	return largestStep * .5f;
+}
+
+void CompactMesh::expandBranch(int branchIndex, const MeshCounts& from, MeshBuffer& out, const MeshCounts& to) const {
+
+	const Branch& branch = branches[branchIndex];
+	const MeshCounts count = countBranch(branch);
+	const bool strip = branch.sides == 2;
+
+	for (int i = 0; i < count.verts; i++) {
+
+		const uint16_t* q = &positions[static_cast<size_t>(from.verts + i) * 3];
+		out.xs[to.verts + i] = expandValue(q[0], boxMin[0], boxStep[0]);
+		out.ys[to.verts + i] = expandValue(q[1], boxMin[1], boxStep[1]);
+		out.zs[to.verts + i] = expandValue(q[2], boxMin[2], boxStep[2]);
+	}
+
+	// The u coordinates are worked out as the generator does, so they come back exactly
+	const float uFaceWidth = strip ? 1.f : 1.f / branch.sides;
+	const int uvsPerRing = strip ? branch.sides : branch.sides + 1;
+	const int capUVs = strip ? 1 : branch.sides;
+	float* us = &out.us[to.uvs];
+
+	for (int ring = 0; ring <= branch.segmentCount; ring++) {
+
+		for (int i = 0; i < uvsPerRing; i++)
+			us[i] = i * uFaceWidth;
+
+		us += uvsPerRing;
+	}
+
+	for (int i = 0; i < capUVs; i++)
+		us[i] = (i * uFaceWidth) + (uFaceWidth * .5f);
+
+	for (int i = 0; i < count.uvs; i++)
+		out.vs[to.uvs + i] = expandValue(vCoords[from.uvs + i], branch.vMin, branch.vStep);
+
+	const TopologyTemplate& topology = getTopologyTemplate(branch.segmentCount, branch.sides);
+	std::copy(topology.faceCounts.begin(), topology.faceCounts.end(), out.faceCounts.begin() + to.faces);
+	copyWithOffset(topology.faceConnects.data(), static_cast<int>(topology.faceConnects.size()), to.verts, &out.faceConnects[to.faceConnects]);
+	copyWithOffset(topology.uvConnects.data(), static_cast<int>(topology.uvConnects.size()), to.uvs, &out.uvConnects[to.uvConnects]);
+}
+
+void CompactMesh::expand(MeshBuffer& out) const {
+
+	out.clear();
+	out.resize(total);
+
+	MeshCounts at;
+	for (int i = 0; i < branchCount(); i++) {
+
+		expandBranch(i, at, out, at);
+		at += countBranch(branches[i]);
+	}
+}
+
+void CompactMesh::exportTo(MeshExporter& exporter) const {
+
+	MeshBuffer piece;
+	MeshCounts from;
+	int first = 0;
+
+	while (first < branchCount()) {
+
+		// Take branchlets until the piece is big enough, but always at least one
+		int last = first;
+		MeshCounts pieceCounts;
+		while (last < branchCount() && (last == first || pieceCounts.verts < exportPieceVerts))
+			pieceCounts += countBranch(branches[last++]);
+
+		piece.resize(pieceCounts);
+
+		MeshCounts to;
+		for (int i = first; i < last; i++) {
+
+			expandBranch(i, from, piece, to);
+
+			const MeshCounts count = countBranch(branches[i]);
+			from += count;
+			to += count;
+		}
+
+		exporter.write(piece);
+		first = last;
+	}
+}
+
+#ifndef BRANCHLETS_HEADLESS
+MStatus CompactMesh::createMesh(std::string name) const {
+
+	Branchlets expanded;
+	expand(expanded.mesh);
+
+	return expanded.createMesh(name);
+}
+#endif
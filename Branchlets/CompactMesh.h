@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Branchlets.h"
+
+class MeshExporter;
+
+// A finished branchlet mesh in a small fraction of the memory of its MeshBuffer, for large forests held between build stages.
+// Only what can't be worked out again is kept:
+//
+//     positions       3 x 16 bits per vertex, quantized within the box around the whole mesh
+//     u coordinates   none, since every ring's are the same multiples of 1 / sides
+//     v coordinates   16 bits per uv, quantized within each branchlet's range of v
+//     connectivity    none, since it only depends on each branchlet's segment count and sides (see Topology.h)
+//
+// A tube of 8 sides and 12 segments takes about 900 bytes rather than about 5900.  Quantizing moves a vertex by at most half a
+// step of the box along each axis, which is positionErrorBound(), so a mesh should be kept to a modest size, e.g. by compacting
+// each chunk of createChunks() on its own.  Nothing is expanded back to full precision until it is exported or made into a mesh.
+// Normals and tangents (see Branchlets::setNormals()) aren't kept
+class CompactMesh {
+
+	struct Branch {
+
+		int segmentCount = 0;
+		int sides = 0;
+
+		// v = vMin + (q * vStep), where q is the 16 bit value
+		float vMin = 0.f;
+		float vStep = 0.f;
+	};
+
+	std::vector<Branch> branches;
+
+	// x, y, z of each vertex in turn, where x = boxMin[0] + (q * boxStep[0]) and so on
+	std::vector<uint16_t> positions;
+	std::vector<uint16_t> vCoords;
+
+	float boxMin[3] = { 0.f, 0.f, 0.f };
+	float boxStep[3] = { 0.f, 0.f, 0.f };
+
+	// The length of each array once expanded
+	MeshCounts total;
+
+	// The number of elements a branchlet expands to
+	static MeshCounts countBranch(const Branch& branch);
+
+	// Expand the branchlet at 'branchIndex', whose vertices and uvs start at 'from', into 'out' at the indices in 'to'
+	void expandBranch(int branchIndex, const MeshCounts& from, MeshBuffer& out, const MeshCounts& to) const;
+
+public:
+
+	CompactMesh() {}
+
+	// Quantize every branchlet of 'source'.  The branchlets' records are needed to know their segment counts and sides, so a mesh
+	// that was streamed to an exporter can't be compacted; a warning is shown and this is left empty
+	explicit CompactMesh(const Branchlets& source);
+
+	bool empty() const { return branches.empty(); }
+
+	int branchCount() const { return static_cast<int>(branches.size()); }
+
+	// The length of each array of the expanded mesh
+	const MeshCounts& counts() const { return total; }
+
+	// The number of bytes allocated for the compact data
+	size_t memoryBytes() const;
+
+	// The most any expanded vertex can be from where it was along each axis, besides rounding to single precision
+	BVector positionErrorBound() const;
+
+	// The most any expanded v coordinate can be from what it was, over every branchlet
+	float vErrorBound() const;
+
+	// Expand the whole mesh into 'out', replacing what it held
+	void expand(MeshBuffer& out) const;
+
+	// Expand the mesh into 'exporter' a batch of branchlets at a time, so it is never held at full size
+	void exportTo(MeshExporter& exporter) const;
+
+#ifndef BRANCHLETS_HEADLESS
+	// Expand the mesh and pass it to MFnMesh::create(), as MMesh::createMesh() does
+	MStatus createMesh(std::string name) const;
+#endif
+};
@@ -0,0 +1,111 @@
+#include "Decimate.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+// The radius of the ring at the top of segment 'segment' of 'segs', which is the next segment's, or its own for the last
+static double topRadius(const std::vector<BSegment>& segs, size_t segment) {
+
+	return segs[std::min(segment + 1, segs.size() - 1)].r;
+}
+
+// How far v grows for each unit of distance up to a ring of 'radius' with 'sides' sides.  This is Branchlets::getVScaler(): the
+// u width of a face over its width in the world, where a strip's single face spans all of u and a tube's spans 1 / sides of it
+static double vScale(double radius, int sides) {
+
+	const double uFaceWidth = sides == 2 ? 1. : 1. / sides;
+	const double faceWidth = std::sqrt((2. * radius * radius) - (2. * radius * radius * std::cos((2. * PI) / sides)));
+
+	return uFaceWidth / faceWidth;
+}
+
+// How far v grows from the ring at the base of segment 'first' to the ring at the top of segment 'last', in texture heights
+static double vGrowth(const std::vector<BSegment>& segs, size_t first, size_t last, int sides) {
+
+	double growth = 0.;
+	for (size_t i = first; i <= last; i++)
+		growth += segs[i].v.length() * vScale(topRadius(segs, i), sides);
+
+	return growth;
+}
+
+// Check whether the run of segments from 'first' to 'next - 1' can take in segment 'next', given the vector of the merged segment
+// that would result and how far v has already moved at the base of the run
+static bool canJoin(const std::vector<BSegment>& segs, size_t first, size_t next, const BVector& chord, double vShift, const DecimateSettings& settings) {
+
+	if (segs[next - 1].v.angle(segs[next].v) > settings.maxAngle)
+		return false;
+
+	if (std::fabs(segs[next].r - segs[first].r) > settings.maxRadiusChange * segs[first].r)
+		return false;
+
+	const double chordLength = chord.length();
+	if (chordLength <= 0.)
+		return false;
+
+	// The merged segment's top ring is the next kept one's, or for the last segment its own, which has the run's first radius
+	const double mergedTop = next + 1 < segs.size() ? segs[next + 1].r : segs[first].r;
+	const double shift = vShift + (chordLength * vScale(mergedTop, settings.sides)) - vGrowth(segs, first, next, settings.sides);
+	if (std::fabs(shift) > settings.maxVShift)
+		return false;
+
+	// The distance from each joint in the run to the line through the merged segment.  The run is nearly straight by now, so this
+	// is also the distance to the merged segment itself
+	BVector joint;
+	for (size_t i = first; i < next; i++) {
+
+		joint += segs[i].v;
+		if ((joint ^ chord).length() / chordLength > settings.maxDeviation)
+			return false;
+	}
+
+	return true;
+}
+
+std::vector<BSegment> decimateSegments(const std::vector<BSegment>& segs, const DecimateSettings& settings) {
+
+	std::vector<BSegment> kept;
+	kept.reserve(segs.size());
+
+	// How far the v of the ring at the base of the current run has moved, which carries on up the branchlet
+	double vShift = 0.;
+
+	size_t first = 0;
+	while (first < segs.size()) {
+
+		// Grow the run starting at 'first' for as long as the next segment can join it
+		BVector chord = segs[first].v;
+		size_t next = first + 1;
+
+		while (next < segs.size()) {
+
+			const BVector joinedChord = chord + segs[next].v;
+			if (!canJoin(segs, first, next, joinedChord, vShift, settings))
+				break;
+
+			chord = joinedChord;
+			next++;
+		}
+
+		const double mergedTop = next < segs.size() ? segs[next].r : segs[first].r;
+		vShift += (chord.length() * vScale(mergedTop, settings.sides)) - vGrowth(segs, first, next - 1, settings.sides);
+
+		kept.emplace_back(chord, segs[first].r);
+		first = next;
+	}
+
+	return kept;
+}
+
+std::vector<BBranch> decimateBranches(const std::vector<BBranch>& branches, const DecimateSettings& settings) {
+
+	std::vector<BBranch> decimated;
+	decimated.reserve(branches.size());
+
+	for (const BBranch& branch : branches)
+		decimated.emplace_back(branch.startPoint, decimateSegments(branch.segments, settings), branch.vOffset);
+
+	return decimated;
+}
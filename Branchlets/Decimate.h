@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "Branchlets.h"
+
+// Limits on how far decimateSegments() may change a branchlet.  A run of segments is merged into one only if it stays within all of them
+struct DecimateSettings {
+
+	// The largest bend between two neighbouring segments in a run, in radians.  This is the angle B in Branchlets::findEllipseVectors()
+	float maxAngle = .05f;
+
+	// The largest difference between the radius of any segment in a run and the radius of its first segment, as a fraction of the latter
+	float maxRadiusChange = .05f;
+
+	// The largest distance from any removed joint to the merged segment, in world units.  This limits how far the silhouette moves
+	float maxDeviation = .01f;
+
+	// The largest amount by which the v coordinate of any ring that is kept may move, in texture heights.  Each ring's v grows
+	// from the one below by the distance between them divided by the width of its faces, so merging a tapering run moves every
+	// ring above it.  The shift is added up along the branchlet, scaled as Branchlets::getVScaler() scales it for 'sides' sides,
+	// and a run is only merged if the total stays within this.  The shift is worked out along the center of the tube, so it doesn't include the
+	// small changes in the distance between vertices where rings turn against each other, as they can with FrameMode::Ellipse
+	float maxVShift = .01f;
+
+	// The number of sides the branchlets will be built with, or 2 for strips.  Fewer sides make wider faces, and so v grows more
+	// slowly around them
+	int sides = 8;
+};
+
+// Merge runs of nearly straight segments of nearly equal radius, so that each run makes one row of faces instead of one per segment.
+// A merged segment goes from the start of its run to the end of it, so the point between every pair of kept segments, and the tip,
+// is unchanged.  It keeps the radius of the run's first segment, which keeps the ring at its base unchanged.  Runs whose rings
+// all have the same radius can be merged without moving v at all, which is what oversampled scans and simulations are made of
+std::vector<BSegment> decimateSegments(const std::vector<BSegment>& segs, const DecimateSettings& settings);
+
+// Decimate the segments of every branch in 'branches'
+std::vector<BBranch> decimateBranches(const std::vector<BBranch>& branches, const DecimateSettings& settings);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <type_traits>
+
+// Call 'body' with std::integral_constant<int, sides> when 'sides' is one of the side counts that generators are compiled for
+// (2, 3, 4, 6, 8, 12 and 16), so that it can be used as a compile time constant and every loop around a ring has a fixed length.
+// Any other count is passed as std::integral_constant<int, 0>, meaning it is only known at run time
+template <typename Body>
+void dispatchSides(int sides, Body&& body) {
+
+	switch (sides) {
+
+	case 2: body(std::integral_constant<int, 2>()); break;
+	case 3: body(std::integral_constant<int, 3>()); break;
+	case 4: body(std::integral_constant<int, 4>()); break;
+	case 6: body(std::integral_constant<int, 6>()); break;
+	case 8: body(std::integral_constant<int, 8>()); break;
+	case 12: body(std::integral_constant<int, 12>()); break;
+	case 16: body(std::integral_constant<int, 16>()); break;
+	default: body(std::integral_constant<int, 0>()); break;
+	}
+}
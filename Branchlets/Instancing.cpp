@@ -0,0 +1,189 @@
+#include "Instancing.h"
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+// A segment whose direction is within this sine of the first segment's is taken to run along it, and doesn't set the turn about it
+static const double parallelSine = 1e-4;
+
+// Find the transform that takes a branchlet from its canonical pose to where it is
+static RigidTransform findPose(const BBranch& branch) {
+
+	RigidTransform pose;
+	pose.translation = branch.startPoint;
+
+	const std::vector<BSegment>& segs = branch.segments;
+	if (segs.empty() || segs[0].v.length() == 0.)
+		return pose;
+
+	const BVector up = segs[0].v.normal();
+
+	// Turn about the first segment so that the first segment to leave its line points towards +x
+	BVector side;
+	for (size_t i = 1; i < segs.size(); i++) {
+
+		const BVector across = segs[i].v - (up * (up * segs[i].v));
+		if (across.length() > segs[i].v.length() * parallelSine) {
+
+			side = across.normal();
+			break;
+		}
+	}
+
+	// A straight branchlet has no such segment, so it is turned the way findEllipseVectors() turns a first ring
+	if (side.length() == 0.) {
+
+		side = up ^ BVector::xAxis;
+		if (side.length() < .001)
+			side = up ^ BVector::yAxis;
+
+		side = side.normal();
+	}
+
+	pose.xAxis = side;
+	pose.yAxis = up;
+	pose.zAxis = side ^ up;
+
+	return pose;
+}
+
+// Move 'branch''s segments into the canonical pose of 'pose', by the inverse (transposed) rotation
+static void findCanonicalSegments(const BBranch& branch, const RigidTransform& pose, std::vector<BSegment>& canonical) {
+
+	canonical.clear();
+	for (const BSegment& seg : branch.segments)
+		canonical.push_back(BSegment(BVector(pose.xAxis * seg.v, pose.yAxis * seg.v, pose.zAxis * seg.v), seg.r));
+}
+
+// Round every canonical segment vector and radius to a multiple of 'tolerance'.  Branchlets with the same values are the same shape
+static void quantizeShape(const std::vector<BSegment>& canonical, double tolerance, std::vector<int64_t>& values) {
+
+	values.clear();
+	values.push_back(static_cast<int64_t>(canonical.size()));
+
+	for (const BSegment& seg : canonical) {
+
+		values.push_back(std::llround(seg.v.x / tolerance));
+		values.push_back(std::llround(seg.v.y / tolerance));
+		values.push_back(std::llround(seg.v.z / tolerance));
+		values.push_back(std::llround(seg.r / tolerance));
+	}
+}
+
+BranchletInstances::BranchletInstances(int sides, const std::vector<BBranch>& branches, float tolerance, unsigned threadCount, FrameMode frameMode) : sides(sides) {
+
+	prototypeMesh = BranchletCreator().createDefault(sides);
+	prototypeStarts.resize(1);
+
+	if (sides < 2)
+		return;
+
+	const double step = tolerance > 0.f ? tolerance : 1e-6;
+
+	// The quantized values of every prototype, one after another, and the prototypes that share each hash of them
+	std::vector<int64_t> shapeValues;
+	std::vector<size_t> shapeValueStarts;
+	std::unordered_map<uint64_t, int> firstWithHash;
+	std::vector<int> nextWithHash;
+
+	std::vector<BBranch> prototypeBranches;
+	std::vector<BSegment> canonical;
+	std::vector<int64_t> values;
+
+	instanceList.resize(branches.size());
+
+	for (size_t i = 0; i < branches.size(); i++) {
+
+		BranchInstance& instance = instanceList[i];
+		instance.transform = findPose(branches[i]);
+
+		findCanonicalSegments(branches[i], instance.transform, canonical);
+		quantizeShape(canonical, step, values);
+
+		MeshCacheKey key;
+		for (int64_t value : values)
+			key.add(static_cast<uint64_t>(value));
+
+		const uint64_t hash = key.value();
+		const auto found = firstWithHash.find(hash);
+
+		int prototype = found != firstWithHash.end() ? found->second : -1;
+		int lastWithHash = -1;
+		while (prototype >= 0) {
+
+			const size_t first = shapeValueStarts[prototype];
+			if (shapeValueStarts[prototype + 1] - first == values.size() && std::equal(values.begin(), values.end(), shapeValues.begin() + first))
+				break;
+
+			lastWithHash = prototype;
+			prototype = nextWithHash[prototype];
+		}
+
+		if (prototype < 0) {
+
+			// A new shape, which is generated in its canonical pose
+			prototype = static_cast<int>(prototypeBranches.size());
+			prototypeBranches.push_back(BBranch(BVector(), canonical, branches[i].vOffset));
+
+			if (shapeValueStarts.empty())
+				shapeValueStarts.push_back(0);
+
+			shapeValues.insert(shapeValues.end(), values.begin(), values.end());
+			shapeValueStarts.push_back(shapeValues.size());
+			nextWithHash.push_back(-1);
+
+			if (lastWithHash >= 0)
+				nextWithHash[lastWithHash] = prototype;
+			else
+				firstWithHash[hash] = prototype;
+		}
+
+		instance.prototype = prototype;
+		instance.vShift = branches[i].vOffset - prototypeBranches[prototype].vOffset;
+	}
+
+	// The prototypes are small, so they always keep normals in case the mesh they are copied into does
+	prototypeMesh->setFrameMode(frameMode);
+	prototypeMesh->setNormals(true);
+	prototypeMesh->addMany(prototypeBranches, threadCount);
+
+	prototypeStarts.resize(prototypeBranches.size() + 1);
+	for (size_t i = 0; i < prototypeBranches.size(); i++) {
+
+		const int segmentCount = static_cast<int>(prototypeBranches[i].segments.size());
+		prototypeStarts[i + 1] = prototypeStarts[i];
+		prototypeStarts[i + 1] += sides == 2 ? BranchletStrips::countOne(segmentCount) : Branchlets::countOne(segmentCount, sides);
+	}
+}
+
+MeshCounts BranchletInstances::prototypeCounts(int index) const {
+
+	const MeshCounts& first = prototypeStarts[index];
+	const MeshCounts& end = prototypeStarts[index + 1];
+
+	MeshCounts counts;
+	counts.verts = end.verts - first.verts;
+	counts.faces = end.faces - first.faces;
+	counts.faceConnects = end.faceConnects - first.faceConnects;
+	counts.uvs = end.uvs - first.uvs;
+	counts.uvConnects = end.uvConnects - first.uvConnects;
+
+	return counts;
+}
+
+MeshCounts BranchletInstances::expandedCounts() const {
+
+	MeshCounts counts;
+	for (const BranchInstance& instance : instanceList)
+		counts += prototypeCounts(instance.prototype);
+
+	return counts;
+}
+
+size_t BranchletInstances::memoryBytes() const {
+
+	return prototypeMesh->buffer().capacityBytes() + (prototypeStarts.capacity() * sizeof(MeshCounts)) + (instanceList.capacity() * sizeof(BranchInstance));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Branchlets.h"
+
+// A rotation followed by a translation, kept as the rotated x, y and z axes (the columns of the rotation matrix), which is the
+// form Maya's instancers and most exporters take.  The axes are unit length and right handed, so faces keep their winding
+struct RigidTransform {
+
+	BVector xAxis = BVector::xAxis;
+	BVector yAxis = BVector::yAxis;
+	BVector zAxis = BVector::zAxis;
+	BVector translation;
+
+	// Rotate 'v' without translating it
+	BVector rotate(const BVector& v) const { return (xAxis * v.x) + (yAxis * v.y) + (zAxis * v.z); }
+
+	BVector apply(const BVector& point) const { return rotate(point) + translation; }
+};
+
+// One branchlet placed as a copy of a prototype
+struct BranchInstance {
+
+	// The index of the prototype, which is also its branchlet index in BranchletInstances::prototypes()
+	int prototype = 0;
+
+	// Takes the prototype from where it was built, at the origin with its first segment along +y, to where the branchlet is
+	RigidTransform transform;
+
+	// Added to every v coordinate of the prototype, for branchlets whose vOffset differs from the prototype's
+	float vShift = 0.f;
+};
+
+// The branchlets of a tree grouped by shape, for trees where many twigs are the same list of segments placed and turned
+// differently.  Each branchlet is moved to its canonical pose, with its start point at the origin, its first segment along +y
+// and its first segment that doesn't run parallel to that one turned towards +x.  Branchlets whose canonical segment vectors and
+// radii round to the same multiples of 'tolerance' are the same shape.  Each shape is generated once, as a prototype, and every
+// branchlet becomes an instance of one, which can either be handed on as it is or copied into a mesh by Branchlets::addInstances().
+//
+// Differences of up to 'tolerance' in each segment add up along a branchlet, so an instance's tip can be up to about the segment
+// count times 'tolerance' from where the branchlet's own segments would put it.  The rings of an instance turn with it, so the first
+// vertex of each ring may not be where generating the branchlet in place would put it, though the surface is the same, and since v
+// coordinates follow the distances between vertices they can differ by a little too
+class BranchletInstances {
+
+	int sides = 0;
+
+	// One branchlet per prototype, in the order the shapes were first seen
+	std::unique_ptr<Branchlets> prototypeMesh;
+
+	// Where each prototype starts in each array of prototypeMesh, with its end after the last
+	std::vector<MeshCounts> prototypeStarts;
+
+	std::vector<BranchInstance> instanceList;
+
+public:
+
+	BranchletInstances() : prototypeMesh(std::make_unique<Branchlets>()), prototypeStarts(1) {}
+
+	// Group 'branches' by shape and generate a prototype of each with 'sides' sides (2 for strips) on 'threadCount' threads.
+	// Shows a warning and is left empty for less than 2 sides
+	BranchletInstances(int sides, const std::vector<BBranch>& branches, float tolerance = .001f, unsigned threadCount = 1, FrameMode frameMode = FrameMode::Ellipse);
+
+	bool empty() const { return instanceList.empty(); }
+
+	int sideCount() const { return sides; }
+
+	int prototypeCount() const { return static_cast<int>(prototypeStarts.size()) - 1; }
+
+	// Every prototype, each as a branchlet of its own in its canonical pose
+	const Branchlets& prototypes() const { return *prototypeMesh; }
+
+	// Where prototype 'index' starts in each array of prototypes().buffer().  The next prototype starts where it ends
+	const MeshCounts& prototypeStart(int index) const { return prototypeStarts[index]; }
+
+	// The number of elements prototype 'index', and so each of its instances, adds to each array
+	MeshCounts prototypeCounts(int index) const;
+
+	// One instance per branchlet, in the order the branchlets were given
+	const std::vector<BranchInstance>& instances() const { return instanceList; }
+
+	// The length of each array once every instance is copied into a mesh
+	MeshCounts expandedCounts() const;
+
+	// The number of bytes allocated for the arrays of the prototypes and for the instances
+	size_t memoryBytes() const;
+};
@@ -1,25 +1,195 @@
-
 #include "MMesh.h"
+#include "MeshExporter.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <iostream>
+
+MeshCounts MMesh::counts() const {
+
+	return mesh.counts();
+}
+
+void MMesh::setCounts(const MeshCounts& counts) {
+
+#ifdef BRANCHLETS_STATS
+	const MeshCounts oldCounts = mesh.counts();
+	const size_t oldBytes = mesh.capacityBytes();
+#endif
+
+	mesh.resize(counts);
+
+#ifdef BRANCHLETS_STATS
+	BRANCHLETS_COUNT(StatCounter::Vertices, counts.verts - oldCounts.verts);
+	BRANCHLETS_COUNT(StatCounter::UVs, counts.uvs - oldCounts.uvs);
+	BRANCHLETS_COUNT(StatCounter::Faces, counts.faces - oldCounts.faces);
+
+	const size_t newBytes = mesh.capacityBytes();
+	if (newBytes > oldBytes) {
+
+		BRANCHLETS_COUNT(StatCounter::ArrayGrowths, 1);
+		BRANCHLETS_COUNT(StatCounter::ArrayBytes, static_cast<long long>(newBytes - oldBytes));
+	}
+#endif
+}
+
+void MMesh::reset() {
+
+	mesh.clear();
+	clearDirty();
+}
+
+bool MMesh::flushToExporter() {
+
+	if (exporter == nullptr)
+		return false;
+
+	BRANCHLETS_TIME(StatPhase::ExportWrite);
+
+	exporter->write(mesh);
+	mesh.clear();
+	clearDirty();
+
+	return true;
+}
+
+static void addRange(std::vector<IndexRange>& ranges, const IndexRange& range) {
+
+	if (range.begin >= range.end)
+		return;
+
+	if (!ranges.empty() && range.begin <= ranges.back().end && range.end >= ranges.back().begin) {
+
+		ranges.back().begin = std::min(ranges.back().begin, range.begin);
+		ranges.back().end = std::max(ranges.back().end, range.end);
+	}
+	else {
+
+		ranges.push_back(range);
+	}
+}
+
+void MMesh::markDirty(const IndexRange& verts, const IndexRange& uvs) {
+
+	addRange(dirtyVerts, verts);
+	addRange(dirtyUVs, uvs);
+}
+
+void MMesh::clearDirty() {
+
+	dirtyVerts.clear();
+	dirtyUVs.clear();
+}
+
+void MMesh::displayWarning(const std::string& message) {
+
+#ifndef BRANCHLETS_HEADLESS
+	MGlobal::displayWarning(MString() + message.c_str());
+#else
+	std::cerr << "Warning: " << message << std::endl;
+#endif
+}
+
+#ifndef BRANCHLETS_HEADLESS
 
 MStatus MMesh::createMesh(std::string name) const {
 
+	BRANCHLETS_TIME(StatPhase::CreateMesh);
+
 	MStatus status = MS::kSuccess;
 
-	if (verts.length() > 2) {
+	const unsigned vertCount = static_cast<unsigned>(mesh.xs.size());
+
+	if (vertCount > 2) {
+
+		// This is the only place the mesh is converted to Maya's types
+		MFloatPointArray verts(vertCount);
+		for (unsigned i = 0; i < vertCount; i++)
+			verts.set(i, mesh.xs[i], mesh.ys[i], mesh.zs[i]);
+
+		MIntArray faceCounts(mesh.faceCounts.data(), static_cast<unsigned>(mesh.faceCounts.size()));
+		MIntArray faceConnects(mesh.faceConnects.data(), static_cast<unsigned>(mesh.faceConnects.size()));
+		MFloatArray us(mesh.us.data(), static_cast<unsigned>(mesh.us.size()));
+		MFloatArray vs(mesh.vs.data(), static_cast<unsigned>(mesh.vs.size()));
+		MIntArray uvConnects(mesh.uvConnects.data(), static_cast<unsigned>(mesh.uvConnects.size()));
 
 		MFnMesh newMesh;
-		MObject transform = newMesh.create(verts.length(), faceCounts.length(), verts, faceCounts, faceConnects, us, vs);
+		MObject transform = newMesh.create(vertCount, faceCounts.length(), verts, faceCounts, faceConnects, us, vs);
 		newMesh.assignUVs(faceCounts, uvConnects);
 
+		if (mesh.hasNormals()) {
+
+			MVectorArray normals(vertCount);
+			MIntArray normalVerts(vertCount);
+			for (unsigned i = 0; i < vertCount; i++) {
+
+				normals.set(MVector(mesh.nxs[i], mesh.nys[i], mesh.nzs[i]), i);
+				normalVerts.set(static_cast<int>(i), i);
+			}
+
+			newMesh.setVertexNormals(normals, normalVerts);
+		}
+
 		MFnDependencyNode nodeFn;
 		nodeFn.setObject(transform);
 		nodeFn.setName(name.c_str());
 	}
 	else {
 
-		MGlobal::displayInfo(MString() + "No mesh created for " + name.c_str() + " because it has " + verts.length() + " vertices");
+		MGlobal::displayInfo(MString() + "No mesh created for " + name.c_str() + " because it has " + vertCount + " vertices");
+	}
+
+
+	return status;
+}
+
+MStatus MMesh::updateMesh(std::string name) {
+
+	BRANCHLETS_TIME(StatPhase::UpdateMesh);
+
+	MSelectionList selection;
+	MDagPath path;
+
+	MStatus status = selection.add(name.c_str());
+	if (status)
+		status = selection.getDagPath(0, path);
+	if (status)
+		status = path.extendToShape();
+
+	if (!status) {
+
+		MGlobal::displayWarning(MString() + "Cannot update " + name.c_str() + " because it is not a mesh");
+		return status;
 	}
 
+	MFnMesh fnMesh(path, &status);
+	if (!status)
+		return status;
+
+	for (const IndexRange& range : dirtyVerts)
+		for (int i = range.begin; i < range.end; i++)
+			fnMesh.setPoint(i, MPoint(mesh.xs[i], mesh.ys[i], mesh.zs[i]));
+
+	if (mesh.hasNormals()) {
+
+		for (const IndexRange& range : dirtyVerts) {
+
+			for (int i = range.begin; i < range.end; i++) {
+
+				MVector normal(mesh.nxs[i], mesh.nys[i], mesh.nzs[i]);
+				fnMesh.setVertexNormal(normal, i);
+			}
+		}
+	}
+
+	for (const IndexRange& range : dirtyUVs)
+		for (int i = range.begin; i < range.end; i++)
+			fnMesh.setUV(i, mesh.us[i], mesh.vs[i]);
+
+	fnMesh.updateSurface();
+	clearDirty();
 
 	return status;
-}
\ No newline at end of file
+}
+
+#endif
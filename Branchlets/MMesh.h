@@ -1,26 +1,85 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
+#ifndef BRANCHLETS_HEADLESS
 #include <maya/MFnMesh.h>
 #include <maya/MFloatPointArray.h>
 #include <maya/MFloatArray.h>
 #include <maya/MIntArray.h>
 #include <maya/MGlobal.h>
+#include <maya/MSelectionList.h>
+#include <maya/MDagPath.h>
+#include <maya/MPoint.h>
+#include <maya/MVector.h>
+#include <maya/MVectorArray.h>
+#endif
+
+#include "MeshBuffer.h"
+
+class MeshExporter;
 
 // Base class for computing and storing data needed to create meshes using Maya's MFnMesh::create()
+// The data is kept in a MeshBuffer, and is only converted to Maya's array types when the mesh is created
 class MMesh {
 
 protected:
 
-	MFloatPointArray verts;
-	MIntArray faceConnects;
-	MIntArray faceCounts;
-	MFloatArray us, vs;
-	MIntArray uvConnects;
+	MeshBuffer mesh;
+
+	// Where finished geometry is streamed to, if anywhere
+	MeshExporter* exporter = nullptr;
+
+	// If there is an exporter, hand it everything computed so far and empty the arrays, keeping their capacity.  Returns whether
+	// the arrays were emptied, in which case nothing that indexes into them is valid any more
+	bool flushToExporter();
+
+	// The ranges of vertices and uvs that have changed since the last call to clearDirty() or updateMesh()
+	std::vector<IndexRange> dirtyVerts;
+	std::vector<IndexRange> dirtyUVs;
+
+	// Note that the vertices and uvs in the given ranges have changed.  A range that overlaps or touches the last one is merged with it
+	void markDirty(const IndexRange& verts, const IndexRange& uvs);
 
 public:
 
 	MMesh() {}
 
-	// Pass all member variables as arguments to MFnMesh::create()
+	// Get the current length of each array
+	MeshCounts counts() const;
+
+	// Set the length of each array.  Existing elements are kept and any new ones are left to be filled in by index
+	void setCounts(const MeshCounts& counts);
+
+	// Empty every array, keeping their memory for whatever is added next
+	void reset();
+
+	// The mesh data as computed so far
+	const MeshBuffer& buffer() const { return mesh; }
+
+	// Stream geometry to 'meshExporter' as it is added instead of keeping it, so that only the most recent branch or batch
+	// of branches is held in memory.  Anything already added is streamed along with the next branch or batch, and can't be updated
+	// after that.  Pass nullptr to go back to keeping everything for createMesh()
+	void setExporter(MeshExporter* meshExporter) { exporter = meshExporter; }
+
+	// The ranges of vertices and uvs that have changed since the last call to clearDirty() or updateMesh()
+	const std::vector<IndexRange>& dirtyVertRanges() const { return dirtyVerts; }
+	const std::vector<IndexRange>& dirtyUVRanges() const { return dirtyUVs; }
+
+	// Forget which vertices and uvs have changed, once the changes have been applied to a mesh by some other means
+	void clearDirty();
+
+	// Show a warning in Maya's script editor, or on stderr in headless builds
+	static void displayWarning(const std::string& message);
+
+#ifndef BRANCHLETS_HEADLESS
+	// Pass all member variables as arguments to MFnMesh::create().  If the buffer has normals they are set as the mesh's vertex
+	// normals, which Maya then keeps locked.  Maya has no way to be given tangents, and works its own out from the uvs
 	MStatus createMesh(std::string name) const;
+
+	// Push only the vertices, uvs and normals that have changed to the mesh named 'name', which must have been made by createMesh()
+	// from this object.  Its connectivity is left alone, so vertex and uv ids still match indices into the arrays.  Clears the changed ranges
+	MStatus updateMesh(std::string name);
+#endif
 };
@@ -0,0 +1,100 @@
+#include "MappedFile.h"
+#include "MMesh.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+
+	close();
+}
+
+bool MappedFile::open(const std::string& filePath, bool sequential, bool warn) {
+
+	close();
+
+	auto fail = [&](const std::string& message) {
+
+		if (warn)
+			MMesh::displayWarning(message);
+
+		close();
+		return false;
+	};
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail("Could not open " + filePath + " for reading");
+
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		return fail(filePath + " is empty");
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle != nullptr)
+		mapped = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+	mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+	fileDescriptor = ::open(filePath.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		return fail("Could not open " + filePath + " for reading");
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0)
+		return fail(filePath + " is empty");
+
+	mappedSize = static_cast<size_t>(fileStatus.st_size);
+
+	void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping != MAP_FAILED) {
+
+		mapped = static_cast<const char*>(mapping);
+
+		if (sequential)
+			madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (mapped == nullptr)
+		return fail("Could not map " + filePath + " into memory");
+
+	return true;
+}
+
+void MappedFile::close() {
+
+#ifdef _WIN32
+	if (mapped != nullptr)
+		UnmapViewOfFile(mapped);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != nullptr)
+		CloseHandle(fileHandle);
+
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (mapped != nullptr)
+		munmap(const_cast<char*>(mapped), mappedSize);
+	if (fileDescriptor >= 0)
+		::close(fileDescriptor);
+
+	fileDescriptor = -1;
+#endif
+
+	mapped = nullptr;
+	mappedSize = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped into memory for reading, through mmap() on POSIX systems and a file mapping on Windows.  Pages are only
+// read from disk as they are touched, so opening even a very large file costs next to nothing
+class MappedFile {
+
+	const char* mapped = nullptr;
+	size_t mappedSize = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDescriptor = -1;
+#endif
+
+public:
+
+	MappedFile() {}
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	// Map 'filePath', closing whatever was mapped before.  With 'sequential' set, the system is asked to read ahead, for files that
+	// are read from front to back.  Returns false and shows a warning if it can't be opened, is empty or can't be mapped, unless
+	// 'warn' is cleared, for files that may well have gone
+	bool open(const std::string& filePath, bool sequential = false, bool warn = true);
+
+	void close();
+
+	bool isOpen() const { return mapped != nullptr; }
+
+	const char* data() const { return mapped; }
+
+	size_t size() const { return mappedSize; }
+};
@@ -0,0 +1,156 @@
+#include "MeshBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+MeshCounts& MeshCounts::operator+=(const MeshCounts& other) {
+
+	verts += other.verts;
+	faces += other.faces;
+	faceConnects += other.faceConnects;
+	uvs += other.uvs;
+	uvConnects += other.uvConnects;
+
+	return *this;
+}
+
+MeshCounts MeshBuffer::counts() const {
+
+	MeshCounts counts;
+	counts.verts = static_cast<int>(xs.size());
+	counts.faces = static_cast<int>(faceCounts.size());
+	counts.faceConnects = static_cast<int>(faceConnects.size());
+	counts.uvs = static_cast<int>(us.size());
+	counts.uvConnects = static_cast<int>(uvConnects.size());
+
+	return counts;
+}
+
+void MeshBuffer::resize(const MeshCounts& counts) {
+
+	xs.resize(counts.verts);
+	ys.resize(counts.verts);
+	zs.resize(counts.verts);
+	faceCounts.resize(counts.faces);
+	faceConnects.resize(counts.faceConnects);
+	us.resize(counts.uvs);
+	vs.resize(counts.uvs);
+	uvConnects.resize(counts.uvConnects);
+
+	if (withNormals) {
+
+		nxs.resize(counts.verts);
+		nys.resize(counts.verts);
+		nzs.resize(counts.verts);
+		txs.resize(counts.verts);
+		tys.resize(counts.verts);
+		tzs.resize(counts.verts);
+	}
+}
+
+void MeshBuffer::reserve(const MeshCounts& counts) {
+
+	xs.reserve(counts.verts);
+	ys.reserve(counts.verts);
+	zs.reserve(counts.verts);
+	faceCounts.reserve(counts.faces);
+	faceConnects.reserve(counts.faceConnects);
+	us.reserve(counts.uvs);
+	vs.reserve(counts.uvs);
+	uvConnects.reserve(counts.uvConnects);
+
+	if (withNormals) {
+
+		nxs.reserve(counts.verts);
+		nys.reserve(counts.verts);
+		nzs.reserve(counts.verts);
+		txs.reserve(counts.verts);
+		tys.reserve(counts.verts);
+		tzs.reserve(counts.verts);
+	}
+}
+
+void MeshBuffer::clear() {
+
+	xs.clear();
+	ys.clear();
+	zs.clear();
+	faceCounts.clear();
+	faceConnects.clear();
+	us.clear();
+	vs.clear();
+	uvConnects.clear();
+	nxs.clear();
+	nys.clear();
+	nzs.clear();
+	txs.clear();
+	tys.clear();
+	tzs.clear();
+}
+
+size_t MeshBuffer::capacityBytes() const {
+
+	return ((xs.capacity() + ys.capacity() + zs.capacity() + us.capacity() + vs.capacity()) * sizeof(float))
+		+ ((nxs.capacity() + nys.capacity() + nzs.capacity() + txs.capacity() + tys.capacity() + tzs.capacity()) * sizeof(float))
+		+ ((faceCounts.capacity() + faceConnects.capacity() + uvConnects.capacity()) * sizeof(int));
+}
+
+void MeshBuffer::setVert(int index, double x, double y, double z) {
+
+	xs[index] = static_cast<float>(x);
+	ys[index] = static_cast<float>(y);
+	zs[index] = static_cast<float>(z);
+}
+
+void MeshBuffer::setNormal(int index, double x, double y, double z) {
+
+	nxs[index] = static_cast<float>(x);
+	nys[index] = static_cast<float>(y);
+	nzs[index] = static_cast<float>(z);
+}
+
+void MeshBuffer::setTangent(int index, double x, double y, double z) {
+
+	txs[index] = static_cast<float>(x);
+	tys[index] = static_cast<float>(y);
+	tzs[index] = static_cast<float>(z);
+}
+
+float MeshBuffer::distanceBetween(int vertA, int vertB) const {
+
+	float dx = xs[vertA] - xs[vertB];
+	float dy = ys[vertA] - ys[vertB];
+	float dz = zs[vertA] - zs[vertB];
+
+	return std::sqrt((dx * dx) + (dy * dy) + (dz * dz));
+}
+
+MeshBounds MeshBuffer::bounds() const {
+
+	MeshBounds box;
+	for (size_t i = 0; i < xs.size(); i++)
+		box.add(xs[i], ys[i], zs[i]);
+
+	return box;
+}
+
+MeshBounds::MeshBounds() {
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		min[axis] = std::numeric_limits<float>::max();
+		max[axis] = std::numeric_limits<float>::lowest();
+	}
+}
+
+void MeshBounds::add(float x, float y, float z) {
+
+	const float point[3] = { x, y, z };
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		min[axis] = std::min(min[axis], point[axis]);
+		max[axis] = std::max(max[axis], point[axis]);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// The number of elements in each of a mesh's arrays.  This is used both for the size of a whole mesh and for the amount
+// that a single piece of geometry adds to it, so that every array can be sized once before it is filled by index
+struct MeshCounts {
+
+	int verts = 0;
+	int faces = 0;
+	int faceConnects = 0;
+	int uvs = 0;
+	int uvConnects = 0;
+
+	MeshCounts& operator+=(const MeshCounts& other);
+};
+
+// A half open range of indices into one of a mesh's arrays
+struct IndexRange {
+
+	int begin = 0;
+	int end = 0;
+};
+
+// An axis aligned box around a mesh's vertices.  It starts out empty, with each min above each max
+struct MeshBounds {
+
+	float min[3];
+	float max[3];
+
+	MeshBounds();
+
+	bool isEmpty() const { return min[0] > max[0]; }
+
+	// Grow the box to hold the point (x, y, z)
+	void add(float x, float y, float z);
+};
+
+// The arguments to MFnMesh::create() and MFnMesh::assignUVs(), kept in plain arrays with each coordinate in its own array
+// (structure of arrays) so that it can be reserved, filled by index and vectorized, and so it needs no Maya types at all
+struct MeshBuffer {
+
+	// Vertex positions
+	std::vector<float> xs, ys, zs;
+
+	// The number of vertices in each face
+	std::vector<int> faceCounts;
+
+	// The vertex indices of each face's corners, in order, for all faces
+	std::vector<int> faceConnects;
+
+	// UV coordinates
+	std::vector<float> us, vs;
+
+	// The uv indices of each face's corners, matching faceConnects
+	std::vector<int> uvConnects;
+
+	// A unit normal and tangent for each vertex, only kept when 'withNormals' is set.  Each tangent points the way u increases, and
+	// normal ^ tangent points the way v increases, so the bitangent sign that glTF and most engines want is +1 for every vertex
+	std::vector<float> nxs, nys, nzs;
+	std::vector<float> txs, tys, tzs;
+
+	// Whether resize() and reserve() size the normals and tangents along with the vertices
+	bool withNormals = false;
+
+	// Get the current length of each array
+	MeshCounts counts() const;
+
+	// Set the length of each array.  Existing elements are kept and any new ones are left to be filled in by index
+	void resize(const MeshCounts& counts);
+
+	// Make room for the given length of each array without changing their current lengths
+	void reserve(const MeshCounts& counts);
+
+	// Empty every array
+	void clear();
+
+	// The number of bytes allocated for every array, used or not
+	size_t capacityBytes() const;
+
+	// Set the position of a vertex, rounding it to single precision
+	void setVert(int index, double x, double y, double z);
+
+	// Set the normal and tangent of a vertex, rounding them to single precision
+	void setNormal(int index, double x, double y, double z);
+	void setTangent(int index, double x, double y, double z);
+
+	bool hasNormals() const { return withNormals && nxs.size() == xs.size(); }
+
+	// The distance between two vertices, computed in single precision
+	float distanceBetween(int vertA, int vertB) const;
+
+	// Find the box around every vertex
+	MeshBounds bounds() const;
+};
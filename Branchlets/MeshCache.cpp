@@ -0,0 +1,609 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "MMesh.h"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const uint64_t murmurMultiplier = 0xc6a4a7935bd1e995ULL;
+static const int murmurShift = 47;
+
+// The extension of every file
+static const char* entryExtension = ".bmc";
+
+// Files are written under their name with this added, then renamed.  One left behind this long ago was abandoned by a writer that
+// never finished, so it is removed when the directory is next opened
+static const char* tempExtension = ".tmp";
+static const std::chrono::hours staleTempAge(1);
+
+// Part of every temporary name, so that processes sharing a directory never write to the same file
+static long long processId() {
+
+#ifdef _WIN32
+	return _getpid();
+#else
+	return getpid();
+#endif
+}
+
+// Connects are written this many at a time, offset into a buffer of their own
+static const size_t connectBlock = 4096;
+
+MeshCacheKey::MeshCacheKey() {
+
+	hash = static_cast<uint64_t>(MeshCacheHeader().version) * murmurMultiplier;
+}
+
+void MeshCacheKey::add(uint64_t word) {
+
+	word *= murmurMultiplier;
+	word ^= word >> murmurShift;
+	word *= murmurMultiplier;
+
+	hash ^= word;
+	hash *= murmurMultiplier;
+	wordCount++;
+}
+
+void MeshCacheKey::add(float value) {
+
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	add(static_cast<uint64_t>(bits));
+}
+
+void MeshCacheKey::add(double value) {
+
+	uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	add(bits);
+}
+
+uint64_t MeshCacheKey::value() const {
+
+	uint64_t finished = hash ^ (wordCount * murmurMultiplier);
+	finished ^= finished >> murmurShift;
+	finished *= murmurMultiplier;
+	finished ^= finished >> murmurShift;
+
+	return finished;
+}
+
+// The number of 4 byte values in an entry with the given counts
+static size_t entryValues(const MeshCacheEntry& entry) {
+
+	return (static_cast<size_t>(entry.verts) * 3) + entry.faces + entry.faceConnects + (static_cast<size_t>(entry.uvs) * 2) + entry.uvConnects;
+}
+
+// Whether 'entry' holds exactly the elements from 'at' up to 'end'
+static bool entryFits(const MeshCacheEntry& entry, const MeshCounts& at, const MeshCounts& end) {
+
+	return entry.verts == end.verts - at.verts && entry.faces == end.faces - at.faces && entry.faceConnects == end.faceConnects - at.faceConnects &&
+		entry.uvs == end.uvs - at.uvs && entry.uvConnects == end.uvConnects - at.uvConnects;
+}
+
+template <class T>
+static void writeRaw(std::ostream& out, const T* data, size_t count) {
+
+	out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+// Write 'count' connects from 'connects', less 'offset'
+static void writeConnects(std::ostream& out, const int* connects, size_t count, int offset) {
+
+	int32_t block[connectBlock];
+
+	for (size_t first = 0; first < count; first += connectBlock) {
+
+		const size_t blockCount = std::min(connectBlock, count - first);
+		for (size_t i = 0; i < blockCount; i++)
+			block[i] = connects[first + i] - offset;
+
+		writeRaw(out, block, blockCount);
+	}
+}
+
+// Copy 'count' connects from 'source' to 'connects', plus 'offset'
+static void readConnects(int* connects, const char* source, size_t count, int offset) {
+
+	std::memcpy(connects, source, count * sizeof(int32_t));
+
+	for (size_t i = 0; i < count; i++)
+		connects[i] += offset;
+}
+
+// Read the header and entry table of a file of 'fileBytes' bytes, checking that they are from this version and that every entry
+// lies within the file
+static bool readTable(const char* data, size_t fileBytes, std::vector<MeshCacheEntry>& table) {
+
+	MeshCacheHeader header;
+	const MeshCacheHeader expected;
+
+	if (fileBytes < sizeof(header))
+		return false;
+
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version ||
+		(fileBytes - sizeof(header)) / sizeof(MeshCacheEntry) < header.entryCount)
+		return false;
+
+	table.resize(header.entryCount);
+	std::memcpy(table.data(), data + sizeof(header), header.entryCount * sizeof(MeshCacheEntry));
+
+	for (const MeshCacheEntry& entry : table)
+		if (entry.offset > fileBytes || (fileBytes - entry.offset) / 4 < entryValues(entry))
+			return false;
+
+	return true;
+}
+
+MeshCache::MeshCache(const std::string& cacheDirectory, size_t maxBytes) : directory(cacheDirectory), maxBytes(maxBytes) {
+
+	std::error_code error;
+	fs::create_directories(directory, error);
+
+	if (!fs::is_directory(directory, error)) {
+
+		warn("Could not use " + directory + " as a mesh cache");
+		return;
+	}
+
+	usable = true;
+
+	// Take on the files already there, the most recently used first
+	struct Found {
+
+		fs::file_time_type time;
+		uint64_t key;
+		size_t bytes;
+		std::vector<MeshCacheEntry> table;
+	};
+
+	std::vector<Found> found;
+
+	for (const fs::directory_entry& file : fs::directory_iterator(directory, error)) {
+
+		const fs::path& path = file.path();
+		if (!file.is_regular_file(error))
+			continue;
+
+		if (path.stem().extension() == entryExtension && path.extension().string().rfind(tempExtension, 0) == 0) {
+
+			const fs::file_time_type time = file.last_write_time(error);
+			if (!error && fs::file_time_type::clock::now() - time > staleTempAge)
+				fs::remove(path, error);
+
+			continue;
+		}
+
+		if (path.extension() != entryExtension)
+			continue;
+
+		const std::string name = path.stem().string();
+		char* end = nullptr;
+		const uint64_t key = std::strtoull(name.c_str(), &end, 16);
+
+		if (name.size() != 16 || end != name.c_str() + name.size())
+			continue;
+
+		// Only the header and table are read.  A file that doesn't match is most likely damaged or from another version, so it
+		// is removed
+		Found entry = { file.last_write_time(error), key, static_cast<size_t>(file.file_size(error)), {} };
+
+		std::vector<char> start(sizeof(MeshCacheHeader));
+		std::ifstream in(path, std::ios::binary);
+		in.read(start.data(), start.size());
+
+		MeshCacheHeader header;
+		std::memcpy(&header, start.data(), sizeof(header));
+
+		if (in && header.entryCount <= entry.bytes / sizeof(MeshCacheEntry)) {
+
+			start.resize(sizeof(header) + (header.entryCount * sizeof(MeshCacheEntry)));
+			in.read(start.data() + sizeof(header), header.entryCount * sizeof(MeshCacheEntry));
+		}
+
+		const bool valid = in && readTable(start.data(), entry.bytes, entry.table);
+		in.close();
+
+		if (!valid) {
+
+			fs::remove(path, error);
+			continue;
+		}
+
+		found.push_back(std::move(entry));
+	}
+
+	std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.time < b.time; });
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (const Found& file : found)
+		insert(file.key, file.bytes, file.table);
+
+	evict();
+}
+
+std::string MeshCache::pathFor(uint64_t fileKey) const {
+
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fileKey));
+
+	return (fs::path(directory) / (std::string(name) + entryExtension)).string();
+}
+
+void MeshCache::insert(uint64_t fileKey, size_t bytes, const std::vector<MeshCacheEntry>& table) {
+
+	forget(fileKey);
+
+	uses.push_front(fileKey);
+
+	File& file = files[fileKey];
+	file.bytes = bytes;
+	file.use = uses.begin();
+	file.keys.reserve(table.size());
+	totalBytes += bytes;
+
+	for (const MeshCacheEntry& place : table) {
+
+		Entry& entry = entries[place.key];
+		entry.file = fileKey;
+		entry.place = place;
+		file.keys.push_back(place.key);
+	}
+}
+
+void MeshCache::forget(uint64_t fileKey) {
+
+	auto existing = files.find(fileKey);
+	if (existing == files.end())
+		return;
+
+	// Entries stored again in a later file are kept
+	for (uint64_t key : existing->second.keys) {
+
+		auto entry = entries.find(key);
+		if (entry != entries.end() && entry->second.file == fileKey)
+			entries.erase(entry);
+	}
+
+	totalBytes -= existing->second.bytes;
+	uses.erase(existing->second.use);
+	files.erase(existing);
+}
+
+void MeshCache::remove(uint64_t fileKey) {
+
+	if (files.find(fileKey) == files.end())
+		return;
+
+	forget(fileKey);
+
+	std::error_code error;
+	fs::remove(pathFor(fileKey), error);
+}
+
+void MeshCache::evict() {
+
+	while (totalBytes > maxBytes && !uses.empty()) {
+
+		remove(uses.back());
+		counters.evictions++;
+	}
+}
+
+bool MeshCache::load(uint64_t key, MeshBuffer& mesh, const MeshCounts& at, const MeshCounts& end) {
+
+	MeshCacheRange range;
+	range.key = key;
+	range.at = at;
+	range.end = end;
+
+	std::vector<char> found;
+	return load(std::vector<MeshCacheRange>(1, range), mesh, found) == 1;
+}
+
+int MeshCache::load(const std::vector<MeshCacheRange>& ranges, MeshBuffer& mesh, std::vector<char>& found) {
+
+	found.assign(ranges.size(), 0);
+
+	// Where each wanted entry is, sorted by file and then by place in the file, so that each file is mapped once and read front
+	// to back
+	struct Wanted {
+
+		uint64_t file;
+		MeshCacheEntry place;
+		int range;
+	};
+
+	std::vector<Wanted> wanted;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (int i = 0; i < static_cast<int>(ranges.size()); i++) {
+
+			auto existing = entries.find(ranges[i].key);
+
+			if (existing == entries.end() || !entryFits(existing->second.place, ranges[i].at, ranges[i].end))
+				counters.misses++;
+			else
+				wanted.push_back({ existing->second.file, existing->second.place, i });
+		}
+	}
+
+	std::sort(wanted.begin(), wanted.end(), [](const Wanted& a, const Wanted& b) {
+
+		return a.file != b.file ? a.file < b.file : a.place.offset < b.place.offset;
+	});
+
+	int filled = 0;
+	MappedFile file;
+	std::vector<MeshCacheEntry> table;
+
+	for (size_t first = 0; first < wanted.size(); ) {
+
+		const uint64_t fileKey = wanted[first].file;
+
+		size_t last = first;
+		while (last < wanted.size() && wanted[last].file == fileKey)
+			last++;
+
+		const std::string path = pathFor(fileKey);
+
+		// A file that has gone was most likely evicted by another thread since it was looked up, and one that doesn't match is
+		// most likely damaged, so either way it is forgotten
+		if (!file.open(path, true, false) || !readTable(file.data(), file.size(), table)) {
+
+			file.close();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			remove(fileKey);
+			counters.misses += static_cast<long long>(last - first);
+
+			first = last;
+			continue;
+		}
+
+		long long bytesRead = 0;
+		int fileHits = 0;
+
+		for (size_t i = first; i < last; i++) {
+
+			const MeshCacheEntry& place = wanted[i].place;
+			const MeshCounts& at = ranges[wanted[i].range].at;
+
+			// The file may have been stored again since it was looked up, so the entry must still be where the index says.  The
+			// table is in the order the entries were written
+			auto listed = std::lower_bound(table.begin(), table.end(), place.offset, [](const MeshCacheEntry& entry, uint64_t offset) {
+
+				return entry.offset < offset;
+			});
+
+			if (listed == table.end() || std::memcmp(&*listed, &place, sizeof(place)) != 0)
+				continue;
+
+			const char* source = file.data() + place.offset;
+			auto copyFloats = [&source](std::vector<float>& values, int firstValue, int count) {
+
+				std::memcpy(values.data() + firstValue, source, count * sizeof(float));
+				source += count * sizeof(float);
+			};
+
+			copyFloats(mesh.xs, at.verts, place.verts);
+			copyFloats(mesh.ys, at.verts, place.verts);
+			copyFloats(mesh.zs, at.verts, place.verts);
+
+			std::memcpy(mesh.faceCounts.data() + at.faces, source, place.faces * sizeof(int32_t));
+			source += place.faces * sizeof(int32_t);
+
+			readConnects(mesh.faceConnects.data() + at.faceConnects, source, place.faceConnects, at.verts);
+			source += place.faceConnects * sizeof(int32_t);
+
+			copyFloats(mesh.us, at.uvs, place.uvs);
+			copyFloats(mesh.vs, at.uvs, place.uvs);
+
+			readConnects(mesh.uvConnects.data() + at.uvConnects, source, place.uvConnects, at.uvs);
+
+			found[wanted[i].range] = 1;
+			bytesRead += static_cast<long long>(entryValues(place) * 4);
+			fileHits++;
+		}
+
+		file.close();
+
+		// Touching the file keeps the least recently used order for the next session
+		std::error_code error;
+		fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto existing = files.find(fileKey);
+		if (existing != files.end())
+			uses.splice(uses.begin(), uses, existing->second.use);
+
+		counters.hits += fileHits;
+		counters.misses += static_cast<long long>(last - first) - fileHits;
+		counters.bytesRead += bytesRead;
+
+		filled += fileHits;
+		first = last;
+	}
+
+	return filled;
+}
+
+void MeshCache::store(uint64_t key, const MeshBuffer& mesh, const MeshCounts& at, const MeshCounts& end) {
+
+	MeshCacheRange range;
+	range.key = key;
+	range.at = at;
+	range.end = end;
+
+	store(key, std::vector<MeshCacheRange>(1, range), mesh);
+}
+
+void MeshCache::store(uint64_t fileKey, const std::vector<MeshCacheRange>& ranges, const MeshBuffer& mesh) {
+
+	if (!usable || ranges.empty())
+		return;
+
+	MeshCacheHeader header;
+	header.entryCount = static_cast<uint32_t>(ranges.size());
+
+	// Lay out every entry after the table before anything is written
+	std::vector<MeshCacheEntry> table(ranges.size());
+	uint64_t offset = sizeof(header) + (table.size() * sizeof(MeshCacheEntry));
+
+	for (size_t i = 0; i < ranges.size(); i++) {
+
+		const MeshCounts& at = ranges[i].at;
+		const MeshCounts& end = ranges[i].end;
+
+		MeshCacheEntry& entry = table[i];
+		entry.key = ranges[i].key;
+		entry.offset = offset;
+		entry.verts = end.verts - at.verts;
+		entry.faces = end.faces - at.faces;
+		entry.faceConnects = end.faceConnects - at.faceConnects;
+		entry.uvs = end.uvs - at.uvs;
+		entry.uvConnects = end.uvConnects - at.uvConnects;
+
+		offset += entryValues(entry) * 4;
+	}
+
+	const size_t bytes = static_cast<size_t>(offset);
+
+	const std::string path = pathFor(fileKey);
+	std::string tempPath;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tempPath = path + tempExtension + std::to_string(processId()) + "-" + std::to_string(tempCount++);
+	}
+
+	// The file is written under another name and then renamed, so a reader never sees a partly written file
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+
+			warn("Could not open " + tempPath + " for writing");
+			return;
+		}
+
+		writeRaw(file, &header, 1);
+		writeRaw(file, table.data(), table.size());
+
+		for (size_t i = 0; i < ranges.size(); i++) {
+
+			const MeshCounts& at = ranges[i].at;
+			const MeshCacheEntry& entry = table[i];
+
+			writeRaw(file, mesh.xs.data() + at.verts, entry.verts);
+			writeRaw(file, mesh.ys.data() + at.verts, entry.verts);
+			writeRaw(file, mesh.zs.data() + at.verts, entry.verts);
+			writeRaw(file, mesh.faceCounts.data() + at.faces, entry.faces);
+			writeConnects(file, mesh.faceConnects.data() + at.faceConnects, entry.faceConnects, at.verts);
+			writeRaw(file, mesh.us.data() + at.uvs, entry.uvs);
+			writeRaw(file, mesh.vs.data() + at.uvs, entry.uvs);
+			writeConnects(file, mesh.uvConnects.data() + at.uvConnects, entry.uvConnects, at.uvs);
+		}
+
+		file.flush();
+		if (file.fail()) {
+
+			warn("Failed to write " + tempPath);
+			file.close();
+
+			std::error_code error;
+			fs::remove(tempPath, error);
+			return;
+		}
+	}
+
+	std::error_code error;
+	fs::rename(tempPath, path, error);
+	if (error) {
+
+		warn("Could not move " + tempPath + " to " + path);
+		fs::remove(tempPath, error);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	insert(fileKey, bytes, table);
+	counters.stores += static_cast<long long>(ranges.size());
+	counters.bytesWritten += static_cast<long long>(bytes);
+	evict();
+}
+
+void MeshCache::warn(const std::string& message) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	warnings.push_back(message);
+}
+
+void MeshCache::reportWarnings() {
+
+	std::vector<std::string> reported;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		reported.swap(warnings);
+	}
+
+	for (const std::string& message : reported)
+		MMesh::displayWarning(message);
+}
+
+void MeshCache::clear() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	while (!uses.empty())
+		remove(uses.back());
+}
+
+MeshCacheStats MeshCache::stats() const {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return counters;
+}
+
+void MeshCache::resetStats() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	counters = MeshCacheStats();
+}
+
+int MeshCache::entryCount() const {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<int>(entries.size());
+}
+
+int MeshCache::fileCount() const {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return static_cast<int>(files.size());
+}
+
+size_t MeshCache::sizeBytes() const {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return totalBytes;
+}
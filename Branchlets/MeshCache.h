@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BMath.h"
+#include "MeshBuffer.h"
+
+// The header of each file in a MeshCache.  A file holds one or more entries: the header is followed by a MeshCacheEntry for
+// each, and then their values.  The version is part of every key too, so bumping it when the generated geometry or the layout
+// of a file changes means old entries are never used
+struct MeshCacheHeader {
+
+	char magic[4] = { 'B', 'M', 'S', 'H' };
+	uint32_t version = 2;
+	uint32_t entryCount = 0;
+	uint32_t reserved = 0;
+};
+
+// Where an entry's values are in its file, and how many elements it holds.  Every value is 4 bytes, in the order of the arrays
+// of a MeshBuffer: xs, ys, zs, faceCounts, faceConnects, us, vs, uvConnects, with connects counted from the first vertex and
+// uv of the entry
+struct MeshCacheEntry {
+
+	uint64_t key = 0;
+	uint64_t offset = 0;
+	int32_t verts = 0;
+	int32_t faces = 0;
+	int32_t faceConnects = 0;
+	int32_t uvs = 0;
+	int32_t uvConnects = 0;
+	int32_t reserved = 0;
+};
+
+// The elements of a mesh from the indices in 'at' up to 'end', and the key of the entry that holds them
+struct MeshCacheRange {
+
+	uint64_t key = 0;
+	MeshCounts at;
+	MeshCounts end;
+};
+
+// Builds the 64 bit key of a MeshCache entry from every value that the geometry depends on, a word at a time (MurmurHash64A's
+// mixing).  Floating point values are hashed by their bits, so the key only matches input that is exactly the same
+class MeshCacheKey {
+
+	uint64_t hash;
+	uint64_t wordCount = 0;
+
+public:
+
+	MeshCacheKey();
+
+	void add(uint64_t word);
+
+	void add(int value) { add(static_cast<uint64_t>(static_cast<uint32_t>(value))); }
+
+	void add(float value);
+
+	void add(double value);
+
+	void add(const BVector& v) { add(v.x); add(v.y); add(v.z); }
+
+	// The finished key
+	uint64_t value() const;
+};
+
+// Hits, misses and stores count entries, and evictions count files
+struct MeshCacheStats {
+
+	long long hits = 0;
+	long long misses = 0;
+	long long stores = 0;
+	long long evictions = 0;
+	long long bytesRead = 0;
+	long long bytesWritten = 0;
+};
+
+// A directory of finished geometry, so that rebuilding geometry that hasn't changed only costs reading it back.  Each entry is
+// found by its key, and many entries can be stored together in one file, so that a batch of branchlets takes a single file
+// however many there are.  A file is memory mapped on a hit, once for all the entries wanted from it, and they are copied
+// straight into the mesh's arrays.  The directory is kept under a size limit by removing the least recently used files, and
+// each hit updates its file's modification time so that the order in which they were used carries over to the next session.
+// Every method can be called from any thread.  Maya can only show warnings from the main thread, so problems are kept until
+// reportWarnings() is called rather than shown as they happen
+class MeshCache {
+
+	struct Entry {
+
+		// The key of the file the entry is in, and where it is in that file
+		uint64_t file = 0;
+		MeshCacheEntry place;
+	};
+
+	struct File {
+
+		size_t bytes = 0;
+
+		// The keys of the entries stored in the file
+		std::vector<uint64_t> keys;
+
+		// Where the file is in 'uses'
+		std::list<uint64_t>::iterator use;
+	};
+
+	std::string directory;
+	size_t maxBytes = 0;
+	size_t totalBytes = 0;
+	bool usable = false;
+
+	// The key of every file, from the most to the least recently used
+	std::list<uint64_t> uses;
+	std::unordered_map<uint64_t, File> files;
+	std::unordered_map<uint64_t, Entry> entries;
+
+	MeshCacheStats counters;
+	long long tempCount = 0;
+	std::vector<std::string> warnings;
+	mutable std::mutex mutex;
+
+	std::string pathFor(uint64_t fileKey) const;
+
+	// Add a file as the most recently used, replacing any with the same key, and point the keys of 'table' at it.  An entry
+	// stored again in a later file is found there from then on.  The mutex must be held
+	void insert(uint64_t fileKey, size_t bytes, const std::vector<MeshCacheEntry>& table);
+
+	// Forget a file and the entries found in it.  The mutex must be held
+	void forget(uint64_t fileKey);
+
+	// Forget a file and delete it.  The mutex must be held
+	void remove(uint64_t fileKey);
+
+	// Remove the least recently used files until the cache is within its limit.  The mutex must be held
+	void evict();
+
+	// Keep 'message' for reportWarnings()
+	void warn(const std::string& message);
+
+public:
+
+	// Keep entries in 'cacheDirectory', creating it if it doesn't exist, and taking on whatever files are already there, in the
+	// order they were last modified.  No more than 'maxBytes' are kept
+	MeshCache(const std::string& cacheDirectory, size_t maxBytes = static_cast<size_t>(1) << 30);
+
+	MeshCache(const MeshCache&) = delete;
+
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	// Whether the directory could be created and read.  If not, every lookup misses and nothing is stored
+	bool isOpen() const { return usable; }
+
+	// If there is an entry for 'key', copy it into 'mesh' at the indices in 'at' and return true.  The entry must fill the arrays
+	// from 'at' up to 'end' exactly, or it is treated as a miss.  Its connects are offset by the vertex and uv indices in 'at'
+	bool load(uint64_t key, MeshBuffer& mesh, const MeshCounts& at, const MeshCounts& end);
+
+	// Look up the entry of each of 'ranges' and copy those there are into 'mesh', as above.  A file that has gone or can't be
+	// read is a miss, not a problem, since another thread or process may have just removed it.  found[i] is set to whether range i
+	// was filled in.  Each file is mapped once however many of its entries are wanted.  Returns the number filled in
+	int load(const std::vector<MeshCacheRange>& ranges, MeshBuffer& mesh, std::vector<char>& found);
+
+	// Store the elements of 'mesh' from the indices in 'at' up to 'end' as the entry for 'key', in a file of its own
+	void store(uint64_t key, const MeshBuffer& mesh, const MeshCounts& at, const MeshCounts& end);
+
+	// Store the elements of 'mesh' in each of 'ranges' as the entry for its key, all in one file named by 'fileKey'.  A file
+	// already stored under 'fileKey' is replaced
+	void store(uint64_t fileKey, const std::vector<MeshCacheRange>& ranges, const MeshBuffer& mesh);
+
+	// Remove every entry and delete its file
+	void clear();
+
+	// Show every warning kept since the last call with MMesh::displayWarning(), and forget them.  Call this from the thread that
+	// may show warnings, which in Maya is the main one
+	void reportWarnings();
+
+	MeshCacheStats stats() const;
+
+	void resetStats();
+
+	// The number of entries and files, and the total size of the files
+	int entryCount() const;
+	int fileCount() const;
+	size_t sizeBytes() const;
+};
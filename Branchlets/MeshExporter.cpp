@@ -0,0 +1,527 @@
+#include "MeshExporter.h"
+#include "MMesh.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+// Streams are given a buffer this large so that small writes are batched into large ones
+static const size_t fileBufferSize = 1 << 20;
+
+template <class T>
+static void writeRaw(std::ostream& out, const T* data, size_t count) {
+
+	out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+// Get the file name part of a path
+static std::string baseName(const std::string& filePath) {
+
+	size_t slash = filePath.find_last_of("/\\");
+	return slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+}
+
+// Get a path with its extension (if any) replaced by 'extension'
+static std::string replaceExtension(const std::string& filePath, const std::string& extension) {
+
+	size_t dot = filePath.find_last_of('.');
+	size_t slash = filePath.find_last_of("/\\");
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filePath + extension;
+
+	return filePath.substr(0, dot) + extension;
+}
+
+MeshExporter::~MeshExporter() {
+
+	if (file.is_open())
+		file.close();
+}
+
+bool MeshExporter::open(const std::string& filePath) {
+
+	path = filePath;
+
+	// The buffer has to be in place before the file is opened for it to be used
+	fileBuffer.resize(fileBufferSize);
+	file.rdbuf()->pubsetbuf(fileBuffer.data(), fileBuffer.size());
+	file.open(filePath, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+
+		MMesh::displayWarning("Could not open " + filePath + " for writing");
+		return false;
+	}
+
+	return true;
+}
+
+bool MeshExporter::close() {
+
+	if (!file.is_open())
+		return false;
+
+	file.flush();
+	bool succeeded = !file.fail();
+	file.close();
+
+	if (!succeeded)
+		MMesh::displayWarning("Failed to write " + path);
+
+	return succeeded;
+}
+
+ObjExporter::ObjExporter(const std::string& filePath) {
+
+	if (open(filePath))
+		file << "# Branchlets\n";
+}
+
+void ObjExporter::write(const MeshBuffer& piece) {
+
+	if (!isOpen())
+		return;
+
+	char line[64];
+
+	for (size_t i = 0; i < piece.xs.size(); i++) {
+
+		std::snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", piece.xs[i], piece.ys[i], piece.zs[i]);
+		file << line;
+	}
+
+	for (size_t i = 0; i < piece.us.size(); i++) {
+
+		std::snprintf(line, sizeof(line), "vt %.7g %.7g\n", piece.us[i], piece.vs[i]);
+		file << line;
+	}
+
+	// Each normal belongs to the vertex at the same index, so a corner's normal index follows from its vertex index.  OBJ has
+	// nowhere to put tangents
+	const bool normals = piece.hasNormals();
+	if (normals) {
+
+		for (size_t i = 0; i < piece.nxs.size(); i++) {
+
+			std::snprintf(line, sizeof(line), "vn %.7g %.7g %.7g\n", piece.nxs[i], piece.nys[i], piece.nzs[i]);
+			file << line;
+		}
+	}
+
+	// OBJ indices start at 1 and count from the start of the file
+	int corner = 0;
+	for (int faceCount : piece.faceCounts) {
+
+		file << 'f';
+
+		for (int i = 0; i < faceCount; i++, corner++) {
+
+			const int vert = piece.faceConnects[corner];
+			const int uv = piece.uvConnects[corner] + written.uvs + 1;
+
+			if (normals)
+				std::snprintf(line, sizeof(line), " %d/%d/%d", vert + written.verts + 1, uv, vert + normalsWritten + 1);
+			else
+				std::snprintf(line, sizeof(line), " %d/%d", vert + written.verts + 1, uv);
+
+			file << line;
+		}
+
+		file << '\n';
+	}
+
+	written += piece.counts();
+	if (normals)
+		normalsWritten += static_cast<int>(piece.nxs.size());
+}
+
+bool ObjExporter::finish() {
+
+	return close();
+}
+
+PlyExporter::PlyExporter(const std::string& filePath, bool normals) : withNormals(normals) {
+
+	if (!open(filePath))
+		return;
+
+	// The counts are written as fixed width placeholders and overwritten by finish()
+	file << "ply\nformat binary_little_endian 1.0\ncomment Branchlets\nelement vertex ";
+	vertCountPosition = file.tellp();
+	file << "0000000000\nproperty float x\nproperty float y\nproperty float z\n";
+	if (withNormals)
+		file << "property float nx\nproperty float ny\nproperty float nz\n";
+
+	file << "element face ";
+	faceCountPosition = file.tellp();
+	file << "0000000000\nproperty list uchar int vertex_indices\nproperty list uchar float texcoord\nend_header\n";
+
+	facePath = filePath + ".faces.tmp";
+	faceFileBuffer.resize(fileBufferSize);
+	faceFile.rdbuf()->pubsetbuf(faceFileBuffer.data(), faceFileBuffer.size());
+	faceFile.open(facePath, std::ios::binary | std::ios::trunc);
+
+	if (!faceFile.is_open()) {
+
+		MMesh::displayWarning("Could not open " + facePath + " for writing");
+		file.close();
+	}
+}
+
+PlyExporter::~PlyExporter() {
+
+	if (faceFile.is_open()) {
+
+		faceFile.close();
+		std::remove(facePath.c_str());
+	}
+}
+
+void PlyExporter::write(const MeshBuffer& piece) {
+
+	if (!isOpen())
+		return;
+
+	// Vertices go straight into the output, interleaved as x, y, z and then nx, ny, nz if the file has normals.  A piece without
+	// normals of its own gets zero ones
+	const size_t vertCount = piece.xs.size();
+	const size_t stride = withNormals ? 6 : 3;
+	const bool normals = withNormals && piece.hasNormals();
+	std::vector<float> interleaved(vertCount * stride, 0.f);
+
+	for (size_t i = 0; i < vertCount; i++) {
+
+		interleaved[(i * stride)] = piece.xs[i];
+		interleaved[(i * stride) + 1] = piece.ys[i];
+		interleaved[(i * stride) + 2] = piece.zs[i];
+
+		if (normals) {
+
+			interleaved[(i * stride) + 3] = piece.nxs[i];
+			interleaved[(i * stride) + 4] = piece.nys[i];
+			interleaved[(i * stride) + 5] = piece.nzs[i];
+		}
+	}
+
+	writeRaw(file, interleaved.data(), interleaved.size());
+
+	// Faces go to the spill file until every vertex has been written
+	int corner = 0;
+	std::vector<int> faceVerts;
+	std::vector<float> faceUVs;
+
+	for (int faceCount : piece.faceCounts) {
+
+		faceVerts.resize(faceCount);
+		faceUVs.resize(faceCount * 2);
+
+		for (int i = 0; i < faceCount; i++, corner++) {
+
+			faceVerts[i] = piece.faceConnects[corner] + written.verts;
+			faceUVs[(i * 2)] = piece.us[piece.uvConnects[corner]];
+			faceUVs[(i * 2) + 1] = piece.vs[piece.uvConnects[corner]];
+		}
+
+		unsigned char cornerCount = static_cast<unsigned char>(faceCount);
+		unsigned char uvValueCount = static_cast<unsigned char>(faceCount * 2);
+
+		writeRaw(faceFile, &cornerCount, 1);
+		writeRaw(faceFile, faceVerts.data(), faceVerts.size());
+		writeRaw(faceFile, &uvValueCount, 1);
+		writeRaw(faceFile, faceUVs.data(), faceUVs.size());
+	}
+
+	written += piece.counts();
+}
+
+bool PlyExporter::finish() {
+
+	if (!isOpen())
+		return false;
+
+	faceFile.close();
+	bool succeeded = !faceFile.fail();
+
+	{
+		std::ifstream faces(facePath, std::ios::binary);
+		if (written.faces > 0)
+			file << faces.rdbuf();
+	}
+
+	std::remove(facePath.c_str());
+
+	char count[16];
+
+	file.seekp(vertCountPosition);
+	std::snprintf(count, sizeof(count), "%010d", written.verts);
+	file.write(count, 10);
+
+	file.seekp(faceCountPosition);
+	std::snprintf(count, sizeof(count), "%010d", written.faces);
+	file.write(count, 10);
+
+	return close() && succeeded;
+}
+
+GltfExporter::GltfExporter(const std::string& filePath) {
+
+	gltfPath = filePath;
+	std::string binPath = replaceExtension(filePath, ".bin");
+	binName = baseName(binPath);
+
+	open(binPath);
+}
+
+void GltfExporter::write(const MeshBuffer& piece) {
+
+	if (!isOpen())
+		return;
+
+	const int maxShortIndexVerts = std::numeric_limits<unsigned short>::max();
+	const int uvCount = static_cast<int>(piece.us.size());
+
+	const bool pieceNormals = piece.hasNormals();
+
+	if ((static_cast<int>(positions.size() / 3) + uvCount) > maxShortIndexVerts || pieceNormals != chunkNormals)
+		flushChunk();
+
+	chunkNormals = pieceNormals;
+
+	const int base = static_cast<int>(positions.size() / 3);
+	positions.resize((base + uvCount) * 3);
+	texcoords.resize((base + uvCount) * 2);
+
+	if (chunkNormals) {
+
+		normals.resize((base + uvCount) * 3);
+		tangents.resize((base + uvCount) * 4);
+	}
+
+	// Every uv Branchlets makes belongs to a single vertex, so each uv becomes one glTF vertex placed at the vertex its corners use
+	for (size_t corner = 0; corner < piece.uvConnects.size(); corner++) {
+
+		const int uv = piece.uvConnects[corner];
+		const int vert = piece.faceConnects[corner];
+
+		positions[((base + uv) * 3)] = piece.xs[vert];
+		positions[((base + uv) * 3) + 1] = piece.ys[vert];
+		positions[((base + uv) * 3) + 2] = piece.zs[vert];
+
+		// normal ^ tangent points the way v increases, which is up the texture once v is flipped below, so every w is 1
+		if (chunkNormals) {
+
+			normals[((base + uv) * 3)] = piece.nxs[vert];
+			normals[((base + uv) * 3) + 1] = piece.nys[vert];
+			normals[((base + uv) * 3) + 2] = piece.nzs[vert];
+
+			tangents[((base + uv) * 4)] = piece.txs[vert];
+			tangents[((base + uv) * 4) + 1] = piece.tys[vert];
+			tangents[((base + uv) * 4) + 2] = piece.tzs[vert];
+			tangents[((base + uv) * 4) + 3] = 1.f;
+		}
+	}
+
+	// glTF's v axis points down the texture
+	for (int uv = 0; uv < uvCount; uv++) {
+
+		texcoords[((base + uv) * 2)] = piece.us[uv];
+		texcoords[((base + uv) * 2) + 1] = 1.f - piece.vs[uv];
+	}
+
+	// Split each face into a fan of triangles
+	int corner = 0;
+	for (int faceCount : piece.faceCounts) {
+
+		for (int i = 1; i < faceCount - 1; i++) {
+
+			indices.push_back(base + piece.uvConnects[corner]);
+			indices.push_back(base + piece.uvConnects[corner + i]);
+			indices.push_back(base + piece.uvConnects[corner + i + 1]);
+		}
+
+		corner += faceCount;
+	}
+
+	// A piece too big for a chunk of its own is written straight away with 32 bit indices
+	if (static_cast<int>(positions.size() / 3) > maxShortIndexVerts)
+		flushChunk();
+
+	written += piece.counts();
+}
+
+void GltfExporter::flushChunk() {
+
+	if (indices.empty())
+		return;
+
+	Primitive primitive;
+	primitive.vertCount = static_cast<int>(positions.size() / 3);
+	primitive.indexCount = static_cast<int>(indices.size());
+	primitive.shortIndices = primitive.vertCount <= std::numeric_limits<unsigned short>::max();
+	primitive.hasNormals = chunkNormals;
+	primitive.normalOffset = 0;
+	primitive.tangentOffset = 0;
+
+	// glTF requires the bounds of every position accessor
+	for (int axis = 0; axis < 3; axis++) {
+
+		primitive.min[axis] = std::numeric_limits<float>::max();
+		primitive.max[axis] = std::numeric_limits<float>::lowest();
+	}
+
+	for (size_t i = 0; i < positions.size(); i++) {
+
+		primitive.min[i % 3] = std::min(primitive.min[i % 3], positions[i]);
+		primitive.max[i % 3] = std::max(primitive.max[i % 3], positions[i]);
+	}
+
+	primitive.positionOffset = binLength;
+	writeRaw(file, positions.data(), positions.size());
+	binLength += positions.size() * sizeof(float);
+
+	primitive.texcoordOffset = binLength;
+	writeRaw(file, texcoords.data(), texcoords.size());
+	binLength += texcoords.size() * sizeof(float);
+
+	if (primitive.hasNormals) {
+
+		primitive.normalOffset = binLength;
+		writeRaw(file, normals.data(), normals.size());
+		binLength += normals.size() * sizeof(float);
+
+		primitive.tangentOffset = binLength;
+		writeRaw(file, tangents.data(), tangents.size());
+		binLength += tangents.size() * sizeof(float);
+	}
+
+	primitive.indexOffset = binLength;
+
+	if (primitive.shortIndices) {
+
+		std::vector<unsigned short> shortIndices(indices.begin(), indices.end());
+		writeRaw(file, shortIndices.data(), shortIndices.size());
+		binLength += shortIndices.size() * sizeof(unsigned short);
+
+		// Keep the next primitive's floats 4 byte aligned
+		if (binLength % 4 != 0) {
+
+			const unsigned short padding = 0;
+			writeRaw(file, &padding, 1);
+			binLength += sizeof(unsigned short);
+		}
+	}
+	else {
+
+		writeRaw(file, indices.data(), indices.size());
+		binLength += indices.size() * sizeof(unsigned);
+	}
+
+	primitives.push_back(primitive);
+
+	positions.clear();
+	texcoords.clear();
+	normals.clear();
+	tangents.clear();
+	indices.clear();
+}
+
+bool GltfExporter::finish() {
+
+	if (!isOpen())
+		return false;
+
+	flushChunk();
+	bool succeeded = close();
+
+	std::ofstream json(gltfPath, std::ios::trunc);
+	if (!json.is_open()) {
+
+		MMesh::displayWarning("Could not open " + gltfPath + " for writing");
+		return false;
+	}
+
+	char number[32];
+	auto num = [&](double value) { std::snprintf(number, sizeof(number), "%.9g", value); return std::string(number); };
+
+	json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Branchlets\"},\"scene\":0,";
+
+	if (primitives.empty()) {
+
+		json << "\"scenes\":[{\"nodes\":[]}]}\n";
+		json.close();
+		return succeeded && !json.fail();
+	}
+
+	json << "\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[";
+
+	// Each primitive has three accessors, or five with normals, each with its own buffer view of the same index, in the order
+	// position, texcoord, normal, tangent, index
+	std::vector<size_t> firstAccessors(primitives.size());
+	size_t accessorCount = 0;
+
+	for (size_t i = 0; i < primitives.size(); i++) {
+
+		firstAccessors[i] = accessorCount;
+		accessorCount += primitives[i].hasNormals ? 5 : 3;
+	}
+
+	for (size_t i = 0; i < primitives.size(); i++) {
+
+		const size_t first = firstAccessors[i];
+		json << (i > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":" << first << ",\"TEXCOORD_0\":" << (first + 1);
+
+		if (primitives[i].hasNormals)
+			json << ",\"NORMAL\":" << (first + 2) << ",\"TANGENT\":" << (first + 3);
+
+		json << "},\"indices\":" << (first + (primitives[i].hasNormals ? 4 : 2)) << ",\"mode\":4}";
+	}
+
+	json << "]}],\"buffers\":[{\"uri\":\"" << binName << "\",\"byteLength\":" << binLength << "}],\"bufferViews\":[";
+
+	for (size_t i = 0; i < primitives.size(); i++) {
+
+		const Primitive& p = primitives[i];
+		const long long indexBytes = static_cast<long long>(p.indexCount) * (p.shortIndices ? sizeof(unsigned short) : sizeof(unsigned));
+
+		json << (i > 0 ? "," : "");
+		json << "{\"buffer\":0,\"byteOffset\":" << p.positionOffset << ",\"byteLength\":" << (p.vertCount * 12) << ",\"target\":34962},";
+		json << "{\"buffer\":0,\"byteOffset\":" << p.texcoordOffset << ",\"byteLength\":" << (p.vertCount * 8) << ",\"target\":34962},";
+
+		if (p.hasNormals) {
+
+			json << "{\"buffer\":0,\"byteOffset\":" << p.normalOffset << ",\"byteLength\":" << (p.vertCount * 12) << ",\"target\":34962},";
+			json << "{\"buffer\":0,\"byteOffset\":" << p.tangentOffset << ",\"byteLength\":" << (p.vertCount * 16) << ",\"target\":34962},";
+		}
+
+		json << "{\"buffer\":0,\"byteOffset\":" << p.indexOffset << ",\"byteLength\":" << indexBytes << ",\"target\":34963}";
+	}
+
+	json << "],\"accessors\":[";
+
+	for (size_t i = 0; i < primitives.size(); i++) {
+
+		const Primitive& p = primitives[i];
+		const size_t first = firstAccessors[i];
+		const size_t index = first + (p.hasNormals ? 4 : 2);
+
+		json << (i > 0 ? "," : "");
+		json << "{\"bufferView\":" << first << ",\"componentType\":5126,\"count\":" << p.vertCount << ",\"type\":\"VEC3\",";
+		json << "\"min\":[" << num(p.min[0]) << "," << num(p.min[1]) << "," << num(p.min[2]) << "],";
+		json << "\"max\":[" << num(p.max[0]) << "," << num(p.max[1]) << "," << num(p.max[2]) << "]},";
+		json << "{\"bufferView\":" << (first + 1) << ",\"componentType\":5126,\"count\":" << p.vertCount << ",\"type\":\"VEC2\"},";
+
+		if (p.hasNormals) {
+
+			json << "{\"bufferView\":" << (first + 2) << ",\"componentType\":5126,\"count\":" << p.vertCount << ",\"type\":\"VEC3\"},";
+			json << "{\"bufferView\":" << (first + 3) << ",\"componentType\":5126,\"count\":" << p.vertCount << ",\"type\":\"VEC4\"},";
+		}
+
+		json << "{\"bufferView\":" << index << ",\"componentType\":" << (p.shortIndices ? 5123 : 5125) << ",\"count\":" << p.indexCount << ",\"type\":\"SCALAR\"}";
+	}
+
+	json << "]}\n";
+	json.close();
+
+	return succeeded && !json.fail();
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "MeshBuffer.h"
+
+// Writes meshes to disk piece by piece as they are generated, without going through MFnMesh.  Each piece passed to write() is
+// a self contained mesh whose vertex and uv indices start at 0; the exporter offsets them as it goes, so the pieces end up as
+// one mesh in the file while only the piece being written has to be held in memory.  Output goes through a large write buffer
+class MeshExporter {
+
+protected:
+
+	std::string path;
+	std::ofstream file;
+	std::vector<char> fileBuffer;
+
+	// The number of vertices, uvs and faces written so far
+	MeshCounts written;
+
+	// Open 'filePath' for binary writing with a large buffer.  Returns false and shows a warning if it can't be opened
+	bool open(const std::string& filePath);
+
+	// Close the file, returning false if anything failed to write
+	bool close();
+
+public:
+
+	MeshExporter() {}
+
+	MeshExporter(const MeshExporter&) = delete;
+
+	MeshExporter& operator=(const MeshExporter&) = delete;
+
+	virtual ~MeshExporter();
+
+	virtual bool isOpen() const { return file.is_open(); }
+
+	// The number of vertices, uvs and faces written so far
+	const MeshCounts& counts() const { return written; }
+
+	// Append a piece of mesh to the file
+	virtual void write(const MeshBuffer& piece) = 0;
+
+	// Write anything that can only be written once every piece is known and close the file.  Returns false if anything failed
+	virtual bool finish() = 0;
+};
+
+// Wavefront OBJ text output, mainly for debugging.  Pieces that keep normals (see MeshBuffer::hasNormals()) get a 'vn' line per
+// vertex, and their faces refer to them
+class ObjExporter : public MeshExporter {
+
+	// The number of 'vn' lines written so far, which only pieces with normals add to
+	int normalsWritten = 0;
+
+public:
+
+	ObjExporter(const std::string& filePath);
+
+	void write(const MeshBuffer& piece) override;
+
+	bool finish() override;
+};
+
+// Binary little endian PLY with float x, y, z vertices and faces holding both their vertex indices and a 'texcoord' list of
+// u, v pairs for their corners.  PLY puts every vertex before every face, so faces are spilled to a temporary file next to
+// the output and appended to it by finish(), and the element counts in the header are patched in at the same time.  The header
+// is written before any piece is seen, so whether vertices also carry float nx, ny, nz normals is chosen up front
+class PlyExporter : public MeshExporter {
+
+	bool withNormals = false;
+
+	std::string facePath;
+	std::ofstream faceFile;
+	std::vector<char> faceFileBuffer;
+
+	// Where the header's vertex and face counts are, so they can be filled in once they are known
+	std::streamoff vertCountPosition = 0;
+	std::streamoff faceCountPosition = 0;
+
+public:
+
+	PlyExporter(const std::string& filePath, bool normals = false);
+
+	~PlyExporter() override;
+
+	void write(const MeshBuffer& piece) override;
+
+	bool finish() override;
+};
+
+// glTF 2.0 output, written as 'filePath' (the JSON) plus a .bin buffer beside it.  glTF vertices carry their own uvs, so each
+// uv of a piece becomes a vertex with the position of the vertex it belongs to, and faces are split into triangles.  Pieces are
+// gathered into chunks of at most 65535 vertices, each of which is written as one primitive with 16 bit indices.  A piece too
+// large to fit in a chunk on its own gets a primitive with 32 bit indices.  Only the chunk being gathered is held in memory.
+// Pieces that keep normals give their primitives NORMAL and TANGENT attributes too, so a chunk is ended early wherever pieces
+// with and without normals meet
+class GltfExporter : public MeshExporter {
+
+	// The chunk being gathered.  Normals and tangents are only gathered when 'chunkNormals' is set
+	std::vector<float> positions;
+	std::vector<float> texcoords;
+	std::vector<float> normals;
+	std::vector<float> tangents;
+	std::vector<unsigned> indices;
+	bool chunkNormals = false;
+
+	// A primitive that has already been written to the .bin buffer
+	struct Primitive {
+
+		long long positionOffset;
+		long long texcoordOffset;
+		long long normalOffset;
+		long long tangentOffset;
+		long long indexOffset;
+		int vertCount;
+		int indexCount;
+		bool shortIndices;
+		bool hasNormals;
+		float min[3];
+		float max[3];
+	};
+
+	std::vector<Primitive> primitives;
+	std::string gltfPath;
+	std::string binName;
+	long long binLength = 0;
+
+	// Write the gathered chunk to the .bin buffer as a primitive, then empty it
+	void flushChunk();
+
+public:
+
+	GltfExporter(const std::string& filePath);
+
+	void write(const MeshBuffer& piece) override;
+
+	bool finish() override;
+};
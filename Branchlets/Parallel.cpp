@@ -0,0 +1,57 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+unsigned resolveThreadCount(unsigned requested) {
+
+	if (requested > 0)
+		return requested;
+
+	unsigned hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+void parallelFor(int count, unsigned threadCount, void (*body)(void* context, int index), void* context) {
+
+	threadCount = std::min(resolveThreadCount(threadCount), static_cast<unsigned>(std::max(count, 1)));
+
+	if (threadCount <= 1) {
+
+		for (int i = 0; i < count; i++)
+			body(context, i);
+
+		return;
+	}
+
+	// Blocks are small enough that every thread gets many of them, but large enough that the shared counter isn't contended
+	const int blockSize = std::max(1, count / static_cast<int>(threadCount * 16));
+	std::atomic<int> nextIndex(0);
+
+	auto work = [&]() {
+
+		for (;;) {
+
+			const int first = nextIndex.fetch_add(blockSize);
+			if (first >= count)
+				return;
+
+			const int last = std::min(first + blockSize, count);
+			for (int i = first; i < last; i++)
+				body(context, i);
+		}
+	};
+
+	// The calling thread does its share of the work too
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount - 1);
+	for (unsigned i = 0; i < threadCount - 1; i++)
+		workers.emplace_back(work);
+
+	work();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Find how many worker threads to use when 'requested' threads are asked for.  A request of 0 means one per hardware thread
+unsigned resolveThreadCount(unsigned requested);
+
+// Call 'body' once for every index in [0, count), spread over 'threadCount' threads.  Indices are handed out in small
+// blocks as threads become free, so uneven amounts of work per index still balance.  Returns once every call has finished
+void parallelFor(int count, unsigned threadCount, void (*body)(void* context, int index), void* context);
+
+// The same, for any callable taking an index.  The callable is passed through by address rather than wrapped in a
+// std::function, so a call never allocates
+template <typename Body>
+void parallelFor(int count, unsigned threadCount, const Body& body) {
+
+	parallelFor(count, threadCount, [](void* context, int index) { (*static_cast<const Body*>(context))(index); }, const_cast<Body*>(&body));
+}
@@ -0,0 +1,167 @@
+#include "Pipeline.h"
+#include "MeshExporter.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifndef BRANCHLETS_HEADLESS
+bool MayaChunkSink::submit(int chunkIndex, BranchletChunk& chunk) {
+
+	return chunk.mesh->createMesh(baseName + std::to_string(chunkIndex)) == MS::kSuccess;
+}
+#endif
+
+bool LocalChunkSink::submit(int, BranchletChunk& chunk) {
+
+	const MeshBuffer& piece = chunk.mesh->buffer();
+
+	if (exporter != nullptr)
+		exporter->write(piece);
+
+	if (secondsPerVert > 0.) {
+
+		// Busy wait rather than sleep, since a sleep can't be trusted to be shorter than a millisecond or so
+		const auto until = std::chrono::steady_clock::now() + std::chrono::duration<double>(secondsPerVert * piece.xs.size());
+		while (std::chrono::steady_clock::now() < until) {}
+	}
+
+	chunkCount++;
+	submitted += piece.counts();
+
+	if (!chunk.bounds.isEmpty()) {
+
+		bounds.add(chunk.bounds.min[0], chunk.bounds.min[1], chunk.bounds.min[2]);
+		bounds.add(chunk.bounds.max[0], chunk.bounds.max[1], chunk.bounds.max[2]);
+	}
+
+	return true;
+}
+
+void ChunkPipeline::cancel() {
+
+	// Set under the lock, so that a thread can't check it and then miss the wake up
+	{
+		std::lock_guard<std::mutex> lock(progressMutex);
+		cancelled.store(true);
+	}
+
+	chunkBuilt.notify_all();
+	chunkSubmitted.notify_all();
+}
+
+PipelineResult ChunkPipeline::run(const std::vector<BBranch>& branches, int sides, const ChunkSettings& chunkSettings, ChunkSink& sink, const PipelineSettings& settings) {
+
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+
+	cancelled.store(false);
+
+	std::vector<BranchletChunk> chunks = chunkBranches(branches, sides, chunkSettings);
+	const int chunkCount = static_cast<int>(chunks.size());
+	const int maxAhead = std::max(1, settings.maxAhead);
+
+	PipelineResult result;
+	result.chunkCount = chunkCount;
+
+	// Chunks can finish out of order, so each one is marked in 'ready' and waits there until every chunk before it has been
+	// submitted.  None can be more than 'maxAhead' past the next to submit, so a slot for each of those is enough.  Both are
+	// guarded by progressMutex
+	std::vector<char> ready(maxAhead, 0);
+	int nextSubmit = 0;
+
+	// Workers claim chunks in order.  A worker that claims a chunk too far ahead of the next to be submitted waits for submission
+	// to catch up before building it, which is the backpressure
+	std::atomic<int> nextChunk(0);
+
+	auto work = [&]() {
+
+		for (;;) {
+
+			const int chunkIndex = nextChunk.fetch_add(1);
+			if (chunkIndex >= chunkCount)
+				return;
+
+			{
+				std::unique_lock<std::mutex> lock(progressMutex);
+				chunkSubmitted.wait(lock, [&]() { return chunkIndex < nextSubmit + maxAhead || cancelled.load(); });
+
+				if (cancelled.load())
+					return;
+			}
+
+			buildChunk(chunks[chunkIndex], branches, sides);
+
+			{
+				std::lock_guard<std::mutex> lock(progressMutex);
+				ready[chunkIndex % maxAhead] = 1;
+			}
+
+			chunkBuilt.notify_one();
+		}
+	};
+
+	const unsigned threadCount = std::min(resolveThreadCount(settings.threadCount), static_cast<unsigned>(std::max(chunkCount, 1)));
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount);
+	for (unsigned i = 0; i < threadCount; i++)
+		workers.emplace_back(work);
+
+	while (result.submitted < chunkCount) {
+
+		{
+			std::unique_lock<std::mutex> lock(progressMutex);
+			char& next = ready[result.submitted % maxAhead];
+
+			if (!next && !cancelled.load()) {
+
+				const auto waitStart = Clock::now();
+				chunkBuilt.wait(lock, [&]() { return next || cancelled.load(); });
+				result.waitSeconds += std::chrono::duration<double>(Clock::now() - waitStart).count();
+			}
+
+			if (cancelled.load())
+				break;
+
+			next = 0;
+		}
+
+		const auto submitStart = Clock::now();
+		BranchletChunk& chunk = chunks[result.submitted];
+
+		const bool accepted = sink.submit(result.submitted, chunk);
+
+		// The chunk's memory is let go of as soon as it has been submitted
+		chunk.mesh.reset();
+		chunk.branchIndices = std::vector<int>();
+
+		// A chunk the sink refused isn't counted as submitted, even if it was the last one
+		if (!accepted) {
+
+			result.submitSeconds += std::chrono::duration<double>(Clock::now() - submitStart).count();
+			cancel();
+			break;
+		}
+
+		result.submitted++;
+
+		{
+			std::lock_guard<std::mutex> lock(progressMutex);
+			nextSubmit = result.submitted;
+		}
+
+		chunkSubmitted.notify_all();
+		result.submitSeconds += std::chrono::duration<double>(Clock::now() - submitStart).count();
+	}
+
+	result.cancelled = result.submitted < chunkCount;
+	if (result.cancelled)
+		cancel();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return result;
+}
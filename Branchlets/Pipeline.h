@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Chunks.h"
+
+class MeshExporter;
+
+// Takes finished chunks from a ChunkPipeline, one at a time and in order, on the thread that runs the pipeline.  That is where
+// anything that has to happen on Maya's main thread, such as MFnMesh::create(), goes
+class ChunkSink {
+
+public:
+
+	virtual ~ChunkSink() {}
+
+	// Take chunk 'chunkIndex', which may be moved from.  Return false to cancel the rest of the build
+	virtual bool submit(int chunkIndex, BranchletChunk& chunk) = 0;
+};
+
+#ifndef BRANCHLETS_HEADLESS
+// Makes a Maya mesh of each chunk with MMesh::createMesh(), named 'baseName' followed by the chunk's index
+class MayaChunkSink : public ChunkSink {
+
+	std::string baseName;
+
+public:
+
+	MayaChunkSink(const std::string& BaseName) : baseName(BaseName) {}
+
+	bool submit(int chunkIndex, BranchletChunk& chunk) override;
+};
+#endif
+
+// Stands in for Maya where there is none.  It keeps totals of what it is given, writes each chunk to an exporter if it has one,
+// and can spend a set time on each vertex to act like the cost of making a mesh, so that pipelining can be measured headless
+class LocalChunkSink : public ChunkSink {
+
+	MeshExporter* exporter = nullptr;
+	double secondsPerVert = 0.;
+
+public:
+
+	// The totals of every chunk submitted so far
+	int chunkCount = 0;
+	MeshCounts submitted;
+	MeshBounds bounds;
+
+	LocalChunkSink() {}
+
+	// Write each chunk to 'meshExporter' (if not nullptr), and wait 'SecondsPerVert' for each of its vertices
+	LocalChunkSink(MeshExporter* meshExporter, double SecondsPerVert = 0.) : exporter(meshExporter), secondsPerVert(SecondsPerVert) {}
+
+	bool submit(int chunkIndex, BranchletChunk& chunk) override;
+};
+
+struct PipelineSettings {
+
+	// The number of threads building chunks, besides the thread submitting them.  0 uses one per hardware thread
+	unsigned threadCount = 0;
+
+	// The most chunks that may be built ahead of the one being submitted.  Workers wait once they are this far ahead, which
+	// bounds the memory held by finished chunks however slow submission is
+	int maxAhead = 8;
+};
+
+struct PipelineResult {
+
+	int chunkCount = 0;
+
+	// The chunks the sink accepted.  A chunk it refused by returning false is not counted, and the run is cancelled
+	int submitted = 0;
+	bool cancelled = false;
+
+	// The whole run, the time spent in the sink, and the time the submitting thread spent waiting for chunks to be built.  When
+	// generation hides behind submission, the wait is close to 0
+	double seconds = 0.;
+	double submitSeconds = 0.;
+	double waitSeconds = 0.;
+};
+
+// Builds chunks on worker threads while the calling thread hands them to a ChunkSink, so that generating one chunk overlaps with
+// submitting the last.  Chunks are submitted in the order chunkBranches() gives them, so the result is the same for any number of
+// threads.  Every thread that has to wait, for a chunk to be built or for submission to catch up, sleeps on a condition variable
+class ChunkPipeline {
+
+	std::atomic<bool> cancelled;
+
+	// Guards the progress of the current run.  The submitting thread waits on 'chunkBuilt', and workers that are too far ahead
+	// wait on 'chunkSubmitted'
+	std::mutex progressMutex;
+	std::condition_variable chunkBuilt;
+	std::condition_variable chunkSubmitted;
+
+public:
+
+	ChunkPipeline() : cancelled(false) {}
+
+	// Split 'branches' into chunks with 'chunkSettings', build them and submit each to 'sink'.  Returns once every chunk has been
+	// submitted, or once the build has been cancelled and every worker has stopped
+	PipelineResult run(const std::vector<BBranch>& branches, int sides, const ChunkSettings& chunkSettings, ChunkSink& sink, const PipelineSettings& settings = PipelineSettings());
+
+	// Stop the current run from any thread.  Chunks that haven't been submitted are dropped
+	void cancel();
+};
@@ -0,0 +1,216 @@
+#include "RingKernel.h"
+
+#include "FixedSides.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+const RingTable& getRingTable(int sides) {
+
+	static std::map<int, std::unique_ptr<RingTable>> tables;
+	static std::shared_mutex tablesMutex;
+
+	// Every ring looks up its table, and after the first few calls every one is found, so look under a shared lock first and
+	// only take the exclusive lock to add one, as getTopologyTemplate() does
+	{
+		std::shared_lock<std::shared_mutex> lock(tablesMutex);
+
+		auto found = tables.find(sides);
+		if (found != tables.end())
+			return *found->second;
+	}
+
+	std::unique_ptr<RingTable> table(new RingTable());
+
+	// Step by the same single precision increment Branchlets has always used, so that rings come out where they did before
+	const float PI = 3.1415926f;
+	const double angleIncrement = ((PI * 2.f) / sides);
+	const int paddedSides = (sides + 3) & ~3;
+
+	table->cosines.assign(paddedSides, 0.);
+	table->sines.assign(paddedSides, 0.);
+
+	for (int i = 0; i < sides; i++) {
+
+		table->cosines[i] = std::cos(i * angleIncrement);
+		table->sines[i] = std::sin(i * angleIncrement);
+	}
+
+	table->cosWedge = std::cos((PI * 2.f) / sides);
+	table->sides = sides;
+
+	std::unique_lock<std::shared_mutex> lock(tablesMutex);
+
+	// Another thread may have added the same table while this one was building it, in which case theirs is kept
+	auto inserted = tables.emplace(sides, std::move(table));
+	return *inserted.first->second;
+}
+
+// The body of makeRingPositions(), for 'Sides' sides, or table.sides when 'Sides' is 0
+template <int Sides>
+static void ringPositions(const RingTable& table, const double center[3], const double e0[3], const double e1[3], float* xs, float* ys, float* zs) {
+
+	const int sides = Sides > 0 ? Sides : table.sides;
+	const double* cosines = table.cosines.data();
+	const double* sines = table.sines.data();
+	int i = 0;
+
+#if defined(BRANCHLETS_AVX)
+
+	// Four vertices at a time
+	const __m256d cx = _mm256_set1_pd(center[0]), cy = _mm256_set1_pd(center[1]), cz = _mm256_set1_pd(center[2]);
+	const __m256d e0x = _mm256_set1_pd(e0[0]), e0y = _mm256_set1_pd(e0[1]), e0z = _mm256_set1_pd(e0[2]);
+	const __m256d e1x = _mm256_set1_pd(e1[0]), e1y = _mm256_set1_pd(e1[1]), e1z = _mm256_set1_pd(e1[2]);
+
+	for (; i + 4 <= sides; i += 4) {
+
+		const __m256d c = _mm256_loadu_pd(cosines + i);
+		const __m256d s = _mm256_loadu_pd(sines + i);
+
+		_mm_storeu_ps(xs + i, _mm256_cvtpd_ps(_mm256_add_pd(cx, _mm256_add_pd(_mm256_mul_pd(c, e0x), _mm256_mul_pd(s, e1x)))));
+		_mm_storeu_ps(ys + i, _mm256_cvtpd_ps(_mm256_add_pd(cy, _mm256_add_pd(_mm256_mul_pd(c, e0y), _mm256_mul_pd(s, e1y)))));
+		_mm_storeu_ps(zs + i, _mm256_cvtpd_ps(_mm256_add_pd(cz, _mm256_add_pd(_mm256_mul_pd(c, e0z), _mm256_mul_pd(s, e1z)))));
+	}
+
+#elif defined(BRANCHLETS_SSE2)
+
+	// Two vertices at a time.  Converting two doubles gives two floats in the low half of the register, which are stored together
+	const __m128d cx = _mm_set1_pd(center[0]), cy = _mm_set1_pd(center[1]), cz = _mm_set1_pd(center[2]);
+	const __m128d e0x = _mm_set1_pd(e0[0]), e0y = _mm_set1_pd(e0[1]), e0z = _mm_set1_pd(e0[2]);
+	const __m128d e1x = _mm_set1_pd(e1[0]), e1y = _mm_set1_pd(e1[1]), e1z = _mm_set1_pd(e1[2]);
+
+	for (; i + 2 <= sides; i += 2) {
+
+		const __m128d c = _mm_loadu_pd(cosines + i);
+		const __m128d s = _mm_loadu_pd(sines + i);
+
+		_mm_storel_pi(reinterpret_cast<__m64*>(xs + i), _mm_cvtpd_ps(_mm_add_pd(cx, _mm_add_pd(_mm_mul_pd(c, e0x), _mm_mul_pd(s, e1x)))));
+		_mm_storel_pi(reinterpret_cast<__m64*>(ys + i), _mm_cvtpd_ps(_mm_add_pd(cy, _mm_add_pd(_mm_mul_pd(c, e0y), _mm_mul_pd(s, e1y)))));
+		_mm_storel_pi(reinterpret_cast<__m64*>(zs + i), _mm_cvtpd_ps(_mm_add_pd(cz, _mm_add_pd(_mm_mul_pd(c, e0z), _mm_mul_pd(s, e1z)))));
+	}
+
+#endif
+
+	for (; i < sides; i++) {
+
+		xs[i] = static_cast<float>(center[0] + (cosines[i] * e0[0]) + (sines[i] * e1[0]));
+		ys[i] = static_cast<float>(center[1] + (cosines[i] * e0[1]) + (sines[i] * e1[1]));
+		zs[i] = static_cast<float>(center[2] + (cosines[i] * e0[2]) + (sines[i] * e1[2]));
+	}
+}
+
+void makeRingPositions(const RingTable& table, const double center[3], const double e0[3], const double e1[3], float* xs, float* ys, float* zs) {
+
+	dispatchSides(table.sides, [&](auto fixedSides) {
+
+		ringPositions<decltype(fixedSides)::value>(table, center, e0, e1, xs, ys, zs);
+	});
+}
+
+// The body of makeRingNormalsAndTangents(), for 'Sides' sides, or table.sides when 'Sides' is 0.  Each loop is kept free of branches so
+// that the compiler can work on several vertices at once
+template <int Sides>
+static void ringNormals(const RingTable& table, const double e0[3], const double e1[3], const double e0Below[3], const double e1Below[3], const double* e0Above, const double* e1Above,
+	float* nxs, float* nys, float* nzs, float* txs, float* tys, float* tzs) {
+
+	const int sides = Sides > 0 ? Sides : table.sides;
+	const double* cosines = table.cosines.data();
+	const double* sines = table.sines.data();
+
+	const float a0x = static_cast<float>(e0[0]), a0y = static_cast<float>(e0[1]), a0z = static_cast<float>(e0[2]);
+	const float a1x = static_cast<float>(e1[0]), a1y = static_cast<float>(e1[1]), a1z = static_cast<float>(e1[2]);
+	const float b0x = static_cast<float>(e0Below[0]), b0y = static_cast<float>(e0Below[1]), b0z = static_cast<float>(e0Below[2]);
+	const float b1x = static_cast<float>(e1Below[0]), b1y = static_cast<float>(e1Below[1]), b1z = static_cast<float>(e1Below[2]);
+
+	// The normals of the tube below the ring
+	for (int i = 0; i < sides; i++) {
+
+		const float c = static_cast<float>(cosines[i]);
+		const float s = static_cast<float>(sines[i]);
+
+		const float x = (c * b0x) + (s * b1x);
+		const float y = (c * b0y) + (s * b1y);
+		const float z = (c * b0z) + (s * b1z);
+		const float lengthSquared = (x * x) + (y * y) + (z * z);
+		const float scale = lengthSquared > 0.f ? 1.f / std::sqrt(lengthSquared) : 0.f;
+
+		nxs[i] = x * scale;
+		nys[i] = y * scale;
+		nzs[i] = z * scale;
+	}
+
+	// Added to those of the tube above, when there is one
+	if (e0Above) {
+
+		const float c0x = static_cast<float>(e0Above[0]), c0y = static_cast<float>(e0Above[1]), c0z = static_cast<float>(e0Above[2]);
+		const float c1x = static_cast<float>(e1Above[0]), c1y = static_cast<float>(e1Above[1]), c1z = static_cast<float>(e1Above[2]);
+
+		for (int i = 0; i < sides; i++) {
+
+			const float c = static_cast<float>(cosines[i]);
+			const float s = static_cast<float>(sines[i]);
+
+			const float x = (c * c0x) + (s * c1x);
+			const float y = (c * c0y) + (s * c1y);
+			const float z = (c * c0z) + (s * c1z);
+			const float lengthSquared = (x * x) + (y * y) + (z * z);
+			const float scale = lengthSquared > 0.f ? 1.f / std::sqrt(lengthSquared) : 0.f;
+
+			nxs[i] += x * scale;
+			nys[i] += y * scale;
+			nzs[i] += z * scale;
+		}
+	}
+
+	for (int i = 0; i < sides; i++) {
+
+		const float c = static_cast<float>(cosines[i]);
+		const float s = static_cast<float>(sines[i]);
+
+		// Where the tubes' normals cancel, or there is no tube, the normal points straight out from the center
+		const float lengthSquared = (nxs[i] * nxs[i]) + (nys[i] * nys[i]) + (nzs[i] * nzs[i]);
+		const bool radial = lengthSquared < 1e-6f;
+
+		float nx = radial ? (c * a0x) + (s * a1x) : nxs[i];
+		float ny = radial ? (c * a0y) + (s * a1y) : nys[i];
+		float nz = radial ? (c * a0z) + (s * a1z) : nzs[i];
+		const float normalSquared = (nx * nx) + (ny * ny) + (nz * nz);
+		const float normalScale = normalSquared > 0.f ? 1.f / std::sqrt(normalSquared) : 0.f;
+
+		nx *= normalScale;
+		ny *= normalScale;
+		nz *= normalScale;
+
+		// The way around the ring, turned to lie flat against the normal
+		float tx = (c * a1x) - (s * a0x);
+		float ty = (c * a1y) - (s * a0y);
+		float tz = (c * a1z) - (s * a0z);
+		const float along = (tx * nx) + (ty * ny) + (tz * nz);
+
+		tx -= nx * along;
+		ty -= ny * along;
+		tz -= nz * along;
+		const float tangentSquared = (tx * tx) + (ty * ty) + (tz * tz);
+		const float tangentScale = tangentSquared > 0.f ? 1.f / std::sqrt(tangentSquared) : 0.f;
+
+		nxs[i] = nx;
+		nys[i] = ny;
+		nzs[i] = nz;
+		txs[i] = tx * tangentScale;
+		tys[i] = ty * tangentScale;
+		tzs[i] = tz * tangentScale;
+	}
+}
+
+void makeRingNormalsAndTangents(const RingTable& table, const double e0[3], const double e1[3], const double e0Below[3], const double e1Below[3], const double* e0Above, const double* e1Above,
+	float* nxs, float* nys, float* nzs, float* txs, float* tys, float* tzs) {
+
+	dispatchSides(table.sides, [&](auto fixedSides) {
+
+		ringNormals<decltype(fixedSides)::value>(table, e0, e1, e0Below, e1Below, e0Above, e1Above, nxs, nys, nzs, txs, tys, tzs);
+	});
+}
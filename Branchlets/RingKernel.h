@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+// The cosine and sine of the angle of each vertex around a ring with a given number of sides, measured from the ring's
+// first vertex.  Padded with zeros to a multiple of 4 so that wide loads never run off the end
+struct RingTable {
+
+	int sides = 0;
+	std::vector<double> cosines;
+	std::vector<double> sines;
+
+	// The cosine of the angle between neighbouring vertices, in single precision as Branchlets::getVScaler() has always computed it
+	float cosWedge = 0.f;
+};
+
+// Get the table for rings with 'sides' vertices, computing it the first time it is asked for.  The returned reference stays
+// valid for the life of the program, and this is safe to call from several threads at once
+const RingTable& getRingTable(int sides);
+
+// The same as getRingTable(sides), except that when 'Sides' is more than 0 it is the number of sides, and the table is only looked
+// up on the first call rather than under a lock on every call
+template <int Sides>
+const RingTable& getRingTableFor(int sides) {
+
+	if constexpr (Sides > 0) {
+
+		static const RingTable& table = getRingTable(Sides);
+		return table;
+	}
+	else {
+
+		return getRingTable(sides);
+	}
+}
+
+// Write the positions center + (cos * e0) + (sin * e1) for every entry in 'table' to the coordinate arrays 'xs', 'ys' and 'zs'.
+// This uses AVX when the build targets it, SSE2 on other x86 builds, and plain scalar code everywhere else.  The side counts in
+// FixedSides.h each have their own copy with the loop length fixed at compile time
+void makeRingPositions(const RingTable& table, const double center[3], const double e0[3], const double e1[3], float* xs, float* ys, float* zs);
+
+// Write the unit normal and tangent of every vertex of a ring made by makeRingPositions() with 'e0' and 'e1' to 'nxs', 'nys', 'nzs'
+// and 'txs', 'tys', 'tzs'.  'e0Below' and 'e1Below' are the parts of e0 and e1 at right angles to the tube below the ring, and
+// 'e0Above' and 'e1Above' those for the tube above it, or null for a ring on a single tube.  Each normal is halfway between those
+// of the tubes, or points straight out from the center where they cancel, and each tangent runs around the ring the way the
+// vertices are numbered.  This works in single precision, which is all the normals are kept in
+void makeRingNormalsAndTangents(const RingTable& table, const double e0[3], const double e1[3], const double e0Below[3], const double e1Below[3], const double* e0Above, const double* e1Above,
+	float* nxs, float* nys, float* nzs, float* txs, float* tys, float* tzs);
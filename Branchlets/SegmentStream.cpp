@@ -0,0 +1,212 @@
+#include "SegmentStream.h"
+#include "MMesh.h"
+
+#include <climits>
+#include <cstring>
+
+// The size in bytes of a branchlet's header and of one segment in the file
+static const size_t branchHeaderSize = 6 * 4;
+static const size_t segmentSize = 4 * 4;
+
+// Streams are given a buffer this large so that small writes are batched into large ones
+static const size_t fileBufferSize = 1 << 20;
+
+template <class T>
+static void writeRaw(std::ostream& out, const T* data, size_t count) {
+
+	out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+void StreamBranch::getSegments(std::vector<BSegment>& segs) const {
+
+	segs.clear();
+
+	for (int i = 0; i < segmentCount; i++) {
+
+		const float* segment = segments + (i * 4);
+		segs.emplace_back(BVector(segment[0], segment[1], segment[2]), segment[3]);
+	}
+}
+
+SegmentStream::SegmentStream(const std::string& filePath) {
+
+	open(filePath);
+}
+
+SegmentStream::~SegmentStream() {
+
+	close();
+}
+
+bool SegmentStream::open(const std::string& filePath) {
+
+	close();
+
+	// The file is read from front to back, so ask for it to be read ahead
+	if (!file.open(filePath, true))
+		return false;
+
+	if (!index(filePath)) {
+
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool SegmentStream::index(const std::string& filePath) {
+
+	const char* data = file.data();
+	const size_t size = file.size();
+	SegmentStreamHeader header;
+	SegmentStreamHeader expected;
+
+	if (size < sizeof(header)) {
+
+		MMesh::displayWarning(filePath + " is too short to be a segment stream");
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version) {
+
+		MMesh::displayWarning(filePath + " is not a version " + std::to_string(expected.version) + " segment stream");
+		return false;
+	}
+
+	if (header.branchCount > (size - sizeof(header)) / (branchHeaderSize + segmentSize)) {
+
+		MMesh::displayWarning(filePath + " is too short for its " + std::to_string(header.branchCount) + " branchlets");
+		return false;
+	}
+
+	// Every branchlet is checked to lie within the file here, so that reading them later needs no checks
+	branchOffsets.resize(header.branchCount);
+	segmentTotal = 0;
+
+	size_t offset = sizeof(header);
+	for (uint32_t i = 0; i < header.branchCount; i++) {
+
+		if (size - offset < branchHeaderSize) {
+
+			MMesh::displayWarning(filePath + " ends part way through branchlet " + std::to_string(i));
+			return false;
+		}
+
+		int32_t sides;
+		std::memcpy(&sides, data + offset + (3 * 4), 4);
+
+		if (sides < 0 || sides == 1 || sides > SegmentStream::maxSides) {
+
+			MMesh::displayWarning(filePath + " has a bad side count for branchlet " + std::to_string(i));
+			return false;
+		}
+
+		uint32_t segmentCount;
+		std::memcpy(&segmentCount, data + offset + (5 * 4), 4);
+
+		if (segmentCount == 0 || (size - offset - branchHeaderSize) / segmentSize < segmentCount) {
+
+			MMesh::displayWarning(filePath + " has a bad segment count for branchlet " + std::to_string(i));
+			return false;
+		}
+
+		// Face connects are the largest of a branchlet's counts, and one with 0 sides may be given up to the most there can be
+		const long long connectSides = sides == 0 ? SegmentStream::maxSides : sides;
+		if ((static_cast<long long>(segmentCount) * connectSides * 4) + (connectSides * 3) > INT_MAX) {
+
+			MMesh::displayWarning(filePath + " has too many segments in branchlet " + std::to_string(i) + " for one mesh");
+			return false;
+		}
+
+		branchOffsets[i] = offset;
+		offset += branchHeaderSize + (segmentCount * segmentSize);
+		segmentTotal += segmentCount;
+	}
+
+	return true;
+}
+
+void SegmentStream::close() {
+
+	file.close();
+	branchOffsets.clear();
+	segmentTotal = 0;
+}
+
+StreamBranch SegmentStream::branch(int branchIndex) const {
+
+	// Every field is 4 bytes from a 4 byte aligned offset, and the mapping is page aligned, so they can be read in place
+	const char* header = file.data() + branchOffsets[branchIndex];
+	const float* floats = reinterpret_cast<const float*>(header);
+
+	StreamBranch streamBranch;
+	streamBranch.startPoint = BVector(floats[0], floats[1], floats[2]);
+	std::memcpy(&streamBranch.sides, header + (3 * 4), 4);
+	streamBranch.vOffset = floats[4];
+	std::memcpy(&streamBranch.segmentCount, header + (5 * 4), 4);
+	streamBranch.segments = reinterpret_cast<const float*>(header + branchHeaderSize);
+
+	return streamBranch;
+}
+
+SegmentStreamWriter::SegmentStreamWriter(const std::string& filePath) : path(filePath) {
+
+	// The buffer has to be in place before the file is opened for it to be used
+	fileBuffer.resize(fileBufferSize);
+	file.rdbuf()->pubsetbuf(fileBuffer.data(), fileBuffer.size());
+	file.open(filePath, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open()) {
+
+		MMesh::displayWarning("Could not open " + filePath + " for writing");
+		return;
+	}
+
+	// The counts are filled in by finish()
+	writeRaw(file, &header, 1);
+}
+
+void SegmentStreamWriter::write(const BVector& startPoint, const std::vector<BSegment>& segments, float vOffset, int sides) {
+
+	if (!isOpen() || segments.empty())
+		return;
+
+	const float start[3] = { static_cast<float>(startPoint.x), static_cast<float>(startPoint.y), static_cast<float>(startPoint.z) };
+	const int32_t branchSides = sides;
+	const uint32_t segmentCount = static_cast<uint32_t>(segments.size());
+
+	writeRaw(file, start, 3);
+	writeRaw(file, &branchSides, 1);
+	writeRaw(file, &vOffset, 1);
+	writeRaw(file, &segmentCount, 1);
+
+	for (const BSegment& segment : segments) {
+
+		const float values[4] = { static_cast<float>(segment.v.x), static_cast<float>(segment.v.y), static_cast<float>(segment.v.z), segment.r };
+		writeRaw(file, values, 4);
+	}
+
+	header.branchCount++;
+	header.segmentCount += segmentCount;
+}
+
+bool SegmentStreamWriter::finish() {
+
+	if (!isOpen())
+		return false;
+
+	file.seekp(0);
+	writeRaw(file, &header, 1);
+
+	file.flush();
+	bool succeeded = !file.fail();
+	file.close();
+
+	if (!succeeded)
+		MMesh::displayWarning("Failed to write " + path);
+
+	return succeeded;
+}
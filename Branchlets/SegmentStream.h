@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Branchlets.h"
+#include "MappedFile.h"
+
+// A compact binary file of branchlets, for trees made outside of Maya with far more segments than are practical to hold as
+// BSegments.  It is read through a memory mapping, so opening it costs nothing beyond finding where each branchlet starts.
+// Every value is 4 bytes and little endian:
+//
+//     header:    "BSEG", uint32 version, uint32 branch count, uint32 0, uint64 segment count
+//     branchlet: float start point x, y, z, int32 sides, float vOffset, uint32 segment count
+//     segment:   float vector x, y, z, float radius
+//
+// Each branchlet is followed straight away by its segments.  A branchlet's sides may be 0 to use those of the mesh it is added to,
+// 2 to make it a strip, or from 3 up to SegmentStream::maxSides
+struct SegmentStreamHeader {
+
+	char magic[4] = { 'B', 'S', 'E', 'G' };
+	uint32_t version = 1;
+	uint32_t branchCount = 0;
+	uint32_t reserved = 0;
+	uint64_t segmentCount = 0;
+};
+
+// One branchlet of a mapped SegmentStream.  'segments' points into the mapping, 4 floats per segment
+struct StreamBranch {
+
+	BVector startPoint;
+	int sides = 0;
+	float vOffset = 0.f;
+	int segmentCount = 0;
+	const float* segments = nullptr;
+
+	// Convert the segments to BSegments, reusing the memory of 'segs'
+	void getSegments(std::vector<BSegment>& segs) const;
+};
+
+// A segment stream file mapped into memory for reading
+class SegmentStream {
+
+	MappedFile file;
+
+	// Where each branchlet's header is in the mapping
+	std::vector<size_t> branchOffsets;
+	long long segmentTotal = 0;
+
+	// Check the header and find every branchlet, returning false if the file is not a whole segment stream
+	bool index(const std::string& filePath);
+
+public:
+
+	// The most sides a branchlet in a stream may have
+	static const int maxSides = 1024;
+
+	SegmentStream() {}
+
+	// Map 'filePath'.  Shows a warning and leaves the stream closed if it can't be mapped or isn't a segment stream
+	SegmentStream(const std::string& filePath);
+
+	SegmentStream(const SegmentStream&) = delete;
+
+	SegmentStream& operator=(const SegmentStream&) = delete;
+
+	~SegmentStream();
+
+	// Map 'filePath', closing whatever was mapped before.  Returns false and shows a warning if it fails
+	bool open(const std::string& filePath);
+
+	void close();
+
+	bool isOpen() const { return file.isOpen(); }
+
+	int branchCount() const { return static_cast<int>(branchOffsets.size()); }
+
+	long long segmentCount() const { return segmentTotal; }
+
+	// Get the branchlet at 'branchIndex', which must be less than branchCount()
+	StreamBranch branch(int branchIndex) const;
+};
+
+// Writes branchlets to a segment stream file one at a time.  The counts in the header are filled in by finish()
+class SegmentStreamWriter {
+
+	std::string path;
+	std::ofstream file;
+	std::vector<char> fileBuffer;
+	SegmentStreamHeader header;
+
+public:
+
+	SegmentStreamWriter(const std::string& filePath);
+
+	SegmentStreamWriter(const SegmentStreamWriter&) = delete;
+
+	SegmentStreamWriter& operator=(const SegmentStreamWriter&) = delete;
+
+	bool isOpen() const { return file.is_open(); }
+
+	// Append a branchlet.  A 'sides' of 0 leaves the number of sides to the mesh it is added to
+	void write(const BVector& startPoint, const std::vector<BSegment>& segments, float vOffset, int sides = 0);
+
+	// Fill in the header and close the file.  Returns false if anything failed to write
+	bool finish();
+};
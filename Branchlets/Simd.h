@@ -0,0 +1,26 @@
+#pragma once
+
+// Picks the widest instruction set the build targets for the hand-vectorized kernels.  Define BRANCHLETS_NO_SIMD to force the
+// plain scalar code paths everywhere
+
+#if !defined(BRANCHLETS_NO_SIMD)
+
+#if defined(__AVX2__)
+#define BRANCHLETS_AVX2
+#endif
+
+#if defined(__AVX__) || defined(__AVX2__)
+#define BRANCHLETS_AVX
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BRANCHLETS_SSE2
+#endif
+
+#endif
+
+#if defined(BRANCHLETS_AVX) || defined(BRANCHLETS_AVX2)
+#include <immintrin.h>
+#elif defined(BRANCHLETS_SSE2)
+#include <emmintrin.h>
+#endif
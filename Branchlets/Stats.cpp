@@ -0,0 +1,278 @@
+#include "Stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+static const int phaseCount = static_cast<int>(StatPhase::Count);
+static const int counterCount = static_cast<int>(StatCounter::Count);
+
+struct TraceEvent {
+
+	StatPhase phase;
+	int thread;
+	long long startNanoseconds;
+	long long durationNanoseconds;
+};
+
+// Each thread adds up its own timers and counters and records its own traced scopes, so that threads never contend for a cache
+// line or wait on each other, even for phases that are timed once per ring.  Only the thread itself writes them, so they are
+// atomic only so that getGenerationStats() can read them from another thread, and never need a locked add
+struct ThreadStats {
+
+	std::atomic<long long> phaseCalls[phaseCount] = {};
+	std::atomic<long long> phaseNanoseconds[phaseCount] = {};
+	std::atomic<long long> counters[counterCount] = {};
+
+	// The thread's number in traces
+	int thread = 0;
+
+	// The thread's traced scopes, which writeChromeTrace() may read while it is still adding to them.  Only the thread itself and
+	// the functions below ever take the lock, so it is almost never contended
+	std::mutex eventMutex;
+	std::vector<TraceEvent> events;
+};
+
+static void add(std::atomic<long long>& total, long long amount) {
+
+	total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static std::atomic<bool> tracing(false);
+static std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+// The threads that have gathered anything and are still running.  parallelFor() starts new threads on every call, so when a
+// thread exits its totals and traced scopes are moved into 'retired' and its trace number is freed for the next one, rather
+// than keeping an entry for every thread there has ever been
+static std::mutex statsMutex;
+static std::vector<ThreadStats*> liveThreads;
+static std::vector<int> freeThreadNumbers;
+static int threadNumbers = 0;
+static GenerationStats retired;
+static std::vector<TraceEvent> retiredEvents;
+
+// Registers a thread's stats the first time it gathers anything, and retires them when it exits
+class LocalStats {
+
+public:
+
+	ThreadStats stats;
+
+	LocalStats() {
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		if (freeThreadNumbers.empty()) {
+
+			stats.thread = ++threadNumbers;
+		}
+		else {
+
+			stats.thread = freeThreadNumbers.back();
+			freeThreadNumbers.pop_back();
+		}
+
+		liveThreads.push_back(&stats);
+	}
+
+	~LocalStats() {
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		for (int i = 0; i < phaseCount; i++) {
+
+			retired.phaseCalls[i] += stats.phaseCalls[i].load();
+			retired.phaseNanoseconds[i] += stats.phaseNanoseconds[i].load();
+		}
+
+		for (int i = 0; i < counterCount; i++)
+			retired.counters[i] += stats.counters[i].load();
+
+		retiredEvents.insert(retiredEvents.end(), stats.events.begin(), stats.events.end());
+
+		liveThreads.erase(std::find(liveThreads.begin(), liveThreads.end(), &stats));
+		freeThreadNumbers.push_back(stats.thread);
+	}
+};
+
+static ThreadStats& localStats() {
+
+	thread_local LocalStats local;
+	return local.stats;
+}
+
+StatTimer::~StatTimer() {
+
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	const long long nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	ThreadStats& stats = localStats();
+	add(stats.phaseCalls[static_cast<int>(phase)], 1);
+	add(stats.phaseNanoseconds[static_cast<int>(phase)], nanoseconds);
+
+	if (tracing.load(std::memory_order_relaxed)) {
+
+		const long long startNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(start - traceEpoch).count();
+		std::lock_guard<std::mutex> lock(stats.eventMutex);
+		stats.events.push_back({ phase, stats.thread, startNanoseconds, nanoseconds });
+	}
+}
+
+void addStatCount(StatCounter counter, long long amount) {
+
+	add(localStats().counters[static_cast<int>(counter)], amount);
+}
+
+GenerationStats getGenerationStats() {
+
+	std::lock_guard<std::mutex> lock(statsMutex);
+
+	GenerationStats stats = retired;
+
+	for (const ThreadStats* thread : liveThreads) {
+
+		for (int i = 0; i < phaseCount; i++) {
+
+			stats.phaseCalls[i] += thread->phaseCalls[i].load();
+			stats.phaseNanoseconds[i] += thread->phaseNanoseconds[i].load();
+		}
+
+		for (int i = 0; i < counterCount; i++)
+			stats.counters[i] += thread->counters[i].load();
+	}
+
+	return stats;
+}
+
+void resetGenerationStats() {
+
+	std::lock_guard<std::mutex> lock(statsMutex);
+
+	retired = GenerationStats();
+	retiredEvents.clear();
+
+	for (ThreadStats* thread : liveThreads) {
+
+		for (int i = 0; i < phaseCount; i++) {
+
+			thread->phaseCalls[i] = 0;
+			thread->phaseNanoseconds[i] = 0;
+		}
+
+		for (int i = 0; i < counterCount; i++)
+			thread->counters[i] = 0;
+
+		std::lock_guard<std::mutex> eventLock(thread->eventMutex);
+		thread->events.clear();
+	}
+
+	traceEpoch = std::chrono::steady_clock::now();
+}
+
+void setStatTracing(bool enabled) {
+
+	tracing = enabled;
+}
+
+bool writeChromeTrace(const std::string& path) {
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	file << "{\"traceEvents\":[";
+
+	// Chrome trace times are in microseconds
+	bool first = true;
+	char event[256];
+
+	auto write = [&](const TraceEvent& traced) {
+
+		std::snprintf(event, sizeof(event), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",",
+			GenerationStats::name(traced.phase), traced.thread, traced.startNanoseconds / 1e3, traced.durationNanoseconds / 1e3);
+
+		file << event;
+		first = false;
+	};
+
+	std::lock_guard<std::mutex> lock(statsMutex);
+
+	for (const TraceEvent& traced : retiredEvents)
+		write(traced);
+
+	for (ThreadStats* thread : liveThreads) {
+
+		std::lock_guard<std::mutex> eventLock(thread->eventMutex);
+		for (const TraceEvent& traced : thread->events)
+			write(traced);
+	}
+
+	file << "\n]}\n";
+	file.close();
+
+	return !file.fail();
+}
+
+std::string GenerationStats::toJson() const {
+
+	std::ostringstream json;
+
+	json << "{\n\t\"phases\": {";
+	for (int i = 0; i < phaseCount; i++) {
+
+		json << (i > 0 ? "," : "") << "\n\t\t\"" << name(static_cast<StatPhase>(i)) << "\": { \"calls\": " << phaseCalls[i]
+			<< ", \"milliseconds\": " << (phaseNanoseconds[i] / 1e6) << " }";
+	}
+
+	json << "\n\t},\n\t\"counters\": {";
+	for (int i = 0; i < counterCount; i++)
+		json << (i > 0 ? "," : "") << "\n\t\t\"" << name(static_cast<StatCounter>(i)) << "\": " << counters[i];
+
+	json << "\n\t}\n}\n";
+
+	return json.str();
+}
+
+const char* GenerationStats::name(StatPhase phase) {
+
+	switch (phase) {
+
+	case StatPhase::AddOne: return "addOne";
+	case StatPhase::AddMany: return "addMany";
+	case StatPhase::AddStream: return "addStream";
+	case StatPhase::AddInstances: return "addInstances";
+	case StatPhase::CreateLevels: return "createLevels";
+	case StatPhase::UpdateBranch: return "updateBranch";
+	case StatPhase::MakeVertexCoords: return "makeVertexCoords";
+	case StatPhase::FindEllipseVectors: return "findEllipseVectors";
+	case StatPhase::MakeVertexRing: return "makeVertexRing";
+	case StatPhase::MakeUVs: return "makeUVs";
+	case StatPhase::MakeConnects: return "makeConnects";
+	case StatPhase::CreateMesh: return "createMesh";
+	case StatPhase::UpdateMesh: return "updateMesh";
+	case StatPhase::ExportWrite: return "exportWrite";
+	case StatPhase::OptimizeVertexCache: return "optimizeVertexCache";
+	default: return "unknown";
+	}
+}
+
+const char* GenerationStats::name(StatCounter counter) {
+
+	switch (counter) {
+
+	case StatCounter::Branches: return "branches";
+	case StatCounter::Segments: return "segments";
+	case StatCounter::Rings: return "rings";
+	case StatCounter::EllipseFallbacks: return "ellipseFallbacks";
+	case StatCounter::Vertices: return "vertices";
+	case StatCounter::UVs: return "uvs";
+	case StatCounter::Faces: return "faces";
+	case StatCounter::ArrayGrowths: return "arrayGrowths";
+	case StatCounter::ArrayBytes: return "arrayBytes";
+	default: return "unknown";
+	}
+}
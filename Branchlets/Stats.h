@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Timers and counters for each phase of generation.  They are only gathered when BRANCHLETS_STATS is defined; otherwise the
+// BRANCHLETS_TIME and BRANCHLETS_COUNT macros expand to nothing and cost nothing, and the functions below report all zeros.
+// Phase times are inclusive, so a phase that calls another (e.g. makeVertexCoords calling findEllipseVectors) counts both.
+// Each thread keeps its own totals, which are only added up when they are read, so timing a phase once per ring doesn't make
+// threads contend
+
+enum class StatPhase {
+
+	AddOne,
+	AddMany,
+	AddStream,
+	AddInstances,
+	CreateLevels,
+	UpdateBranch,
+	MakeVertexCoords,
+	FindEllipseVectors,
+	MakeVertexRing,
+	MakeUVs,
+	MakeConnects,
+	CreateMesh,
+	UpdateMesh,
+	ExportWrite,
+	OptimizeVertexCache,
+	Count
+};
+
+enum class StatCounter {
+
+	Branches,
+	Segments,
+	Rings,
+
+	// The number of times findEllipseVectors() found that two segments couldn't intersect (d < bottomSeg.r * 1.1) and fell back
+	// to a circle around their combined vector
+	EllipseFallbacks,
+
+	Vertices,
+	UVs,
+	Faces,
+
+	// The number of times setCounts() had to reallocate the mesh arrays, and the bytes those reallocations added
+	ArrayGrowths,
+	ArrayBytes,
+	Count
+};
+
+// A snapshot of every timer and counter
+struct GenerationStats {
+
+	long long phaseCalls[static_cast<int>(StatPhase::Count)] = {};
+	long long phaseNanoseconds[static_cast<int>(StatPhase::Count)] = {};
+	long long counters[static_cast<int>(StatCounter::Count)] = {};
+
+	long long calls(StatPhase phase) const { return phaseCalls[static_cast<int>(phase)]; }
+
+	double milliseconds(StatPhase phase) const { return phaseNanoseconds[static_cast<int>(phase)] / 1e6; }
+
+	long long count(StatCounter counter) const { return counters[static_cast<int>(counter)]; }
+
+	// Every timer and counter as a JSON object
+	std::string toJson() const;
+
+	static const char* name(StatPhase phase);
+
+	static const char* name(StatCounter counter);
+};
+
+// Take a snapshot of the timers and counters gathered since the last reset
+GenerationStats getGenerationStats();
+
+// Zero every timer and counter, and forget any traced scopes.  Don't call this while branchlets are being generated
+void resetGenerationStats();
+
+// Also record the start and end of every timed scope, so they can be written out with writeChromeTrace().  Off by default,
+// since it stores an event for every scope, and fine grained phases like makeVertexRing are entered once per ring
+void setStatTracing(bool enabled);
+
+// Write the scopes recorded while tracing was on in Chrome's trace event format, which chrome://tracing and Perfetto can open.
+// This may be called while branchlets are being generated, and then writes the scopes that have ended so far.  Returns false if
+// the file couldn't be written
+bool writeChromeTrace(const std::string& path);
+
+// Add to a counter.  Use BRANCHLETS_COUNT rather than calling this directly
+void addStatCount(StatCounter counter, long long amount);
+
+// Times the scope it is declared in.  Use BRANCHLETS_TIME rather than declaring this directly
+class StatTimer {
+
+	StatPhase phase;
+	std::chrono::steady_clock::time_point start;
+
+public:
+
+	StatTimer(StatPhase Phase) : phase(Phase), start(std::chrono::steady_clock::now()) {}
+
+	StatTimer(const StatTimer&) = delete;
+
+	StatTimer& operator=(const StatTimer&) = delete;
+
+	~StatTimer();
+};
+
+#ifdef BRANCHLETS_STATS
+#define BRANCHLETS_STAT_JOIN2(a, b) a##b
+#define BRANCHLETS_STAT_JOIN(a, b) BRANCHLETS_STAT_JOIN2(a, b)
+#define BRANCHLETS_TIME(phase) StatTimer BRANCHLETS_STAT_JOIN(statTimer, __LINE__)(phase)
+#define BRANCHLETS_COUNT(counter, amount) addStatCount(counter, amount)
+#else
+#define BRANCHLETS_TIME(phase) ((void)0)
+#define BRANCHLETS_COUNT(counter, amount) ((void)0)
+#endif
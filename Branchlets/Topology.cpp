@@ -0,0 +1,220 @@
+#include "Topology.h"
+#include "Simd.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+// Calculate all face connects for a branchlet
+static void makeFaceConnects(const int segmentCount, const int sides, std::vector<int>& faceConnects) {
+
+	// For each 4 sided face added we have to specify the indices of the verts that make up its 4 corners - these indices are the faceConnects
+	// For each face, they start on the lower left and move counter-clockwise
+	for (int i = 0; i < segmentCount; i++) {
+
+		const int firstCornerIndex = i * sides;
+		int nextCornerIndex = firstCornerIndex;
+
+		for (int j = 0; j < sides - 1; j++) {
+
+			faceConnects.push_back(nextCornerIndex);
+			faceConnects.push_back(nextCornerIndex + 1);
+			faceConnects.push_back(nextCornerIndex + 1 + sides);
+			faceConnects.push_back(nextCornerIndex + sides);
+
+			nextCornerIndex++;
+		}
+
+		//The pattern for faceConnects is a bit different for the last side in every ring of sides
+		faceConnects.push_back(nextCornerIndex);
+		faceConnects.push_back(firstCornerIndex);
+		faceConnects.push_back(firstCornerIndex + sides);
+		faceConnects.push_back(nextCornerIndex + sides);
+	}
+
+	// Finally add the face connects for the triangles connecting the last vertex ring and the cap vertex
+	const int firstCornerIndex = segmentCount * sides;
+	const int capVertIndex = firstCornerIndex + sides;
+	int nextCornerIndex = firstCornerIndex;
+
+	for (int i = 0; i < sides - 1; i++) {
+
+		faceConnects.push_back(nextCornerIndex);
+		faceConnects.push_back(nextCornerIndex + 1);
+		faceConnects.push_back(capVertIndex);
+
+		nextCornerIndex++;
+	}
+
+	faceConnects.push_back(nextCornerIndex);
+	faceConnects.push_back(firstCornerIndex);
+	faceConnects.push_back(capVertIndex);
+}
+
+// Calculate all face connects for a strip
+static void makeStripFaceConnects(const int segmentCount, std::vector<int>& faceConnects) {
+
+	int nextCornerIndex;
+
+	for (int i = 0; i < segmentCount; i++) {
+
+		nextCornerIndex = i * 2;
+		faceConnects.push_back(nextCornerIndex);
+		faceConnects.push_back(nextCornerIndex + 1);
+		faceConnects.push_back(nextCornerIndex + 1 + 2);
+		faceConnects.push_back(nextCornerIndex + 2);
+	}
+
+	nextCornerIndex = segmentCount * 2;
+	faceConnects.push_back(nextCornerIndex);
+	faceConnects.push_back(nextCornerIndex + 1);
+	faceConnects.push_back(nextCornerIndex + 2);
+}
+
+// Calculate all face counts for a branchlet
+static void makeFaceCounts(const int segmentCount, const int sides, std::vector<int>& faceCounts) {
+
+	faceCounts.insert(faceCounts.end(), segmentCount * sides, 4);
+	faceCounts.insert(faceCounts.end(), sides, 3);
+}
+
+// Calculate all face counts for a strip
+static void makeStripFaceCounts(const int segmentCount, std::vector<int>& faceCounts) {
+
+	faceCounts.insert(faceCounts.end(), segmentCount, 4);
+	faceCounts.push_back(3);
+}
+
+// Calculate all uv connects for a branchlet
+static void makeUVConnects(const int sides, const int segmentCount, std::vector<int>& uvConnects) {
+
+	// This works much like creating faceConnects, except we have one additional column of uv's due to the vertical seam,
+	// meaning the uv's don't wrap around. So the code is the same for each face
+
+	int uvSides = sides + 1;
+	int uvLowerLeftCornerIndex = 0;
+
+	for (int i = 0; i < segmentCount; i++) {
+
+		for (int j = 0; j < sides; j++) {
+
+			uvConnects.push_back(uvLowerLeftCornerIndex);
+			uvConnects.push_back(uvLowerLeftCornerIndex + 1);
+			uvConnects.push_back(uvLowerLeftCornerIndex + 1 + uvSides);
+			uvConnects.push_back(uvLowerLeftCornerIndex + uvSides);
+
+			uvLowerLeftCornerIndex++;
+		}
+
+		uvLowerLeftCornerIndex++;
+	}
+
+	for (int i = 0; i < sides; i++) {
+
+		uvConnects.push_back(uvLowerLeftCornerIndex);
+		uvConnects.push_back(uvLowerLeftCornerIndex + 1);
+		uvConnects.push_back(uvLowerLeftCornerIndex + uvSides);
+
+		uvLowerLeftCornerIndex++;
+	}
+}
+
+// Calculate all uv connects for a strip
+static void makeStripUVConnects(const int segmentCount, std::vector<int>& uvConnects) {
+
+	// This works much like creating faceConnects, except we have one additional column of uv's due to the vertical seam,
+	// meaning the uv's don't wrap around so the code is the same for each face
+
+	int uvLowerLeftCornerIndex = 0;
+
+	for (int i = 0; i < segmentCount; i++) {
+
+		uvConnects.push_back(uvLowerLeftCornerIndex);
+		uvConnects.push_back(uvLowerLeftCornerIndex + 1);
+		uvConnects.push_back(uvLowerLeftCornerIndex + 3);
+		uvConnects.push_back(uvLowerLeftCornerIndex + 2);
+
+		uvLowerLeftCornerIndex += 2;
+	}
+
+	uvConnects.push_back(uvLowerLeftCornerIndex);
+	uvConnects.push_back(uvLowerLeftCornerIndex + 1);
+	uvConnects.push_back(uvLowerLeftCornerIndex + 2);
+}
+
+const TopologyTemplate& getTopologyTemplate(int segmentCount, int sides) {
+
+	static std::map<std::pair<int, int>, std::unique_ptr<TopologyTemplate>> templates;
+	static std::shared_mutex templatesMutex;
+
+	const std::pair<int, int> key(segmentCount, sides);
+
+	// Nearly every call finds an existing template, so look under a shared lock first and only take the exclusive lock to add one
+	{
+		std::shared_lock<std::shared_mutex> lock(templatesMutex);
+
+		auto found = templates.find(key);
+		if (found != templates.end())
+			return *found->second;
+	}
+
+	std::unique_ptr<TopologyTemplate> topology(new TopologyTemplate());
+
+	if (sides == 2) {
+
+		makeStripFaceConnects(segmentCount, topology->faceConnects);
+		makeStripFaceCounts(segmentCount, topology->faceCounts);
+		makeStripUVConnects(segmentCount, topology->uvConnects);
+	}
+	else {
+
+		makeFaceConnects(segmentCount, sides, topology->faceConnects);
+		makeFaceCounts(segmentCount, sides, topology->faceCounts);
+		makeUVConnects(sides, segmentCount, topology->uvConnects);
+	}
+
+	std::unique_lock<std::shared_mutex> lock(templatesMutex);
+
+	// Another thread may have added the same template while this one was building it, in which case theirs is kept
+	auto inserted = templates.emplace(key, std::move(topology));
+	return *inserted.first->second;
+}
+
+void copyWithOffset(const int* source, int count, int offset, int* dest) {
+
+	if (offset == 0) {
+
+		std::memcpy(dest, source, count * sizeof(int));
+		return;
+	}
+
+	int i = 0;
+
+#if defined(BRANCHLETS_AVX2)
+
+	const __m256i offsets = _mm256_set1_epi32(offset);
+
+	for (; i + 8 <= count; i += 8) {
+
+		const __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + i));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_add_epi32(indices, offsets));
+	}
+
+#elif defined(BRANCHLETS_SSE2)
+
+	const __m128i offsets = _mm_set1_epi32(offset);
+
+	for (; i + 4 <= count; i += 4) {
+
+		const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_add_epi32(indices, offsets));
+	}
+
+#endif
+
+	for (; i < count; i++)
+		dest[i] = source[i] + offset;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+// The face counts, face connects and uv connects of a single branchlet.  These depend only on its segment count and number of
+// sides, so they are built once with vertex and uv indices starting at 0, then copied into a mesh with an offset added
+struct TopologyTemplate {
+
+	std::vector<int> faceCounts;
+	std::vector<int> faceConnects;
+	std::vector<int> uvConnects;
+};
+
+// Get the template for a branchlet with 'segmentCount' segments and 'sides' sides, where 2 sides means a strip.  It is built
+// the first time it is asked for, and the returned reference stays valid for the life of the program.  Safe to call from several
+// threads at once
+const TopologyTemplate& getTopologyTemplate(int segmentCount, int sides);
+
+// Write source[i] + offset to dest[i] for the first 'count' elements of 'source'
+void copyWithOffset(const int* source, int count, int offset, int* dest);
@@ -0,0 +1,303 @@
+#include "VertexCache.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <utility>
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+
+	triangles += other.triangles;
+	missesBefore += other.missesBefore;
+	missesAfter += other.missesAfter;
+
+	return *this;
+}
+
+// Count the misses of drawing the faces of 'mesh' in 'faceOrder', or in their own order if it is null.  'cornerStarts' holds
+// where each face's corners start, and 'entryTimes' is used to hold the miss count at which each vertex last entered the cache
+static long long countMisses(const MeshBuffer& mesh, const std::vector<int>& cornerStarts, const std::vector<int>* faceOrder, int cacheSize, std::vector<int>& entryTimes) {
+
+	entryTimes.assign(mesh.xs.size(), -(cacheSize + 1));
+
+	// A vertex is still in a first in, first out cache until 'cacheSize' other vertices have entered after it
+	int misses = 0;
+	auto use = [&](int vert) {
+
+		if (misses - entryTimes[vert] > cacheSize) {
+
+			entryTimes[vert] = misses;
+			misses++;
+		}
+	};
+
+	const int faceCount = static_cast<int>(mesh.faceCounts.size());
+	for (int i = 0; i < faceCount; i++) {
+
+		const int face = faceOrder != nullptr ? (*faceOrder)[i] : i;
+		const int first = cornerStarts[face];
+		const int last = cornerStarts[face + 1] - 1;
+
+		for (int corner = first + 1; corner < last; corner++) {
+
+			use(mesh.faceConnects[first]);
+			use(mesh.faceConnects[corner]);
+			use(mesh.faceConnects[corner + 1]);
+		}
+	}
+
+	return misses;
+}
+
+// Find where each face's corners start in faceConnects, with the end of the last face after it
+static void findCornerStarts(const MeshBuffer& mesh, std::vector<int>& cornerStarts) {
+
+	const int faceCount = static_cast<int>(mesh.faceCounts.size());
+	cornerStarts.resize(faceCount + 1);
+	cornerStarts[0] = 0;
+
+	for (int face = 0; face < faceCount; face++)
+		cornerStarts[face + 1] = cornerStarts[face] + mesh.faceCounts[face];
+}
+
+long long countCacheMisses(const MeshBuffer& mesh, int cacheSize) {
+
+	std::vector<int> cornerStarts;
+	std::vector<int> entryTimes;
+	findCornerStarts(mesh, cornerStarts);
+
+	return countMisses(mesh, cornerStarts, nullptr, cacheSize, entryTimes);
+}
+
+void VertexCacheOptimizer::orderFaces(const MeshBuffer& mesh) {
+
+	const int vertCount = static_cast<int>(mesh.xs.size());
+	const int faceCount = static_cast<int>(mesh.faceCounts.size());
+	const int cacheSize = settings.cacheSize;
+
+	findCornerStarts(mesh, cornerStarts);
+
+	// Count the faces of each vertex, then place them with a prefix sum over the counts
+	liveFaces.assign(vertCount, 0);
+	for (int vert : mesh.faceConnects)
+		liveFaces[vert]++;
+
+	faceStarts.resize(vertCount + 1);
+	faceStarts[0] = 0;
+	for (int vert = 0; vert < vertCount; vert++)
+		faceStarts[vert + 1] = faceStarts[vert] + liveFaces[vert];
+
+	vertFaces.resize(mesh.faceConnects.size());
+	newIndices.assign(faceStarts.begin(), faceStarts.end() - 1);
+
+	for (int face = 0; face < faceCount; face++)
+		for (int corner = cornerStarts[face]; corner < cornerStarts[face + 1]; corner++)
+			vertFaces[newIndices[mesh.faceConnects[corner]]++] = face;
+
+	cacheTimes.assign(vertCount, -(cacheSize + 1));
+	emitted.assign(faceCount, 0);
+	deadEnds.clear();
+	faceOrder.clear();
+
+	int time = 0;
+	int cursor = 0;
+	int fanVert = vertCount > 0 ? 0 : -1;
+
+	while (fanVert >= 0) {
+
+		// Emit every face around the vertex that hasn't been yet.  Their vertices are the candidates for the next one
+		candidates.clear();
+
+		for (int i = faceStarts[fanVert]; i < faceStarts[fanVert + 1]; i++) {
+
+			const int face = vertFaces[i];
+			if (emitted[face])
+				continue;
+
+			emitted[face] = 1;
+			faceOrder.push_back(face);
+
+			for (int corner = cornerStarts[face]; corner < cornerStarts[face + 1]; corner++) {
+
+				const int vert = mesh.faceConnects[corner];
+				deadEnds.push_back(vert);
+				candidates.push_back(vert);
+				liveFaces[vert]--;
+
+				if (time - cacheTimes[vert] > cacheSize) {
+
+					cacheTimes[vert] = time;
+					time++;
+				}
+			}
+		}
+
+		fanVert = nextVertex(vertCount, cursor, time);
+	}
+}
+
+int VertexCacheOptimizer::nextVertex(int vertCount, int& cursor, int time) {
+
+	const int cacheSize = settings.cacheSize;
+
+	// Prefer the candidate that has been in the cache longest but will still be there after its remaining faces are emitted,
+	// which Tipsify estimates as 2 new vertices per face
+	int best = -1;
+	int bestPriority = -1;
+
+	for (int vert : candidates) {
+
+		if (liveFaces[vert] <= 0)
+			continue;
+
+		int priority = 0;
+		if (time - cacheTimes[vert] + (2 * liveFaces[vert]) <= cacheSize)
+			priority = time - cacheTimes[vert];
+
+		if (priority > bestPriority) {
+
+			best = vert;
+			bestPriority = priority;
+		}
+	}
+
+	if (best >= 0)
+		return best;
+
+	// Otherwise go back to the most recently used vertex that still has faces, and failing that the next one in the input
+	while (!deadEnds.empty()) {
+
+		const int vert = deadEnds.back();
+		deadEnds.pop_back();
+
+		if (liveFaces[vert] > 0)
+			return vert;
+	}
+
+	for (; cursor < vertCount; cursor++)
+		if (liveFaces[cursor] > 0)
+			return cursor;
+
+	return -1;
+}
+
+VertexCacheStats VertexCacheOptimizer::optimize(MeshBuffer& mesh) {
+
+	BRANCHLETS_TIME(StatPhase::OptimizeVertexCache);
+
+	VertexCacheStats stats;
+	for (int faceCount : mesh.faceCounts)
+		stats.triangles += std::max(faceCount - 2, 0);
+
+	orderFaces(mesh);
+
+	// Misses don't depend on how vertices are numbered, so the two orders can be compared before anything is moved.  The order
+	// Branchlets makes, ring after ring, already reuses a whole ring when two rings fit in the cache, and is kept if it is as good
+	stats.missesBefore = countMisses(mesh, cornerStarts, nullptr, settings.cacheSize, cacheTimes);
+	stats.missesAfter = countMisses(mesh, cornerStarts, &faceOrder, settings.cacheSize, cacheTimes);
+
+	if (stats.missesAfter >= stats.missesBefore) {
+
+		for (int face = 0; face < static_cast<int>(faceOrder.size()); face++)
+			faceOrder[face] = face;
+
+		stats.missesAfter = stats.missesBefore;
+	}
+
+	const bool withNormals = mesh.withNormals;
+	const bool normals = mesh.hasNormals();
+	reordered.withNormals = normals;
+	reordered.resize(mesh.counts());
+
+	// Faces in their new order, with each vertex numbered by the first face to use it.  Any vertex no face uses goes at the end
+	const int vertCount = static_cast<int>(mesh.xs.size());
+	newIndices.assign(vertCount, -1);
+
+	int next = 0;
+	int face = 0;
+	int corner = 0;
+	for (int oldFace : faceOrder) {
+
+		const int faceCount = mesh.faceCounts[oldFace];
+		reordered.faceCounts[face++] = faceCount;
+
+		for (int oldCorner = cornerStarts[oldFace]; oldCorner < cornerStarts[oldFace + 1]; oldCorner++) {
+
+			const int vert = mesh.faceConnects[oldCorner];
+			if (newIndices[vert] < 0)
+				newIndices[vert] = next++;
+
+			reordered.faceConnects[corner++] = newIndices[vert];
+		}
+	}
+
+	for (int vert = 0; vert < vertCount; vert++) {
+
+		if (newIndices[vert] < 0)
+			newIndices[vert] = next++;
+
+		const int to = newIndices[vert];
+		reordered.xs[to] = mesh.xs[vert];
+		reordered.ys[to] = mesh.ys[vert];
+		reordered.zs[to] = mesh.zs[vert];
+
+		if (normals) {
+
+			reordered.nxs[to] = mesh.nxs[vert];
+			reordered.nys[to] = mesh.nys[vert];
+			reordered.nzs[to] = mesh.nzs[vert];
+			reordered.txs[to] = mesh.txs[vert];
+			reordered.tys[to] = mesh.tys[vert];
+			reordered.tzs[to] = mesh.tzs[vert];
+		}
+	}
+
+	// The same for the uvs, following the corners in their new order
+	const int uvCount = static_cast<int>(mesh.us.size());
+	newIndices.assign(uvCount, -1);
+
+	next = 0;
+	corner = 0;
+	for (int oldFace : faceOrder) {
+
+		for (int oldCorner = cornerStarts[oldFace]; oldCorner < cornerStarts[oldFace + 1]; oldCorner++) {
+
+			const int uv = mesh.uvConnects[oldCorner];
+			if (newIndices[uv] < 0)
+				newIndices[uv] = next++;
+
+			reordered.uvConnects[corner++] = newIndices[uv];
+		}
+	}
+
+	for (int uv = 0; uv < uvCount; uv++) {
+
+		if (newIndices[uv] < 0)
+			newIndices[uv] = next++;
+
+		reordered.us[newIndices[uv]] = mesh.us[uv];
+		reordered.vs[newIndices[uv]] = mesh.vs[uv];
+	}
+
+	// The old arrays are kept for the next call
+	std::swap(mesh, reordered);
+	mesh.withNormals = withNormals;
+
+	return stats;
+}
+
+void VertexCacheExporter::write(const MeshBuffer& piece) {
+
+	if (!isOpen())
+		return;
+
+	copy = piece;
+	totals += optimizer.optimize(copy);
+	target->write(copy);
+
+	written += piece.counts();
+}
+
+bool VertexCacheExporter::finish() {
+
+	return isOpen() && target->finish();
+}
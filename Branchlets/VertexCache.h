@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+
+#include "MeshBuffer.h"
+#include "MeshExporter.h"
+
+// How VertexCacheOptimizer simulates a GPU's cache of transformed vertices
+struct VertexCacheSettings {
+
+	// The number of vertices the cache holds.  Most GPUs behave like a cache of 16 to 32, and orders made for one size do well
+	// on the others
+	int cacheSize = 16;
+};
+
+// Cache misses before and after reordering, counted over the triangles engines split each face into, as glTF export does.
+// Results for several meshes can be added together
+struct VertexCacheStats {
+
+	long long triangles = 0;
+	long long missesBefore = 0;
+	long long missesAfter = 0;
+
+	// The average cache miss ratio: vertices transformed per triangle.  3 is no reuse at all, and long strips of quads approach 1
+	double acmrBefore() const { return triangles > 0 ? static_cast<double>(missesBefore) / triangles : 0.; }
+	double acmrAfter() const { return triangles > 0 ? static_cast<double>(missesAfter) / triangles : 0.; }
+
+	VertexCacheStats& operator+=(const VertexCacheStats& other);
+};
+
+// Reorders a finished mesh for real-time engines.  Faces are put in the order of Tipsify (Sander, Nehab and Barczak, 2007),
+// which fans around one vertex at a time and picks the next vertex among those still in the simulated cache, and then vertices
+// and uvs are renumbered in the order the faces first use them, so that each face's data is close in memory to the last face's.
+// Each face keeps its corners, so quads stay quads and winding is unchanged.  Every step is linear in the size of the mesh.
+//
+// This is an output stage: the mesh of a Branchlets object itself can't be reordered, since its records and updateBranch()
+// rely on each branchlet's elements being where they were generated, so it is used on a copy or through VertexCacheExporter.
+// Misses are counted by vertex index.  glTF vertices follow the uvs, which only differ from the vertices by the seam column of
+// each tube, so the order suits those as well
+class VertexCacheOptimizer {
+
+	VertexCacheSettings settings;
+
+	// The faces using each vertex, with those of vertex v from faceStarts[v] to faceStarts[v + 1]
+	std::vector<int> faceStarts;
+	std::vector<int> vertFaces;
+
+	// Where each face's corners start in faceConnects
+	std::vector<int> cornerStarts;
+
+	// Per vertex: faces not yet emitted, and the time it last entered the cache
+	std::vector<int> liveFaces;
+	std::vector<int> cacheTimes;
+
+	std::vector<char> emitted;
+	std::vector<int> deadEnds;
+	std::vector<int> candidates;
+	std::vector<int> faceOrder;
+	std::vector<int> newIndices;
+
+	// The reordered arrays, swapped into the mesh when done
+	MeshBuffer reordered;
+
+	// Put the faces of 'mesh' in Tipsify order in faceOrder
+	void orderFaces(const MeshBuffer& mesh);
+
+	// Pick the vertex to fan around next, or return -1 once every face has been emitted
+	int nextVertex(int vertCount, int& cursor, int time);
+
+public:
+
+	VertexCacheOptimizer(const VertexCacheSettings& settings = VertexCacheSettings()) : settings(settings) {}
+
+	// Reorder the faces, vertices and uvs of 'mesh' in place, along with its normals and tangents if it has them.  Its
+	// memory for scratch arrays is kept between calls
+	VertexCacheStats optimize(MeshBuffer& mesh);
+};
+
+// The number of cache misses drawing the faces of 'mesh' as fans of triangles, through a first in, first out cache of
+// 'cacheSize' vertices
+long long countCacheMisses(const MeshBuffer& mesh, int cacheSize);
+
+// Reorders every piece with a VertexCacheOptimizer before passing it on to another exporter, which it doesn't own.  Only the
+// piece being written is copied
+class VertexCacheExporter : public MeshExporter {
+
+	MeshExporter* target = nullptr;
+	VertexCacheOptimizer optimizer;
+	MeshBuffer copy;
+	VertexCacheStats totals;
+
+public:
+
+	VertexCacheExporter(MeshExporter* target, const VertexCacheSettings& settings = VertexCacheSettings()) : target(target), optimizer(settings) {}
+
+	bool isOpen() const override { return target != nullptr && target->isOpen(); }
+
+	void write(const MeshBuffer& piece) override;
+
+	bool finish() override;
+
+	// The misses of every piece written so far
+	const VertexCacheStats& stats() const { return totals; }
+};
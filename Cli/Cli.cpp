@@ -0,0 +1,137 @@
+// Turns a segment stream file (SegmentStream.h) into a mesh file without Maya.  Build this headless (BRANCHLETS_HEADLESS) and run e.g.
+//
+//     Cli forest.bseg forest.ply --sides 8 --threads 0 --batch 4096
+//
+// The output format is picked from the extension of the output path: .obj, .ply, or .gltf.  Branchlets whose stream sides are 0
+// get --sides sides, and those with 2 are made as strips.  The stream is read through a memory mapping and turned into mesh
+// 'batch' branchlets at a time, each batch being written to the file before the next is made, so neither the whole stream nor
+// the whole mesh is ever held in memory.  With --normals 1 every vertex also gets a normal, and a tangent in .gltf files.
+// --vertex-cache n reorders each batch for a GPU vertex cache of n entries on its way to the file (see VertexCache.h) and
+// reports the average cache miss ratio before and after
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "Branchlets.h"
+#include "MeshExporter.h"
+#include "Parallel.h"
+#include "SegmentStream.h"
+#include "VertexCache.h"
+
+// Make the exporter for 'path' from its extension, or return nullptr if it isn't one that can be written
+static std::unique_ptr<MeshExporter> makeExporter(const std::string& path, bool normals) {
+
+	size_t dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	if (extension == ".obj")
+		return std::make_unique<ObjExporter>(path);
+	else if (extension == ".ply")
+		return std::make_unique<PlyExporter>(path, normals);
+	else if (extension == ".gltf")
+		return std::make_unique<GltfExporter>(path);
+
+	return nullptr;
+}
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 3) {
+
+		std::fprintf(stderr, "Usage: %s input.bseg output.(obj|ply|gltf) [--sides n] [--threads n] [--batch n] [--normals 0|1] [--vertex-cache n]\n", argv[0]);
+		return 1;
+	}
+
+	const std::string inputPath = argv[1];
+	const std::string outputPath = argv[2];
+	int sides = 8;
+	unsigned threadCount = 0;
+	int batchSize = 4096;
+	bool normals = false;
+	int cacheSize = 0;
+
+	for (int i = 3; i < argc; i += 2) {
+
+		const std::string option = argv[i];
+
+		if (i + 1 == argc) {
+
+			std::fprintf(stderr, "Option %s needs a value\n", option.c_str());
+			return 1;
+		}
+
+		const char* value = argv[i + 1];
+
+		if (option == "--sides") sides = std::atoi(value);
+		else if (option == "--threads") threadCount = static_cast<unsigned>(std::atoi(value));
+		else if (option == "--batch") batchSize = std::max(1, std::atoi(value));
+		else if (option == "--normals") normals = std::atoi(value) != 0;
+		else if (option == "--vertex-cache") cacheSize = std::max(0, std::atoi(value));
+		else {
+
+			std::fprintf(stderr, "Unknown option %s\n", option.c_str());
+			return 1;
+		}
+	}
+
+	if (sides < 3) {
+
+		std::fprintf(stderr, "Need at least 3 sides for tubes; strips are chosen per branchlet in the stream\n");
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	SegmentStream stream(inputPath);
+	if (!stream.isOpen())
+		return 1;
+
+	std::unique_ptr<MeshExporter> exporter = makeExporter(outputPath, normals);
+	if (exporter == nullptr) {
+
+		std::fprintf(stderr, "Can't tell the output format of %s; use .obj, .ply or .gltf\n", outputPath.c_str());
+		return 1;
+	}
+
+	if (!exporter->isOpen())
+		return 1;
+
+	// Tubes and strips both write to the one exporter, which numbers their vertices on from each other's
+	VertexCacheSettings cacheSettings;
+	cacheSettings.cacheSize = cacheSize;
+	VertexCacheExporter reorderer(exporter.get(), cacheSettings);
+	MeshExporter* output = cacheSize > 0 ? static_cast<MeshExporter*>(&reorderer) : exporter.get();
+
+	Branchlets tubes(sides);
+	BranchletStrips strips;
+	tubes.setExporter(output);
+	strips.setExporter(output);
+	tubes.setNormals(normals);
+	strips.setNormals(normals);
+
+	for (int first = 0; first < stream.branchCount(); first += batchSize) {
+
+		tubes.addStream(stream, first, batchSize, threadCount);
+		strips.addStream(stream, first, batchSize, threadCount);
+	}
+
+	if (!output->finish())
+		return 1;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const MeshCounts& written = exporter->counts();
+
+	std::printf("%d branchlets, %lld segments -> %d vertices, %d faces in %.2f s (%.0f segments/s, %u threads)\n", stream.branchCount(),
+		stream.segmentCount(), written.verts, written.faces, seconds, stream.segmentCount() / seconds, resolveThreadCount(threadCount));
+
+	if (cacheSize > 0)
+		std::printf("Average cache miss ratio %.3f before reordering, %.3f after\n", reorderer.stats().acmrBefore(), reorderer.stats().acmrAfter());
+
+	return 0;
+}